@@ -20,6 +20,9 @@
 #ifndef _FIRM_HASH_STRING_H_
 #define _FIRM_HASH_STRING_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define _FIRM_FNV_OFFSET_BASIS 2166136261U
 #define _FIRM_FNV_FNV_PRIME 16777619U
 
@@ -51,4 +54,35 @@ unsigned hash_string_size(const char* str, size_t size)
 	return hash;
 }
 
+/**
+ * Hashes size bytes eight at a time. The words are assembled in little endian
+ * order, so the result does not depend on the host (the keyword table is
+ * generated at build time with this hash).
+ */
+static inline __attribute__((pure))
+unsigned hash_string_words(const char* str, size_t size)
+{
+	const unsigned char *p    = (const unsigned char*) str;
+	uint64_t             hash = 0xCBF29CE484222325ULL ^ size;
+
+	for (; size >= 8; size -= 8, p += 8) {
+		uint64_t word = (uint64_t) p[0]       | (uint64_t) p[1] <<  8
+		              | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+		              | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+		              | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+		hash  = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+	if (size > 0) {
+		uint64_t word = 0;
+		for (unsigned shift = 0; size > 0; --size, shift += 8) {
+			word |= (uint64_t) *p++ << shift;
+		}
+		hash  = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+
+	return (unsigned) hash;
+}
+
 #endif
@@ -1217,6 +1217,26 @@ static void print_storage_class(storage_class_tag_t storage_class)
 	panic("invalid storage class");
 }
 
+long get_initializer_data_value(const initializer_data_t *initializer,
+                                size_t index)
+{
+	atomic_type_kind_t   akind = initializer->element_type->atomic.akind;
+	unsigned             size  = get_atomic_type_size(akind);
+	const unsigned char *bytes = initializer->data + index * size;
+
+	unsigned long value = 0;
+	for (unsigned i = size; i-- > 0;) {
+		value = value << 8 | bytes[i];
+	}
+	/* sign extend */
+	if (size < sizeof(long)
+	    && (get_atomic_type_flags(akind) & ATOMIC_TYPE_FLAG_SIGNED)) {
+		unsigned long sign = 1UL << (8 * size - 1);
+		value = (value ^ sign) - sign;
+	}
+	return (long) value;
+}
+
 /**
  * Print an initializer.
  *
@@ -1261,6 +1281,15 @@ void print_initializer(const initializer_t *initializer)
 		print_designator(initializer->designator.designator);
 		print_string(" = ");
 		return;
+	case INITIALIZER_DATA: {
+		const initializer_data_t *data = &initializer->data;
+		for (size_t i = 0; i < data->len; ++i) {
+			if (i > 0)
+				print_string(", ");
+			print_format("%ld", get_initializer_data_value(data, i));
+		}
+		return;
+	}
 	}
 
 	panic("invalid initializer kind found");
@@ -1547,6 +1576,7 @@ expression_classification_t is_constant_initializer(const initializer_t *initial
 	case INITIALIZER_STRING:
 	case INITIALIZER_WIDE_STRING:
 	case INITIALIZER_DESIGNATOR:
+	case INITIALIZER_DATA:
 		return EXPR_CLASS_CONSTANT;
 
 	case INITIALIZER_VALUE:
@@ -1805,7 +1835,7 @@ static expression_classification_t is_object_with_constant_address(const express
 	}
 }
 
-expression_classification_t is_constant_expression(const expression_t *expression)
+static expression_classification_t classify_expression(const expression_t *expression)
 {
 	switch (expression->kind) {
 	EXPR_LITERAL_CASES
@@ -1957,6 +1987,17 @@ expression_classification_t is_constant_expression(const expression_t *expressio
 	panic("invalid expression found (is constant expression)");
 }
 
+expression_classification_t is_constant_expression(const expression_t *expression)
+{
+	unsigned constant_class = expression->base.constant_class;
+	if (constant_class != 0)
+		return (expression_classification_t) (constant_class - 1);
+
+	expression_classification_t const result = classify_expression(expression);
+	((expression_t*) expression)->base.constant_class = result + 1;
+	return result;
+}
+
 /**
  * Initialize the AST construction.
  */
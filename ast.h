@@ -61,6 +61,7 @@ typedef struct initializer_value_t                   initializer_value_t;
 typedef struct initializer_string_t                  initializer_string_t;
 typedef struct initializer_wide_string_t             initializer_wide_string_t;
 typedef struct initializer_designator_t              initializer_designator_t;
+typedef struct initializer_data_t                    initializer_data_t;
 typedef union  initializer_t                         initializer_t;
 
 typedef struct statement_base_t                      statement_base_t;
@@ -75,6 +76,7 @@ typedef struct expression_statement_t                expression_statement_t;
 typedef struct goto_statement_t                      goto_statement_t;
 typedef struct label_statement_t                     label_statement_t;
 typedef struct case_label_statement_t                case_label_statement_t;
+typedef struct case_range_t                          case_range_t;
 typedef struct while_statement_t                     while_statement_t;
 typedef struct do_while_statement_t                  do_while_statement_t;
 typedef struct for_statement_t                       for_statement_t;
@@ -115,7 +117,7 @@ expression_classification_t is_constant_initializer(const initializer_t *initial
 
 /**
  * Returns true if a given expression is a compile time
- * constant.
+ * constant. The result is cached in the expression.
  *
  * @param expression  the expression to check
  */
@@ -127,9 +129,23 @@ expression_classification_t is_constant_expression(const expression_t *expressio
  */
 expression_classification_t is_address_constant(const expression_t *expression);
 
+/**
+ * Returns the value of an element of packed constant data.
+ */
+long get_initializer_data_value(const initializer_data_t *initializer,
+                                size_t index);
+
 long fold_constant_to_int(const expression_t *expression);
 bool fold_constant_to_bool(const expression_t *expression);
 
+/**
+ * Folds an integer constant expression without building firm nodes.
+ *
+ * @return false if the value is unknown or invalid (like a division by zero),
+ *         value is not changed then
+ */
+bool try_fold_constant_to_int(const expression_t *expression, long *value);
+
 /**
  * the type of a literal is usually the biggest type that can hold the value.
  * Since this is backend dependent the parses needs this call exposed.
@@ -50,6 +50,7 @@
 #include "entitymap_t.h"
 #include "driver/firm_opt.h"
 #include "driver/firm_cmdline.h"
+#include "driver/firm_timing.h"
 
 typedef struct trampoline_region trampoline_region;
 struct trampoline_region {
@@ -94,6 +95,8 @@ static ir_type            *current_outer_value_type;
 static ir_node            *current_static_link;
 
 static entitymap_t  entitymap;
+static entitymap_t  string_entities;      /**< entities of string literals */
+static entitymap_t  wide_string_entities; /**< entities of wide literals */
 
 static struct obstack asm_obst;
 
@@ -145,9 +148,12 @@ static const char *dbg_retrieve(const dbg_info *dbg, unsigned *line)
 	const source_position_t *pos = (const source_position_t*) dbg;
 	if (pos == NULL)
 		return NULL;
+
+	presumed_position_t presumed;
+	get_presumed_position(pos, &presumed);
 	if (line != NULL)
-		*line = pos->linenr;
-	return pos->input_name;
+		*line = presumed.linenr;
+	return presumed.input_name;
 }
 
 static dbg_info *get_dbg_info(const source_position_t *pos)
@@ -646,33 +652,6 @@ static ir_type *create_enum_type(enum_type_t *const type)
 {
 	type->base.firm_type = ir_type_int;
 
-	ir_mode   *const mode    = mode_int;
-	ir_tarval *const one     = get_mode_one(mode);
-	ir_tarval *      tv_next = get_mode_null(mode);
-
-	bool constant_folding_old = constant_folding;
-	constant_folding = true;
-
-	enum_t   *enume = type->enume;
-	entity_t *entry = enume->base.next;
-	for (; entry != NULL; entry = entry->base.next) {
-		if (entry->kind != ENTITY_ENUM_VALUE)
-			break;
-
-		expression_t *const init = entry->enum_value.value;
-		if (init != NULL) {
-			ir_node *const cnst = expression_to_firm(init);
-			if (!is_Const(cnst)) {
-				panic("couldn't fold constant");
-			}
-			tv_next = get_Const_tarval(cnst);
-		}
-		entry->enum_value.tv = tv_next;
-		tv_next = tarval_add(tv_next, one);
-	}
-
-	constant_folding = constant_folding_old;
-
 	return create_atomic_type(type->akind, (const type_t*) type);
 }
 
@@ -1097,16 +1076,16 @@ static ir_node *create_Const_from_bool(ir_mode *const mode, bool const v)
 }
 
 /**
- * Creates a SymConst node representing a wide string literal.
+ * Creates the entity of a wide string literal.
  *
- * @param literal   the wide string literal
+ * @param dbgi   debug info of the first use
+ * @param value  the (utf-8 encoded) value of the literal
  */
-static ir_node *wide_string_literal_to_firm(
-		const string_literal_expression_t *literal)
+static ir_entity *create_wide_string_entity(dbg_info *const dbgi,
+                                            const string_t *const value)
 {
 	ir_type  *const global_type = get_glob_type();
 	ir_type  *const elem_type   = ir_type_wchar_t;
-	dbg_info *const dbgi        = get_dbg_info(&literal->base.source_position);
 	ir_type  *const type        = new_type_array(1, elem_type);
 
 	ident     *const id     = id_unique("str.%u");
@@ -1116,7 +1095,7 @@ static ir_node *wide_string_literal_to_firm(
 	add_entity_linkage(entity, IR_LINKAGE_CONSTANT);
 
 	ir_mode      *const mode = get_type_mode(elem_type);
-	const size_t        slen = wstrlen(&literal->value);
+	const size_t        slen = wstrlen(value);
 
 	set_array_lower_bound_int(type, 0, 0);
 	set_array_upper_bound_int(type, 0, slen);
@@ -1124,9 +1103,9 @@ static ir_node *wide_string_literal_to_firm(
 	set_type_state(type, layout_fixed);
 
 	ir_initializer_t *initializer = create_initializer_compound(slen);
-	const char              *p    = literal->value.begin;
+	const char              *p    = value->begin;
 	for (size_t i = 0; i < slen; ++i) {
-		assert(p < literal->value.begin + literal->value.size);
+		assert(p < value->begin + value->size);
 		utf32             v   = read_utf8_char(&p);
 		ir_tarval        *tv  = new_tarval_from_long(v, mode);
 		ir_initializer_t *val = create_initializer_tarval(tv);
@@ -1134,22 +1113,21 @@ static ir_node *wide_string_literal_to_firm(
 	}
 	set_entity_initializer(entity, initializer);
 
-	return create_symconst(dbgi, entity);
+	return entity;
 }
 
 /**
- * Creates a SymConst node representing a string constant.
+ * Creates the entity of a string constant.
  *
- * @param src_pos    the source position of the string constant
+ * @param dbgi       debug info of the first use
  * @param id_prefix  a prefix for the name of the generated string constant
  * @param value      the value of the string constant
  */
-static ir_node *string_to_firm(const source_position_t *const src_pos,
-                               const char *const id_prefix,
-                               const string_t *const value)
+static ir_entity *create_string_entity(dbg_info *const dbgi,
+                                       const char *const id_prefix,
+                                       const string_t *const value)
 {
 	ir_type  *const global_type = get_glob_type();
-	dbg_info *const dbgi        = get_dbg_info(src_pos);
 	ir_type  *const type        = new_type_array(1, ir_type_const_char);
 
 	ident     *const id     = id_unique(id_prefix);
@@ -1177,6 +1155,46 @@ static ir_node *string_to_firm(const source_position_t *const src_pos,
 	}
 	set_entity_initializer(entity, initializer);
 
+	return entity;
+}
+
+/**
+ * Creates a SymConst node representing a string constant.
+ *
+ * @param src_pos    the source position of the string constant
+ * @param id_prefix  a prefix for the name of the generated string constant
+ * @param value      the value of the string constant
+ */
+static ir_node *string_to_firm(const source_position_t *const src_pos,
+                               const char *const id_prefix,
+                               const string_t *const value)
+{
+	dbg_info *const dbgi = get_dbg_info(src_pos);
+	return create_symconst(dbgi, create_string_entity(dbgi, id_prefix, value));
+}
+
+/**
+ * Creates a SymConst node representing a string literal. The lexer makes
+ * literals unique strings (see identify_string()), so all occurrences of a
+ * literal share one entity.
+ *
+ * @param src_pos  the source position of the literal
+ * @param value    the value of the literal
+ * @param is_wide  true for wide string literals
+ */
+static ir_node *string_literal_to_firm(const source_position_t *const src_pos,
+                                       const string_t *const value,
+                                       bool const is_wide)
+{
+	dbg_info    *const dbgi = get_dbg_info(src_pos);
+	entitymap_t *const map  = is_wide ? &wide_string_entities : &string_entities;
+
+	ir_entity *entity = entitymap_get(map, value->begin);
+	if (entity == NULL) {
+		entity = is_wide ? create_wide_string_entity(dbgi, value)
+		                 : create_string_entity(dbgi, "str.%u", value);
+		entitymap_insert(map, value->begin, entity);
+	}
 	return create_symconst(dbgi, entity);
 }
 
@@ -1269,15 +1287,14 @@ void determine_literal_type(literal_expression_t *literal)
 }
 
 /**
- * Creates a Const node representing a constant.
+ * Returns the value of a literal in the storage mode of its type.
  */
-static ir_node *literal_to_firm(const literal_expression_t *literal)
+static ir_tarval *literal_to_tarval(const literal_expression_t *literal)
 {
 	type_t     *type   = skip_typeref(literal->base.type);
 	ir_mode    *mode   = get_ir_mode_storage(type);
 	const char *string = literal->value.begin;
 	size_t      size   = literal->value.size;
-	ir_tarval  *tv;
 
 	switch (literal->base.kind) {
 	case EXPR_LITERAL_WIDE_CHARACTER: {
@@ -1285,8 +1302,7 @@ static ir_node *literal_to_firm(const literal_expression_t *literal)
 		char   buf[128];
 		size_t len = snprintf(buf, sizeof(buf), UTF32_PRINTF_FORMAT, v);
 
-		tv = new_tarval_from_str(buf, len, mode);
-		goto make_const;
+		return new_tarval_from_str(buf, len, mode);
 	}
 	case EXPR_LITERAL_CHARACTER: {
 		long long int v;
@@ -1301,45 +1317,46 @@ static ir_node *literal_to_firm(const literal_expression_t *literal)
 		char   buf[128];
 		size_t len = snprintf(buf, sizeof(buf), "%lld", v);
 
-		tv = new_tarval_from_str(buf, len, mode);
-		goto make_const;
+		return new_tarval_from_str(buf, len, mode);
 	}
 	case EXPR_LITERAL_INTEGER:
 	case EXPR_LITERAL_INTEGER_OCTAL:
 	case EXPR_LITERAL_INTEGER_HEXADECIMAL:
 		assert(literal->target_value != NULL);
-		tv = literal->target_value;
-		goto make_const;
+		return literal->target_value;
 	case EXPR_LITERAL_FLOATINGPOINT:
-		tv = new_tarval_from_str(string, size, mode);
-		goto make_const;
+		return new_tarval_from_str(string, size, mode);
 	case EXPR_LITERAL_FLOATINGPOINT_HEXADECIMAL: {
 		char buffer[size + 2];
 		memcpy(buffer, "0x", 2);
 		memcpy(buffer+2, string, size);
-		tv = new_tarval_from_str(buffer, size+2, mode);
-		goto make_const;
+		return new_tarval_from_str(buffer, size+2, mode);
 	}
 	case EXPR_LITERAL_BOOLEAN:
 		if (string[0] == 't') {
-			tv = get_mode_one(mode);
+			return get_mode_one(mode);
 		} else {
 			assert(string[0] == 'f');
-			tv = get_mode_null(mode);
+			return get_mode_null(mode);
 		}
-		goto make_const;
 	case EXPR_LITERAL_MS_NOOP:
-		tv = get_mode_null(mode);
-		goto make_const;
+		return get_mode_null(mode);
 	default:
 		break;
 	}
 	panic("Invalid literal kind found");
+}
 
-make_const: ;
-	dbg_info *dbgi       = get_dbg_info(&literal->base.source_position);
-	ir_node  *res        = new_d_Const(dbgi, tv);
-	ir_mode  *mode_arith = get_ir_mode_arithmetic(type);
+/**
+ * Creates a Const node representing a constant.
+ */
+static ir_node *literal_to_firm(const literal_expression_t *literal)
+{
+	type_t    *type       = skip_typeref(literal->base.type);
+	ir_tarval *tv         = literal_to_tarval(literal);
+	dbg_info  *dbgi       = get_dbg_info(&literal->base.source_position);
+	ir_node   *res        = new_d_Const(dbgi, tv);
+	ir_mode   *mode_arith = get_ir_mode_arithmetic(type);
 	return create_conv(dbgi, res, mode_arith);
 }
 
@@ -1516,10 +1533,9 @@ static ir_node *reference_expression_enum_value_to_firm(
 {
 	entity_t *entity = ref->entity;
 	type_t   *type   = skip_typeref(entity->enum_value.enum_type);
-	/* make sure the type is constructed */
-	(void) get_ir_type(type);
+	ir_mode  *mode   = get_ir_mode_storage(type);
 
-	return new_Const(entity->enum_value.tv);
+	return new_Const_long(mode, entity->enum_value.folded_value);
 }
 
 static ir_node *reference_expression_to_firm(const reference_expression_t *ref)
@@ -2928,13 +2944,8 @@ static long get_offsetof_offset(const offsetof_expression_t *expression)
 			symbol_t *symbol = designator->symbol;
 
 			compound_t *compound = type->compound.compound;
-			entity_t   *iter     = compound->members.entities;
-			for ( ; iter != NULL; iter = iter->base.next) {
-				if (iter->base.symbol == symbol) {
-					break;
-				}
-			}
-			assert(iter != NULL);
+			entity_t   *iter     = find_compound_member(compound, symbol, NULL);
+			assert(iter != NULL && iter->base.symbol == symbol);
 
 			assert(iter->kind == ENTITY_COMPOUND_MEMBER);
 			assert(iter->declaration.kind == DECLARATION_KIND_COMPOUND_MEMBER);
@@ -2960,12 +2971,17 @@ static long get_offsetof_offset(const offsetof_expression_t *expression)
 	return offset;
 }
 
+static ir_tarval *offsetof_to_tarval(const offsetof_expression_t *expression)
+{
+	ir_mode *mode   = get_ir_mode_arithmetic(expression->base.type);
+	long     offset = get_offsetof_offset(expression);
+	return new_tarval_from_long(offset, mode);
+}
+
 static ir_node *offsetof_to_firm(const offsetof_expression_t *expression)
 {
-	ir_mode   *mode   = get_ir_mode_arithmetic(expression->base.type);
-	long       offset = get_offsetof_offset(expression);
-	ir_tarval *tv     = new_tarval_from_long(offset, mode);
-	dbg_info  *dbgi   = get_dbg_info(&expression->base.source_position);
+	ir_tarval *tv   = offsetof_to_tarval(expression);
+	dbg_info  *dbgi = get_dbg_info(&expression->base.source_position);
 
 	return new_d_Const(dbgi, tv);
 }
@@ -3042,9 +3058,9 @@ static unsigned get_cparser_entity_alignment(const entity_t *entity)
 }
 
 /**
- * Transform an alignof expression into Firm code.
+ * Returns the value of an alignof expression.
  */
-static ir_node *alignof_to_firm(const typeprop_expression_t *expression)
+static ir_tarval *alignof_to_tarval(const typeprop_expression_t *expression)
 {
 	unsigned alignment = 0;
 
@@ -3066,25 +3082,304 @@ static ir_node *alignof_to_firm(const typeprop_expression_t *expression)
 		alignment = get_type_alignment(type);
 	}
 
+	ir_mode *mode = get_ir_mode_arithmetic(expression->base.type);
+	return new_tarval_from_long(alignment, mode);
+}
+
+/**
+ * Transform an alignof expression into Firm code.
+ */
+static ir_node *alignof_to_firm(const typeprop_expression_t *expression)
+{
 	dbg_info  *dbgi = get_dbg_info(&expression->base.source_position);
-	ir_mode   *mode = get_ir_mode_arithmetic(expression->base.type);
-	ir_tarval *tv   = new_tarval_from_long(alignment, mode);
+	ir_tarval *tv   = alignof_to_tarval(expression);
 	return new_d_Const(dbgi, tv);
 }
 
 static void init_ir_types(void);
+static ir_tarval *classify_type_to_tarval(
+		const classify_type_expression_t *const expr);
+static ir_tarval *evaluate_constant(const expression_t *expression);
+
+static ir_tarval *tarval_from_bool(ir_mode *const mode, bool const v)
+{
+	return (v ? get_mode_one : get_mode_null)(mode);
+}
+
+/**
+ * Returns the truth value of a constant expression, -1 if it cannot be
+ * evaluated.
+ */
+static int evaluate_condition(const expression_t *expression)
+{
+	ir_tarval *tv = evaluate_constant(expression);
+	if (tv == NULL)
+		return -1;
+	return tarval_cmp(tv, get_mode_null(get_tarval_mode(tv)))
+		!= ir_relation_equal;
+}
+
+/**
+ * Evaluates a cast of a constant value like create_cast() does.
+ */
+static ir_tarval *evaluate_cast(ir_tarval *tv, type_t *from_type,
+                                type_t *type)
+{
+	type      = skip_typeref(type);
+	from_type = skip_typeref(from_type);
+	if (!is_type_scalar(type))
+		return NULL;
+	/* __based pointers need the address of their base */
+	if (is_type_pointer(type) && is_type_pointer(from_type)
+			&& type->pointer.base_variable != from_type->pointer.base_variable)
+		return NULL;
+
+	ir_mode *mode = get_ir_mode_storage(type);
+	if (is_type_atomic(type, ATOMIC_TYPE_BOOL)) {
+		ir_tarval *null = get_mode_null(get_tarval_mode(tv));
+		tv = tarval_from_bool(mode, tarval_cmp(tv, null) != ir_relation_equal);
+	} else {
+		tv = tarval_convert_to(tv, mode);
+	}
+	if (tv == tarval_bad)
+		return NULL;
+	return tarval_convert_to(tv, get_ir_mode_arithmetic(type));
+}
+
+static ir_tarval *evaluate_unary(const unary_expression_t *expression)
+{
+	type_t    *type = skip_typeref(expression->base.type);
+	ir_tarval *tv   = evaluate_constant(expression->value);
+	if (tv == NULL)
+		return NULL;
+
+	switch (expression->base.kind) {
+	case EXPR_UNARY_NEGATE:
+		return tarval_neg(tarval_convert_to(tv, get_ir_mode_arithmetic(type)));
+	case EXPR_UNARY_PLUS:
+		return tv;
+	case EXPR_UNARY_BITWISE_NEGATE:
+		return tarval_not(tarval_convert_to(tv, get_ir_mode_arithmetic(type)));
+	case EXPR_UNARY_NOT: {
+		ir_tarval *null  = get_mode_null(get_tarval_mode(tv));
+		bool       value = tarval_cmp(tv, null) == ir_relation_equal;
+		return tarval_from_bool(get_ir_mode_arithmetic(type), value);
+	}
+	case EXPR_UNARY_CAST:
+	case EXPR_UNARY_CAST_IMPLICIT:
+		return evaluate_cast(tv, expression->value->base.type, type);
+	default:
+		return NULL;
+	}
+}
+
+static ir_tarval *evaluate_binary(const binary_expression_t *expression)
+{
+	expression_kind_t kind = expression->base.kind;
+	type_t           *type = skip_typeref(expression->base.type);
+
+	if (kind == EXPR_BINARY_LOGICAL_AND || kind == EXPR_BINARY_LOGICAL_OR) {
+		ir_mode *mode = get_ir_mode_arithmetic(type);
+		int      left = evaluate_condition(expression->left);
+		if (left < 0)
+			return NULL;
+		if (kind == EXPR_BINARY_LOGICAL_AND ? !left : left)
+			return tarval_from_bool(mode, left);
+		int right = evaluate_condition(expression->right);
+		if (right < 0)
+			return NULL;
+		return tarval_from_bool(mode, right);
+	}
+
+	type_t *type_left  = skip_typeref(expression->left->base.type);
+	type_t *type_right = skip_typeref(expression->right->base.type);
+	/* pointer arithmetic needs the size of the points-to type */
+	if (is_type_pointer(type_left) || is_type_pointer(type_right)) {
+		switch (kind) {
+		case EXPR_BINARY_ADD:
+		case EXPR_BINARY_SUB:
+			return NULL;
+		default:
+			break;
+		}
+	}
+
+	ir_tarval *left  = evaluate_constant(expression->left);
+	if (left == NULL)
+		return NULL;
+	ir_tarval *right = evaluate_constant(expression->right);
+	if (right == NULL)
+		return NULL;
+
+	switch (kind) {
+	case EXPR_BINARY_EQUAL:
+	case EXPR_BINARY_NOTEQUAL:
+	case EXPR_BINARY_LESS:
+	case EXPR_BINARY_LESSEQUAL:
+	case EXPR_BINARY_GREATER:
+	case EXPR_BINARY_GREATEREQUAL:
+	case EXPR_BINARY_ISGREATER:
+	case EXPR_BINARY_ISGREATEREQUAL:
+	case EXPR_BINARY_ISLESS:
+	case EXPR_BINARY_ISLESSEQUAL:
+	case EXPR_BINARY_ISLESSGREATER:
+	case EXPR_BINARY_ISUNORDERED: {
+		if (get_tarval_mode(left) != get_tarval_mode(right))
+			return NULL;
+		ir_relation relation = get_relation(kind);
+		bool        value    = (tarval_cmp(left, right) & relation) != 0;
+		return tarval_from_bool(get_ir_mode_arithmetic(type), value);
+	}
+
+	case EXPR_BINARY_SHIFTLEFT:
+	case EXPR_BINARY_SHIFTRIGHT: {
+		ir_mode *mode = get_tarval_mode(left);
+		right = tarval_convert_to(right, mode_uint);
+		if (kind == EXPR_BINARY_SHIFTLEFT)
+			return tarval_shl(left, right);
+		return mode_is_signed(mode) ? tarval_shrs(left, right)
+		                            : tarval_shr(left, right);
+	}
+
+	default:
+		break;
+	}
+
+	/* like create_op(): the right operand determines the mode */
+	ir_mode *mode = get_ir_mode_arithmetic(type_right);
+	left = tarval_convert_to(left, mode);
+	if (get_tarval_mode(right) != mode)
+		return NULL;
+
+	switch (kind) {
+	case EXPR_BINARY_ADD:         return tarval_add(left, right);
+	case EXPR_BINARY_SUB:         return tarval_sub(left, right);
+	case EXPR_BINARY_MUL:         return tarval_mul(left, right);
+	case EXPR_BINARY_BITWISE_AND: return tarval_and(left, right);
+	case EXPR_BINARY_BITWISE_OR:  return tarval_or(left, right);
+	case EXPR_BINARY_BITWISE_XOR: return tarval_eor(left, right);
+	case EXPR_BINARY_DIV:
+	case EXPR_BINARY_MOD:
+		/* leave division by zero to the firm construction */
+		if (!mode_is_float(mode) && tarval_is_null(right))
+			return NULL;
+		return kind == EXPR_BINARY_DIV ? tarval_div(left, right)
+		                               : tarval_mod(left, right);
+	default:
+		return NULL;
+	}
+}
+
+static ir_tarval *evaluate_sizeof(const typeprop_expression_t *expression)
+{
+	type_t *const type = skip_typeref(expression->type);
+	if (is_type_array(type) && type->array.is_vla)
+		return NULL;
+	/* strange gnu extensions: sizeof(function) == 1 */
+	ir_mode *mode = get_ir_mode_storage(type_size_t);
+	if (is_type_function(type))
+		return get_mode_one(mode);
+
+	ir_type *irtype = get_ir_type(type);
+	if (get_type_state(irtype) != layout_fixed)
+		return NULL;
+	return new_tarval_from_long(get_type_size_bytes(irtype), mode);
+}
+
+static ir_tarval *evaluate_constant_expression(const expression_t *expression)
+{
+	switch (expression->kind) {
+	EXPR_LITERAL_CASES {
+		type_t *type = skip_typeref(expression->base.type);
+		return tarval_convert_to(literal_to_tarval(&expression->literal),
+		                         get_ir_mode_arithmetic(type));
+	}
+	case EXPR_REFERENCE_ENUM_VALUE: {
+		entity_t *entity = expression->reference.entity;
+		type_t   *type   = skip_typeref(entity->enum_value.enum_type);
+		return new_tarval_from_long(entity->enum_value.folded_value,
+		                            get_ir_mode_storage(type));
+	}
+	EXPR_UNARY_CASES
+		return evaluate_unary(&expression->unary);
+	EXPR_BINARY_CASES
+		return evaluate_binary(&expression->binary);
+	case EXPR_SIZEOF:
+		return evaluate_sizeof(&expression->typeprop);
+	case EXPR_ALIGNOF:
+		return alignof_to_tarval(&expression->typeprop);
+	case EXPR_OFFSETOF:
+		return offsetof_to_tarval(&expression->offsetofe);
+	case EXPR_CLASSIFY_TYPE:
+		return classify_type_to_tarval(&expression->classify_type);
+	case EXPR_BUILTIN_CONSTANT_P: {
+		ir_mode *mode  = get_ir_mode_arithmetic(expression->base.type);
+		bool     value = is_constant_expression(
+				expression->builtin_constant.value) == EXPR_CLASS_CONSTANT;
+		return tarval_from_bool(mode, value);
+	}
+	case EXPR_BUILTIN_TYPES_COMPATIBLE_P: {
+		const builtin_types_compatible_expression_t *compatible
+			= &expression->builtin_types_compatible;
+		type_t  *left  = get_unqualified_type(skip_typeref(compatible->left));
+		type_t  *right = get_unqualified_type(skip_typeref(compatible->right));
+		ir_mode *mode  = get_ir_mode_arithmetic(expression->base.type);
+		return tarval_from_bool(mode, types_compatible(left, right));
+	}
+	case EXPR_CONDITIONAL: {
+		const conditional_expression_t *conditional = &expression->conditional;
+		int condition = evaluate_condition(conditional->condition);
+		if (condition < 0)
+			return NULL;
+		if (!condition)
+			return evaluate_constant(conditional->false_expression);
+		if (conditional->true_expression == NULL)
+			return evaluate_constant(conditional->condition);
+		return evaluate_constant(conditional->true_expression);
+	}
+	default:
+		/* addresses, builtin calls, compound literals */
+		return NULL;
+	}
+}
+
+/**
+ * Evaluates an expression on the AST with tarval arithmetic. The result is
+ * cached in the expression.
+ *
+ * @return the value in the arithmetic mode of the expression type or NULL if
+ *         the expression has no value known without building firm nodes
+ */
+static ir_tarval *evaluate_constant(const expression_t *expression)
+{
+	ir_tarval *tv = expression->base.folded;
+	if (tv != NULL)
+		return tv;
+	if (is_constant_expression(expression) != EXPR_CLASS_CONSTANT)
+		return NULL;
+
+	tv = evaluate_constant_expression(expression);
+	if (tv == NULL || tv == tarval_bad)
+		return NULL;
+	((expression_t*) expression)->base.folded = tv;
+	return tv;
+}
 
 static ir_tarval *fold_constant_to_tarval(const expression_t *expression)
 {
 	assert(is_type_valid(skip_typeref(expression->base.type)));
 
-	bool constant_folding_old = constant_folding;
-	constant_folding = true;
-
 	init_ir_types();
 
 	assert(is_constant_expression(expression) == EXPR_CLASS_CONSTANT);
 
+	ir_tarval *tv = evaluate_constant(expression);
+	if (tv != NULL)
+		return tv;
+
+	bool constant_folding_old = constant_folding;
+	constant_folding = true;
+
 	ir_graph *old_current_ir_graph = current_ir_graph;
 	current_ir_graph = get_const_code_irg();
 
@@ -3097,7 +3392,9 @@ static ir_tarval *fold_constant_to_tarval(const expression_t *expression)
 
 	constant_folding = constant_folding_old;
 
-	return get_Const_tarval(cnst);
+	tv = get_Const_tarval(cnst);
+	((expression_t*) expression)->base.folded = tv;
+	return tv;
 }
 
 long fold_constant_to_int(const expression_t *expression)
@@ -3113,6 +3410,21 @@ long fold_constant_to_int(const expression_t *expression)
 	return get_tarval_long(tv);
 }
 
+bool try_fold_constant_to_int(const expression_t *expression, long *value)
+{
+	if (expression->kind == EXPR_INVALID)
+		return false;
+
+	init_ir_types();
+
+	ir_tarval *tv = evaluate_constant(expression);
+	if (tv == NULL || !tarval_is_long(tv))
+		return false;
+
+	*value = get_tarval_long(tv);
+	return true;
+}
+
 bool fold_constant_to_bool(const expression_t *expression)
 {
 	if (expression->kind == EXPR_INVALID)
@@ -3254,7 +3566,8 @@ typedef enum gcc_type_class
 	lang_type_class
 } gcc_type_class;
 
-static ir_node *classify_type_to_firm(const classify_type_expression_t *const expr)
+static ir_tarval *classify_type_to_tarval(
+		const classify_type_expression_t *const expr)
 {
 	type_t *type = expr->type_expression->base.type;
 
@@ -3329,8 +3642,13 @@ static ir_node *classify_type_to_firm(const classify_type_expression_t *const ex
 	}
 
 make_const:;
+	return new_tarval_from_long(tc, mode_int);
+}
+
+static ir_node *classify_type_to_firm(const classify_type_expression_t *const expr)
+{
 	dbg_info  *const dbgi = get_dbg_info(&expr->base.source_position);
-	ir_tarval *const tv   = new_tarval_from_long(tc, mode_int);
+	ir_tarval *const tv   = classify_type_to_tarval(expr);
 	return new_d_Const(dbgi, tv);
 }
 
@@ -3528,10 +3846,11 @@ static ir_node *_expression_to_firm(const expression_t *expression)
 	EXPR_LITERAL_CASES
 		return literal_to_firm(&expression->literal);
 	case EXPR_STRING_LITERAL:
-		return string_to_firm(&expression->base.source_position, "str.%u",
-		                      &expression->literal.value);
+		return string_literal_to_firm(&expression->base.source_position,
+		                              &expression->literal.value, false);
 	case EXPR_WIDE_STRING_LITERAL:
-		return wide_string_literal_to_firm(&expression->string_literal);
+		return string_literal_to_firm(&expression->base.source_position,
+		                              &expression->string_literal.value, true);
 	case EXPR_REFERENCE:
 		return reference_expression_to_firm(&expression->reference);
 	case EXPR_REFERENCE_ENUM_VALUE:
@@ -3909,18 +4228,12 @@ static void walk_designator(type_path_t *path, const designator_t *designator)
 
 		if (designator->symbol != NULL) {
 			assert(is_type_compound(type));
-			size_t    index  = 0;
+			size_t    index;
 			symbol_t *symbol = designator->symbol;
 
 			compound_t *compound = type->compound.compound;
-			entity_t   *iter     = compound->members.entities;
-			for ( ; iter != NULL; iter = iter->base.next, ++index) {
-				if (iter->base.symbol == symbol) {
-					assert(iter->kind == ENTITY_COMPOUND_MEMBER);
-					break;
-				}
-			}
-			assert(iter != NULL);
+			entity_t   *iter     = find_compound_member(compound, symbol, &index);
+			assert(iter != NULL && iter->base.symbol == symbol);
 
 			/* revert previous initialisations of other union elements */
 			if (type->kind == TYPE_COMPOUND_UNION) {
@@ -4062,6 +4375,36 @@ static bool is_string_type(type_t *type)
 	return is_type_integer(inner);
 }
 
+/**
+ * Initializes consecutive scalar objects of path with the packed values of a
+ * data initializer. libfirm has no initializer for raw bytes, but tarval
+ * initializers need no nodes, so this stays cheap even for huge tables.
+ */
+static void walk_initializer_data(type_path_t *path,
+                                  const initializer_data_t *initializer)
+{
+	ir_mode *mode = get_ir_mode_storage(initializer->element_type);
+
+	for (size_t i = 0; i < initializer->len; ++i) {
+		/* we might have to descend into types until we're at a scalar type */
+		while (!is_type_scalar(skip_typeref(path->top_type))) {
+			descend_into_subtype(path);
+		}
+
+		long              value = get_initializer_data_value(initializer, i);
+		ir_tarval        *tv    = new_tarval_from_long(value, mode);
+		ir_initializer_t *init  = create_initializer_tarval(tv);
+
+		size_t path_len = ARR_LEN(path->path);
+		assert(path_len >= 1);
+		type_path_entry_t *entry = &path->path[path_len-1];
+		set_initializer_compound_value(entry->initializer, entry->index,
+		                               init);
+
+		advance_current_object(path);
+	}
+}
+
 static ir_initializer_t *create_ir_initializer_list(
 		const initializer_list_t *initializer, type_t *type)
 {
@@ -4080,6 +4423,11 @@ static ir_initializer_t *create_ir_initializer_list(
 			continue;
 		}
 
+		if (sub_initializer->kind == INITIALIZER_DATA) {
+			walk_initializer_data(&path, &sub_initializer->data);
+			continue;
+		}
+
 		if (sub_initializer->kind == INITIALIZER_VALUE) {
 			/* we might have to descend into types until we're at a scalar
 			 * type */
@@ -4198,6 +4546,9 @@ static ir_initializer_t *create_ir_initializer(
 
 		case INITIALIZER_DESIGNATOR:
 			panic("unexpected designator initializer found");
+
+		case INITIALIZER_DATA:
+			panic("unexpected data initializer found");
 	}
 	panic("unknown initializer");
 }
@@ -5089,53 +5440,25 @@ static void switch_statement_to_firm(switch_statement_t *statement)
 	current_switch                       = statement;
 
 	/* determine a free number for the default label */
-	unsigned long num_cases       = 0;
-	long          default_proj_nr = 0;
-	for (case_label_statement_t *l = statement->first_case; l != NULL; l = l->next) {
-		if (l->expression == NULL) {
-			/* default case */
-			continue;
-		}
-		if (l->last_case >= l->first_case)
-			num_cases += l->last_case - l->first_case + 1;
-		if (l->last_case > default_proj_nr)
-			default_proj_nr = l->last_case;
-	}
+	const case_range_t *ranges          = statement->case_ranges;
+	size_t              n_ranges        = statement->n_case_ranges;
+	long                default_proj_nr = 0;
+	if (n_ranges > 0 && ranges[n_ranges - 1].last > 0)
+		default_proj_nr = ranges[n_ranges - 1].last;
 
 	if (default_proj_nr == INT_MAX) {
 		/* Bad: an overflow will occur, we cannot be sure that the
-		 * maximum + 1 is a free number. Scan the values a second
-		 * time to find a free number.
+		 * maximum + 1 is a free number. Take the first gap between the
+		 * (sorted) non-negative case values instead.
 		 */
-		unsigned char *bits = xmalloc((num_cases + 7) >> 3);
-
-		memset(bits, 0, (num_cases + 7) >> 3);
-		for (case_label_statement_t *l = statement->first_case; l != NULL; l = l->next) {
-			if (l->expression == NULL) {
-				/* default case */
+		default_proj_nr = 0;
+		for (size_t i = 0; i < n_ranges; ++i) {
+			if (ranges[i].last < default_proj_nr)
 				continue;
-			}
-			unsigned long start = l->first_case > 0 ? (unsigned long)l->first_case : 0;
-			if (start < num_cases && l->last_case >= 0) {
-				unsigned long end  = (unsigned long)l->last_case < num_cases ?
-					(unsigned long)l->last_case : num_cases - 1;
-				for (unsigned long cns = start; cns <= end; ++cns) {
-					bits[cns >> 3] |= (1 << (cns & 7));
-				}
-			}
-		}
-		/* We look at the first num_cases constants:
-		 * Either they are dense, so we took the last (num_cases)
-		 * one, or they are not dense, so we will find one free
-		 * there...
-		 */
-		unsigned long i;
-		for (i = 0; i < num_cases; ++i)
-			if ((bits[i >> 3] & (1 << (i & 7))) == 0)
+			if (ranges[i].first > default_proj_nr)
 				break;
-
-		free(bits);
-		default_proj_nr = i;
+			default_proj_nr = ranges[i].last + 1;
+		}
 	} else {
 		++default_proj_nr;
 	}
@@ -5771,6 +6094,8 @@ static void create_function(entity_t *entity)
 	if (entity->function.statement == NULL)
 		return;
 
+	timer_trace_begin("create_function", entity->base.symbol->string);
+
 	if (is_main(entity) && enable_main_collect2_hack) {
 		prepare_main_collect2(entity);
 	}
@@ -5929,6 +6254,8 @@ static void create_function(entity_t *entity)
 		current_outer_value_type = rem_outer_value_type;
 		current_outer_frame      = rem_outer_frame;
 	}
+
+	timer_trace_end();
 }
 
 static void scope_to_firm(scope_t *scope)
@@ -5987,6 +6314,8 @@ void init_ast2firm(void)
 	}
 
 	entitymap_init(&entitymap);
+	entitymap_init(&string_entities);
+	entitymap_init(&wide_string_entities);
 }
 
 static void init_ir_types(void)
@@ -6010,6 +6339,8 @@ static void init_ir_types(void)
 
 void exit_ast2firm(void)
 {
+	entitymap_destroy(&wide_string_entities);
+	entitymap_destroy(&string_entities);
 	entitymap_destroy(&entitymap);
 	obstack_free(&asm_obst, NULL);
 }
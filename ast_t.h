@@ -250,6 +250,8 @@ struct expression_base_t {
 	expression_kind_t   kind;            /**< The expression kind. */
 	type_t             *type;            /**< The type of the expression. */
 	source_position_t   source_position; /**< The source position of this expression. */
+	ir_tarval          *folded;          /**< The value of a constant expression once folded. */
+	unsigned            constant_class : 2; /**< is_constant_expression() plus one once known, 0 else. */
 	bool                parenthesized : 1;
 #ifndef NDEBUG
 	bool                transformed : 1;     /**< Set if this expression was transformed. */
@@ -432,7 +434,8 @@ typedef enum initializer_kind_t {
 	INITIALIZER_LIST,
 	INITIALIZER_STRING,
 	INITIALIZER_WIDE_STRING,
-	INITIALIZER_DESIGNATOR
+	INITIALIZER_DESIGNATOR,
+	INITIALIZER_DATA
 } initializer_kind_t;
 
 struct initializer_base_t {
@@ -465,6 +468,17 @@ struct initializer_designator_t {
 	designator_t       *designator;
 };
 
+/**
+ * Packed values of consecutive integer constants in an initializer list.
+ * Stands for len value initializers of element_type.
+ */
+struct initializer_data_t {
+	initializer_base_t  base;
+	type_t             *element_type; /**< The type of all elements. */
+	size_t              len;          /**< The number of elements. */
+	unsigned char       data[];       /**< The values, little endian with the size of element_type each. */
+};
+
 union initializer_t {
 	initializer_kind_t        kind;
 	initializer_base_t        base;
@@ -473,6 +487,7 @@ union initializer_t {
 	initializer_string_t      string;
 	initializer_wide_string_t wide_string;
 	initializer_designator_t  designator;
+	initializer_data_t        data;
 };
 
 /**
@@ -547,12 +562,23 @@ struct if_statement_t {
 	statement_t      *false_statement;
 };
 
+/**
+ * A range of values handled by the cases of a switch statement.
+ */
+struct case_range_t {
+	long                    first;
+	long                    last;
+	case_label_statement_t *label;   /**< The first case label handling a value of the range. */
+};
+
 struct switch_statement_t {
 	statement_base_t        base;
 	expression_t           *expression;
 	statement_t            *body;
 	case_label_statement_t *first_case, *last_case;  /**< List of all cases, including default. */
 	case_label_statement_t *default_label;           /**< The default label if existent. */
+	case_range_t           *case_ranges;             /**< The values of all valid cases as disjoint ranges sorted by value. */
+	size_t                  n_case_ranges;           /**< The number of case ranges. */
 	unsigned long           default_proj_nr;         /**< The Proj-number for the default Proj. */
 };
 
@@ -0,0 +1,234 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#define getpid()          _getpid()
+#else
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+#include "symbol_t.h"
+#include "adt/xmalloc.h"
+
+bool cache_hash_tokens = false;
+
+/** the key consists of two differently computed 64 bit hashes */
+typedef struct cache_key_t {
+	uint64_t fnv;
+	uint64_t mix;
+} cache_key_t;
+
+static char        *cache_directory;
+static bool         cache_hash_positions;
+static cache_key_t  base_key;
+static cache_key_t  key;
+static char         key_path[4096];
+
+static void hash_bytes(const void *data, size_t size)
+{
+	const unsigned char *p   = data;
+	uint64_t             fnv = key.fnv;
+	uint64_t             mix = key.mix;
+	for (size_t i = 0; i < size; ++i) {
+		fnv ^= p[i];
+		fnv *= UINT64_C(0x100000001b3);
+		mix  = ((mix << 5) | (mix >> 59)) ^ p[i];
+		mix *= UINT64_C(0x9e3779b97f4a7c15);
+	}
+	key.fnv = fnv;
+	key.mix = mix;
+}
+
+static void hash_string_size(const char *string, size_t size)
+{
+	/* the length avoids ambiguities between consecutive strings */
+	uint32_t len = (uint32_t) size;
+	hash_bytes(&len, sizeof(len));
+	hash_bytes(string, size);
+}
+
+void init_cache(const char *directory)
+{
+	if (cache_directory != NULL)
+		return;
+
+	if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "warning: couldn't create cache directory '%s': %s\n",
+		        directory, strerror(errno));
+		return;
+	}
+	cache_directory = xstrdup(directory);
+	key.fnv         = UINT64_C(0xcbf29ce484222325);
+	key.mix         = UINT64_C(0x6a09e667f3bcc908);
+	base_key        = key;
+}
+
+void exit_cache(void)
+{
+	free(cache_directory);
+	cache_directory   = NULL;
+	cache_hash_tokens = false;
+}
+
+void cache_hash_string(const char *string)
+{
+	if (cache_directory == NULL)
+		return;
+	hash_string_size(string, strlen(string));
+}
+
+void cache_save_base(void)
+{
+	base_key          = key;
+	cache_hash_tokens = false;
+}
+
+void cache_start(bool hash_positions)
+{
+	if (cache_directory == NULL)
+		return;
+	key                  = base_key;
+	cache_hash_positions = hash_positions;
+	cache_hash_tokens    = true;
+}
+
+void cache_hash_token(const token_t *token)
+{
+	int32_t type = token->type;
+	hash_bytes(&type, sizeof(type));
+
+	switch (token->type) {
+	case T_IDENTIFIER:
+		hash_string_size(token->symbol->string, strlen(token->symbol->string));
+		break;
+
+	case T_INTEGER:
+	case T_INTEGER_OCTAL:
+	case T_INTEGER_HEXADECIMAL:
+	case T_FLOATINGPOINT:
+	case T_FLOATINGPOINT_HEXADECIMAL:
+	case T_CHARACTER_CONSTANT:
+	case T_WIDE_CHARACTER_CONSTANT:
+	case T_STRING_LITERAL:
+	case T_WIDE_STRING_LITERAL:
+	case T_EMBED:
+		hash_string_size(token->literal.begin, token->literal.size);
+		/* number suffix */
+		if (token->symbol != NULL) {
+			hash_string_size(token->symbol->string,
+			                 strlen(token->symbol->string));
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if (cache_hash_positions) {
+		presumed_position_t pos;
+		get_presumed_position(&token->source_position, &pos);
+		if (pos.input_name != NULL)
+			hash_string_size(pos.input_name, strlen(pos.input_name));
+		hash_bytes(&pos.linenr, sizeof(pos.linenr));
+	}
+}
+
+static bool copy_file_contents(FILE *dest, FILE *source)
+{
+	char buf[16384];
+	while (!feof(source)) {
+		size_t n = fread(buf, 1, sizeof(buf), source);
+		if (ferror(source) || fwrite(buf, 1, n, dest) != n)
+			return false;
+	}
+	return true;
+}
+
+bool cache_lookup(FILE *output)
+{
+	if (cache_directory == NULL)
+		return false;
+	cache_hash_tokens = false;
+
+	/* spread the entries over 256 subdirectories like ccache */
+	snprintf(key_path, sizeof(key_path), "%s/%02x", cache_directory,
+	         (unsigned) (key.fnv >> 56));
+	if (mkdir(key_path, 0777) != 0 && errno != EEXIST) {
+		key_path[0] = '\0';
+		return false;
+	}
+	snprintf(key_path, sizeof(key_path), "%s/%02x/%014llx%016llx.s",
+	         cache_directory, (unsigned) (key.fnv >> 56),
+	         (unsigned long long) (key.fnv & UINT64_C(0xffffffffffffff)),
+	         (unsigned long long) key.mix);
+
+	FILE *cached = fopen(key_path, "rb");
+	if (cached == NULL)
+		return false;
+	bool success = copy_file_contents(output, cached);
+	fclose(cached);
+	if (!success) {
+		fprintf(stderr, "warning: couldn't copy cached output '%s'\n",
+		        key_path);
+	}
+	return success;
+}
+
+void cache_discard(void)
+{
+	key_path[0] = '\0';
+}
+
+void cache_store(const char *filename)
+{
+	if (cache_directory == NULL || key_path[0] == '\0')
+		return;
+
+	FILE *source = fopen(filename, "rb");
+	if (source == NULL)
+		return;
+
+	/* write to a temporary name first, so no partial entries are seen */
+	char temp_path[4096 + 32];
+	snprintf(temp_path, sizeof(temp_path), "%s.%d", key_path, (int) getpid());
+	FILE *dest = fopen(temp_path, "wb");
+	if (dest != NULL) {
+		bool success = copy_file_contents(dest, source);
+		if (fclose(dest) != 0)
+			success = false;
+		if (!success || rename(temp_path, key_path) != 0)
+			remove(temp_path);
+	}
+	fclose(source);
+	key_path[0] = '\0';
+}
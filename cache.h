@@ -0,0 +1,83 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "token_t.h"
+
+/**
+ * Set while the tokens passed to the parser have to be added to the key of
+ * the current compilation (see cache_hash_token()).
+ */
+extern bool cache_hash_tokens;
+
+/**
+ * Enable the compilation cache in directory. Calling it again has no effect.
+ */
+void init_cache(const char *directory);
+
+void exit_cache(void);
+
+/**
+ * Add a configuration string (command line option, target, ...) to the key.
+ */
+void cache_hash_string(const char *string);
+
+/**
+ * Use the current key as starting point for all following compilations and
+ * stop hashing tokens.
+ */
+void cache_save_base(void);
+
+/**
+ * Start a new compilation: reset the key to the base and start hashing the
+ * tokens seen by the parser. If hash_positions is set the source positions
+ * of the tokens are part of the key (needed when they end up in the output,
+ * e.g. as debug info).
+ */
+void cache_start(bool hash_positions);
+
+/**
+ * Add a token to the key of the current compilation.
+ */
+void cache_hash_token(const token_t *token);
+
+/**
+ * Stop hashing and look for the output of an identical compilation.
+ *
+ * @return true if the cached output has been copied to output
+ */
+bool cache_lookup(FILE *output);
+
+/**
+ * Don't store the output of the current compilation, e.g. because it issued
+ * diagnostics which a cache hit would not reproduce.
+ */
+void cache_discard(void);
+
+/**
+ * Put the file containing the output of the current compilation into the
+ * cache.
+ */
+void cache_store(const char *filename);
+
+#endif
@@ -42,9 +42,29 @@ static const source_position_t *curr_pos = NULL;
  */
 static void print_source_position(FILE *out, const source_position_t *pos)
 {
-	fprintf(out, "at line %u", pos->linenr);
-	if (curr_pos == NULL || curr_pos->input_name != pos->input_name)
-		fprintf(out, " of \"%s\"", pos->input_name);
+	presumed_position_t presumed;
+	get_presumed_position(pos, &presumed);
+	fprintf(out, "at line %u", presumed.linenr);
+	if (curr_pos == NULL
+	    || get_source_position_input_name(curr_pos) != presumed.input_name)
+		fprintf(out, " of \"%s\"", presumed.input_name);
+}
+
+/**
+ * prints the position a diagnostic is about, followed by its kind
+ */
+static void print_diagnostic_position(const source_position_t *pos,
+                                      const char *kind)
+{
+	presumed_position_t presumed;
+	get_presumed_position(pos, &presumed);
+	if (presumed.colnr > 0) {
+		fprintf(stderr, "%s:%u:%u: %s: ", presumed.input_name,
+		        presumed.linenr, presumed.colnr, kind);
+	} else {
+		fprintf(stderr, "%s:%u: %s: ", presumed.input_name, presumed.linenr,
+		        kind);
+	}
 }
 
 /**
@@ -193,7 +213,7 @@ void diagnosticf(const char *const fmt, ...)
 static void errorvf(const source_position_t *pos,
                     const char *const fmt, va_list ap)
 {
-	fprintf(stderr, "%s:%u: error: ", pos->input_name, pos->linenr);
+	print_diagnostic_position(pos, "error");
 	++error_count;
 	curr_pos = pos;
 	diagnosticvf(fmt, ap);
@@ -215,7 +235,7 @@ void errorf(const source_position_t *pos, const char *const fmt, ...)
 static void warningvf(const source_position_t *pos,
                       const char *const fmt, va_list ap)
 {
-	fprintf(stderr, "%s:%u: warning: ", pos->input_name, pos->linenr);
+	print_diagnostic_position(pos, "warning");
 	++warning_count;
 	curr_pos = pos;
 	diagnosticvf(fmt, ap);
@@ -238,7 +258,7 @@ void warningf(const source_position_t *pos, const char *const fmt, ...)
 static void internal_errorvf(const source_position_t *pos,
                     const char *const fmt, va_list ap)
 {
-	fprintf(stderr, "%s:%u: internal error: ", pos->input_name, pos->linenr);
+	print_diagnostic_position(pos, "internal error");
 	curr_pos = pos;
 	diagnosticvf(fmt, ap);
 	fputc('\n', stderr);
@@ -311,7 +311,9 @@ static bool do_irg_opt(ir_graph *irg, const char *name)
 	current_ir_graph = irg;
 
 	timer_push(timers[n]);
+	timer_trace_begin(name, get_entity_name(get_irg_entity(irg)));
 	config->u.transform_irg(irg);
+	timer_trace_end();
 	timer_pop(timers[n]);
 
 	if (firm_dump.all_phases && firm_dump.ir_graph) {
@@ -337,7 +339,9 @@ static void do_irp_opt(const char *name)
 		return;
 
 	timer_push(timers[n]);
+	timer_trace_begin(name, NULL);
 	config->u.transform_irp();
+	timer_trace_end();
 	timer_pop(timers[n]);
 
 	if (firm_dump.ir_graph && firm_dump.all_phases) {
@@ -712,7 +716,9 @@ void gen_firm_finish(FILE *out, const char *input_filename)
 	ir_timer_t *timer = ir_timer_new();
 	timer_register(timer, "Firm: backend");
 	timer_start(timer);
+	timer_trace_begin("backend", input_filename);
 	be_main(out, input_filename);
+	timer_trace_end();
 	timer_stop(timer);
 
 	if (firm_dump.statistic & STAT_FINAL)
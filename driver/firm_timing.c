@@ -7,7 +7,17 @@
  */
 #include "firm_timing.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <libfirm/adt/xmalloc.h>
+#include <libfirm/adt/obst.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid() _getpid()
+#else
+#include <unistd.h>
+#endif
 
 static int timers_inited;
 
@@ -86,3 +96,95 @@ void timer_stop(ir_timer_t *timer)
 	if (timers_inited)
 		ir_timer_stop(timer);
 }
+
+static char           *trace_filename;
+static ir_timer_t     *trace_clock;
+static struct obstack  trace_obst;
+
+static void trace_print_string(const char *string)
+{
+	obstack_1grow(&trace_obst, '"');
+	for (const char *c = string; *c != '\0'; ++c) {
+		unsigned char ch = (unsigned char) *c;
+		if (ch == '"' || ch == '\\') {
+			obstack_1grow(&trace_obst, '\\');
+			obstack_1grow(&trace_obst, ch);
+		} else if (ch < 0x20) {
+			obstack_printf(&trace_obst, "\\u%04x", ch);
+		} else {
+			obstack_1grow(&trace_obst, ch);
+		}
+	}
+	obstack_1grow(&trace_obst, '"');
+}
+
+static void trace_event(char phase, const char *name, const char *detail)
+{
+	/* the clock only accumulates while stopped */
+	ir_timer_stop(trace_clock);
+	unsigned long usec = ir_timer_elapsed_usec(trace_clock);
+	ir_timer_start(trace_clock);
+
+	obstack_printf(&trace_obst, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":0,\"ts\":%lu",
+	               phase, (int) getpid(), usec);
+	if (name != NULL) {
+		obstack_printf(&trace_obst, ",\"name\":");
+		trace_print_string(name);
+	}
+	if (detail != NULL) {
+		obstack_printf(&trace_obst, ",\"args\":{\"detail\":");
+		trace_print_string(detail);
+		obstack_1grow(&trace_obst, '}');
+	}
+	obstack_printf(&trace_obst, "},\n");
+}
+
+void timer_trace_flush(void)
+{
+	if (trace_filename == NULL)
+		return;
+
+	size_t size = obstack_object_size(&trace_obst);
+	if (size == 0)
+		return;
+	char *events = obstack_finish(&trace_obst);
+
+	/* unbuffered appends keep the events of concurrent processes apart */
+	FILE *f = fopen(trace_filename, "a");
+	if (f != NULL) {
+		setvbuf(f, NULL, _IONBF, 0);
+		fwrite(events, 1, size, f);
+		fclose(f);
+	}
+	obstack_free(&trace_obst, events);
+}
+
+void timer_trace_init(const char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "warning: couldn't open trace file '%s'\n", filename);
+		return;
+	}
+	/* the trace viewers accept a missing closing bracket */
+	fputs("[\n", f);
+	fclose(f);
+
+	trace_filename = xstrdup(filename);
+	trace_clock    = ir_timer_new();
+	obstack_init(&trace_obst);
+	ir_timer_start(trace_clock);
+	atexit(timer_trace_flush);
+}
+
+void timer_trace_begin(const char *name, const char *detail)
+{
+	if (trace_filename != NULL)
+		trace_event('B', name, detail);
+}
+
+void timer_trace_end(void)
+{
+	if (trace_filename != NULL)
+		trace_event('E', NULL, NULL);
+}
@@ -19,4 +19,17 @@ void timer_pop(ir_timer_t *timer);
 void timer_start(ir_timer_t *timer);
 void timer_stop(ir_timer_t *timer);
 
+/**
+ * Write nested begin/end events in Chrome trace format (JSON array) to
+ * filename. Processes forked afterwards append their events to the same
+ * file when they exit.
+ */
+void timer_trace_init(const char *filename);
+/** Begin a trace event, detail may be NULL. */
+void timer_trace_begin(const char *name, const char *detail);
+/** End the innermost trace event. */
+void timer_trace_end(void);
+/** Write out buffered trace events (call before forking). */
+void timer_trace_flush(void);
+
 #endif
@@ -23,6 +23,8 @@
 
 #include "entity_t.h"
 #include "ast_t.h"
+#include "type_t.h"
+#include "symbol_t.h"
 #include "adt/error.h"
 #include "adt/util.h"
 
@@ -87,3 +89,280 @@ entity_t *allocate_entity_zero(entity_kind_t kind)
 	entity->kind     = kind;
 	return entity;
 }
+
+/** scopes with more entities get a hash index on their first lookup */
+#define SCOPE_INDEX_MIN_ENTITIES 16
+
+/**
+ * Open addressing hash table mapping symbol and namespace to the first
+ * entity declared with them. It lives on the AST obstack like the scope, a
+ * grown table leaves the old one behind.
+ */
+struct scope_index_t {
+	unsigned  n_slots;   /**< a power of two */
+	unsigned  n_entries;
+	entity_t *slots[];
+};
+
+static unsigned hash_entity_key(const symbol_t *symbol,
+                                entity_namespace_t namespc)
+{
+	unsigned hash = (unsigned) (((const char*) symbol - (const char*) NULL) >> 3);
+	return (hash ^ namespc) * 0x9E3779B1U;
+}
+
+static scope_index_t *new_scope_index(unsigned n_slots)
+{
+	scope_index_t *index
+		= allocate_ast_zero(sizeof(*index) + n_slots * sizeof(index->slots[0]));
+	index->n_slots = n_slots;
+	return index;
+}
+
+/**
+ * Adds an entity to the index unless an earlier one has the same symbol and
+ * namespace.
+ */
+static void insert_index_entity(scope_index_t *index, entity_t *entity)
+{
+	symbol_t           *symbol  = entity->base.symbol;
+	entity_namespace_t  namespc = entity->base.namespc;
+	unsigned            mask    = index->n_slots - 1;
+	for (unsigned i = hash_entity_key(symbol, namespc);; ++i) {
+		entity_t **slot = &index->slots[i & mask];
+		if (*slot == NULL) {
+			*slot = entity;
+			++index->n_entries;
+			return;
+		}
+		if ((*slot)->base.symbol == symbol && (*slot)->base.namespc == namespc)
+			return;
+	}
+}
+
+static void build_scope_index(scope_t *scope)
+{
+	unsigned n_slots = 32;
+	while (n_slots < 2 * scope->n_entities) {
+		n_slots *= 2;
+	}
+	scope_index_t *index = new_scope_index(n_slots);
+	for (entity_t *entity = scope->entities; entity != NULL;
+	     entity = entity->base.next) {
+		if (entity->base.symbol != NULL)
+			insert_index_entity(index, entity);
+	}
+	scope->index = index;
+}
+
+void scope_append_entity(scope_t *scope, entity_t *entity)
+{
+	if (scope->last_entity != NULL) {
+		scope->last_entity->base.next = entity;
+	} else {
+		scope->entities = entity;
+	}
+	scope->last_entity = entity;
+	++scope->n_entities;
+
+	scope_index_t *index = scope->index;
+	if (index == NULL || entity->base.symbol == NULL)
+		return;
+	/* keep the table at most half full */
+	if (2 * (index->n_entries + 1) > index->n_slots) {
+		build_scope_index(scope);
+	} else {
+		insert_index_entity(index, entity);
+	}
+}
+
+entity_t *scope_lookup_entity(scope_t *scope, symbol_t *symbol,
+                              entity_namespace_t namespc)
+{
+	scope_index_t *index = scope->index;
+	if (index == NULL) {
+		if (scope->n_entities < SCOPE_INDEX_MIN_ENTITIES) {
+			entity_t *entity = scope->entities;
+			for ( ; entity != NULL; entity = entity->base.next) {
+				if (entity->base.symbol == symbol
+						&& entity->base.namespc == namespc)
+					break;
+			}
+			return entity;
+		}
+		build_scope_index(scope);
+		index = scope->index;
+	}
+
+	unsigned mask = index->n_slots - 1;
+	for (unsigned i = hash_entity_key(symbol, namespc);; ++i) {
+		entity_t *entity = index->slots[i & mask];
+		if (entity == NULL
+				|| (entity->base.symbol == symbol && entity->base.namespc == namespc))
+			return entity;
+	}
+}
+
+/** an entry of a member_index_t */
+typedef struct member_entry_t {
+	symbol_t *symbol;
+	entity_t *member;   /**< the member or the anonymous member containing it */
+	unsigned  position; /**< position of member in the member list */
+} member_entry_t;
+
+/**
+ * Open addressing hash table mapping the member names of a compound to
+ * their first declaration. Names of anonymous struct and union members are
+ * entered for the anonymous member. Members appended to the compound later
+ * are entered on the next lookup.
+ */
+struct member_index_t {
+	unsigned        n_slots;     /**< a power of two */
+	unsigned        n_entries;
+	unsigned        n_members;   /**< number of entities already entered */
+	entity_t       *last_member; /**< last entity already entered */
+	member_entry_t  slots[];
+};
+
+static member_index_t *new_member_index(unsigned n_slots)
+{
+	member_index_t *index
+		= allocate_ast_zero(sizeof(*index) + n_slots * sizeof(index->slots[0]));
+	index->n_slots = n_slots;
+	return index;
+}
+
+static void insert_index_member(member_index_t **index_ptr, symbol_t *symbol,
+                                entity_t *member, unsigned position)
+{
+	member_index_t *index = *index_ptr;
+	/* keep the table at most half full */
+	if (2 * (index->n_entries + 1) > index->n_slots) {
+		member_index_t *grown = new_member_index(2 * index->n_slots);
+		grown->n_members   = index->n_members;
+		grown->last_member = index->last_member;
+		for (unsigned i = 0; i < index->n_slots; ++i) {
+			member_entry_t *entry = &index->slots[i];
+			if (entry->symbol != NULL)
+				insert_index_member(&grown, entry->symbol, entry->member,
+				                    entry->position);
+		}
+		*index_ptr = index = grown;
+	}
+
+	unsigned mask = index->n_slots - 1;
+	for (unsigned i = hash_entity_key(symbol, NAMESPACE_NORMAL);; ++i) {
+		member_entry_t *slot = &index->slots[i & mask];
+		if (slot->symbol == NULL) {
+			slot->symbol   = symbol;
+			slot->member   = member;
+			slot->position = position;
+			++index->n_entries;
+			return;
+		}
+		if (slot->symbol == symbol)
+			return;
+	}
+}
+
+/**
+ * Returns the compound of an anonymous struct or union member, NULL if
+ * entity is none.
+ */
+static compound_t *get_anonymous_compound(const entity_t *entity)
+{
+	if (entity->kind != ENTITY_COMPOUND_MEMBER || entity->base.symbol != NULL)
+		return NULL;
+	type_t *type = skip_typeref(entity->declaration.type);
+	if (!is_type_compound(type))
+		return NULL;
+	return type->compound.compound;
+}
+
+/** Enters all names reachable in compound for the anonymous member. */
+static void insert_anonymous_members(member_index_t **index_ptr,
+                                     compound_t *compound, entity_t *member,
+                                     unsigned position)
+{
+	entity_t *iter = compound->members.entities;
+	for ( ; iter != NULL; iter = iter->base.next) {
+		if (iter->kind != ENTITY_COMPOUND_MEMBER)
+			continue;
+		if (iter->base.symbol != NULL) {
+			insert_index_member(index_ptr, iter->base.symbol, member, position);
+		} else {
+			compound_t *sub_compound = get_anonymous_compound(iter);
+			if (sub_compound != NULL)
+				insert_anonymous_members(index_ptr, sub_compound, member,
+				                         position);
+		}
+	}
+}
+
+/** Enters the members appended to compound since the last lookup. */
+static member_index_t *update_member_index(compound_t *compound)
+{
+	member_index_t *index = compound->member_index;
+	if (index == NULL) {
+		unsigned n_slots = 32;
+		while (n_slots < 2 * compound->members.n_entities) {
+			n_slots *= 2;
+		}
+		index = new_member_index(n_slots);
+	}
+
+	entity_t *iter = index->last_member != NULL
+		? index->last_member->base.next : compound->members.entities;
+	for ( ; iter != NULL; iter = iter->base.next) {
+		unsigned position = index->n_members++;
+		index->last_member = iter;
+		if (iter->kind != ENTITY_COMPOUND_MEMBER)
+			continue;
+		if (iter->base.symbol != NULL) {
+			insert_index_member(&index, iter->base.symbol, iter, position);
+		} else {
+			compound_t *sub_compound = get_anonymous_compound(iter);
+			if (sub_compound != NULL)
+				insert_anonymous_members(&index, sub_compound, iter, position);
+		}
+	}
+
+	compound->member_index = index;
+	return index;
+}
+
+entity_t *find_compound_member(compound_t *compound, symbol_t *symbol,
+                               size_t *position)
+{
+	if (compound->member_index == NULL
+			&& compound->members.n_entities < SCOPE_INDEX_MIN_ENTITIES) {
+		size_t    iter_position = 0;
+		entity_t *iter          = compound->members.entities;
+		for ( ; iter != NULL; iter = iter->base.next, ++iter_position) {
+			if (iter->kind != ENTITY_COMPOUND_MEMBER)
+				continue;
+			if (iter->base.symbol == symbol)
+				break;
+			compound_t *sub_compound = get_anonymous_compound(iter);
+			if (sub_compound != NULL
+					&& find_compound_member(sub_compound, symbol, NULL) != NULL)
+				break;
+		}
+		if (position != NULL)
+			*position = iter_position;
+		return iter;
+	}
+
+	member_index_t *index = update_member_index(compound);
+	unsigned        mask  = index->n_slots - 1;
+	for (unsigned i = hash_entity_key(symbol, NAMESPACE_NORMAL);; ++i) {
+		member_entry_t *entry = &index->slots[i & mask];
+		if (entry->symbol == NULL)
+			return NULL;
+		if (entry->symbol == symbol) {
+			if (position != NULL)
+				*position = entry->position;
+			return entry->member;
+		}
+	}
+}
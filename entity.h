@@ -21,6 +21,8 @@
 #define ENTITY_H
 
 typedef struct scope_t                      scope_t;
+typedef struct scope_index_t                scope_index_t;
+typedef struct member_index_t               member_index_t;
 
 typedef struct entity_base_t                entity_base_t;
 typedef struct compound_t                   compound_t;
@@ -99,10 +99,14 @@ typedef enum decl_modifier_t {
  * A scope containing entities.
  */
 struct scope_t {
-	entity_t *entities;
-	entity_t *last_entity; /**< pointer to last entity (so appending is fast) */
-	unsigned  depth;       /**< while parsing, the depth of this scope in the
-	                            scope stack. */
+	entity_t      *entities;
+	entity_t      *last_entity; /**< pointer to last entity (so appending is
+	                                 fast) */
+	unsigned       depth;       /**< while parsing, the depth of this scope in
+	                                 the scope stack. */
+	unsigned       n_entities;
+	scope_index_t *index;       /**< hash index of large scopes, created on
+	                                 the first lookup, NULL while unused */
 };
 
 /**
@@ -128,6 +132,7 @@ struct compound_t {
 	entity_base_t     base;
 	entity_t         *alias; /* used for name mangling of anonymous types */
 	scope_t           members;
+	member_index_t   *member_index; /**< see find_compound_member() */
 	decl_modifiers_t  modifiers;
 	bool              layouted          : 1;
 	bool              complete          : 1;
@@ -155,9 +160,7 @@ struct enum_value_t {
 	entity_base_t  base;
 	expression_t  *value;
 	type_t        *enum_type;
-
-	/* ast2firm info */
-	ir_tarval     *tv;
+	long           folded_value; /**< the value, computed while parsing */
 };
 
 struct label_t {
@@ -298,4 +301,25 @@ const char *get_entity_kind_name(entity_kind_t kind);
 
 entity_t *allocate_entity_zero(entity_kind_t kind);
 
+/**
+ * Appends an entity to the entities of a scope.
+ */
+void scope_append_entity(scope_t *scope, entity_t *entity);
+
+/**
+ * Returns the first entity of a scope with the given symbol and namespace,
+ * NULL if there is none.
+ */
+entity_t *scope_lookup_entity(scope_t *scope, symbol_t *symbol,
+                              entity_namespace_t namespc);
+
+/**
+ * Returns the first member of a compound named symbol, NULL if there is
+ * none. For a member of an anonymous struct or union the anonymous member
+ * containing it is returned. If position is not NULL it is set to the
+ * index of the returned member in the member list.
+ */
+entity_t *find_compound_member(compound_t *compound, symbol_t *symbol,
+                               size_t *position);
+
 #endif
@@ -34,17 +34,17 @@ static unsigned hash_ptr(const void *ptr)
 #define HashSetIterator           entitymap_iterator_t
 #define ValueType                 entitymap_entry_t
 #define NullValue                 null_entitymap_entry
-#define KeyType                   symbol_t*
-#define ConstKeyType              const symbol_t*
-#define GetKey(value)             (value).symbol
-#define InitData(self,value,key)  (value).symbol = (key)
+#define KeyType                   const void*
+#define ConstKeyType              const void*
+#define GetKey(value)             (value).key
+#define InitData(self,value,key)  (value).key = (key)
 #define Hash(self,key)            hash_ptr(key)
 #define KeysEqual(self,key1,key2) (key1) == (key2)
 #define SetRangeEmpty(ptr,size)   memset(ptr, 0, (size) * sizeof((ptr)[0]))
-#define EntrySetEmpty(value)      (value).symbol = NULL
-#define EntrySetDeleted(value)    (value).symbol = (symbol_t*) -1
-#define EntryIsEmpty(value)       ((value).symbol == NULL)
-#define EntryIsDeleted(value)     ((value).symbol == (symbol_t*)-1)
+#define EntrySetEmpty(value)      (value).key = NULL
+#define EntrySetDeleted(value)    (value).key = (const void*) -1
+#define EntryIsEmpty(value)       ((value).key == NULL)
+#define EntryIsDeleted(value)     ((value).key == (const void*)-1)
 
 #define hashset_init            entitymap_init
 #define hashset_init_size       _entitymap_init_size
@@ -59,14 +59,14 @@ static unsigned hash_ptr(const void *ptr)
 
 #include "adt/hashset.c"
 
-ir_entity *entitymap_get(const entitymap_t *map, symbol_t *symbol)
+ir_entity *entitymap_get(const entitymap_t *map, const void *key)
 {
-	entitymap_entry_t *entry = _entitymap_find(map, symbol);
+	entitymap_entry_t *entry = _entitymap_find(map, key);
 	return entry->entity;
 }
 
-void entitymap_insert(entitymap_t *map, symbol_t *symbol, ir_entity *entity)
+void entitymap_insert(entitymap_t *map, const void *key, ir_entity *entity)
 {
-	entitymap_entry_t *entry = _entitymap_insert(map, symbol);
+	entitymap_entry_t *entry = _entitymap_insert(map, key);
 	entry->entity = entity;
 }
@@ -23,9 +23,11 @@
 #include <libfirm/firm_types.h>
 #include "symbol.h"
 
+/** maps symbols (or other unique pointers like interned strings) to
+ * entities */
 typedef struct entitymap_entry_t {
-	symbol_t  *symbol;
-	ir_entity *entity;
+	const void *key;
+	ir_entity  *entity;
 } entitymap_entry_t;
 
 #define HashSet          entitymap_t
@@ -45,8 +47,8 @@ void entitymap_init(entitymap_t *map);
 
 void entitymap_destroy(entitymap_t *map);
 
-void entitymap_insert(entitymap_t *map, symbol_t *symbol, ir_entity *entity);
+void entitymap_insert(entitymap_t *map, const void *key, ir_entity *entity);
 
-ir_entity *entitymap_get(const entitymap_t *map, symbol_t *symbol);
+ir_entity *entitymap_get(const entitymap_t *map, const void *key);
 
 #endif
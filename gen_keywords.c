@@ -0,0 +1,223 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * Build time generator for gen_keywords.h: Creates the symbols of all token
+ * strings in tokens.inc and tokens_preprocessor.inc as a static table and a
+ * perfect hash to find them. The symbol table checks this table before its
+ * hash set, so no keyword has to be inserted at startup.
+ *
+ * The perfect hash works on the hash_string_words() value of a string: the
+ * low bits select a bucket, whose seed is mixed into the value before a
+ * multiplicative hash selects the slot. Seeds are searched bucket by bucket,
+ * largest bucket first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "adt/hash_string.h"
+
+static const char *const token_strings[] = {
+#define T(mode,x,str,val)  str,
+#define TS(x,str,val)      str,
+#include "tokens.inc"
+#undef TS
+#undef T
+
+#define T(mode,x,str,val)  str,
+#define TS(x,str,val)      str,
+#include "tokens_preprocessor.inc"
+#undef TS
+#undef T
+};
+
+#define N_TOKEN_STRINGS (sizeof(token_strings) / sizeof(token_strings[0]))
+#define MAX_SEED        0xFFFF
+
+static const char *keys[N_TOKEN_STRINGS];
+static uint32_t    hashes[N_TOKEN_STRINGS];
+static unsigned    n_keys;
+
+static unsigned    slot_bits;
+static unsigned    bucket_bits;
+static unsigned   *seeds;
+static int        *slots;
+
+/* must match KEYWORD_SLOT() in the generated header */
+static unsigned get_slot(uint32_t hash, unsigned seed)
+{
+	return (uint32_t) ((hash ^ seed) * 0x9E3779B1U) >> (32 - slot_bits);
+}
+
+static int compare_bucket_size(const void *a, const void *b)
+{
+	const unsigned *bucket_a = (const unsigned*) a;
+	const unsigned *bucket_b = (const unsigned*) b;
+	return (int) bucket_b[1] - (int) bucket_a[1];
+}
+
+static int try_seeds(void)
+{
+	unsigned n_slots   = 1U << slot_bits;
+	unsigned n_buckets = 1U << bucket_bits;
+	unsigned mask      = n_buckets - 1;
+
+	/* pairs of bucket number and size */
+	unsigned *buckets = calloc(n_buckets, 2 * sizeof(buckets[0]));
+	for (unsigned b = 0; b < n_buckets; ++b) {
+		buckets[2 * b] = b;
+	}
+	for (unsigned k = 0; k < n_keys; ++k) {
+		buckets[2 * (hashes[k] & mask) + 1]++;
+	}
+	qsort(buckets, n_buckets, 2 * sizeof(buckets[0]), compare_bucket_size);
+
+	free(seeds);
+	free(slots);
+	seeds = calloc(n_buckets, sizeof(seeds[0]));
+	slots = malloc(n_slots * sizeof(slots[0]));
+	for (unsigned s = 0; s < n_slots; ++s) {
+		slots[s] = -1;
+	}
+
+	for (unsigned i = 0; i < n_buckets && buckets[2 * i + 1] > 0; ++i) {
+		unsigned bucket = buckets[2 * i];
+		unsigned seed;
+		for (seed = 0; seed <= MAX_SEED; ++seed) {
+			unsigned k;
+			for (k = 0; k < n_keys; ++k) {
+				if ((hashes[k] & mask) != bucket)
+					continue;
+				unsigned slot = get_slot(hashes[k], seed);
+				if (slots[slot] >= 0)
+					break;
+				slots[slot] = (int) k;
+			}
+			if (k == n_keys)
+				break;
+
+			/* undo the partial assignment of this bucket */
+			for (unsigned s = 0; s < n_slots; ++s) {
+				if (slots[s] >= 0 && (hashes[slots[s]] & mask) == bucket)
+					slots[s] = -1;
+			}
+		}
+		if (seed > MAX_SEED) {
+			free(buckets);
+			return 0;
+		}
+		seeds[bucket] = seed;
+	}
+
+	free(buckets);
+	return 1;
+}
+
+static void print_string(const char *string)
+{
+	putchar('"');
+	for (const char *c = string; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\')
+			putchar('\\');
+		putchar(*c);
+	}
+	putchar('"');
+}
+
+int main(void)
+{
+	for (size_t i = 0; i < N_TOKEN_STRINGS; ++i) {
+		const char *string = token_strings[i];
+		size_t      len    = strlen(string);
+		uint32_t    hash   = (uint32_t) hash_string_words(string, len);
+
+		unsigned k;
+		for (k = 0; k < n_keys; ++k) {
+			if (strcmp(keys[k], string) == 0)
+				break;
+		}
+		if (k < n_keys)
+			continue;
+
+		for (k = 0; k < n_keys; ++k) {
+			if (hashes[k] == hash) {
+				fprintf(stderr, "gen_keywords: \"%s\" and \"%s\" have the same hash\n",
+				        keys[k], string);
+				return EXIT_FAILURE;
+			}
+		}
+		keys[n_keys]   = string;
+		hashes[n_keys] = hash;
+		++n_keys;
+	}
+
+	/* smallest table without too much searching for seeds */
+	slot_bits = 1;
+	while ((1U << slot_bits) < n_keys)
+		++slot_bits;
+	for (;; ++slot_bits) {
+		if (slot_bits > 16) {
+			fputs("gen_keywords: no perfect hash found\n", stderr);
+			return EXIT_FAILURE;
+		}
+		for (bucket_bits = slot_bits - 2; bucket_bits <= slot_bits;
+		     ++bucket_bits) {
+			if (try_seeds())
+				goto found;
+		}
+	}
+
+found:
+	printf("/* WARNING: automatically generated file. Generated by gen_keywords.c from\n"
+	       " * tokens.inc and tokens_preprocessor.inc */\n\n");
+	printf("#define KEYWORD_SLOT_SHIFT  %u\n", 32 - slot_bits);
+	printf("#define KEYWORD_BUCKET_MASK %uU\n\n", (1U << bucket_bits) - 1);
+	printf("#define KEYWORD_SLOT(hash) \\\n"
+	       "\t((uint32_t) (((uint32_t) (hash) ^ keyword_seeds[(hash) & KEYWORD_BUCKET_MASK]) \\\n"
+	       "\t             * 0x9E3779B1U) >> KEYWORD_SLOT_SHIFT)\n\n");
+
+	printf("static const unsigned short keyword_seeds[%u] = {", 1U << bucket_bits);
+	for (unsigned b = 0; b < 1U << bucket_bits; ++b) {
+		printf("%s%u,", b % 16 == 0 ? "\n\t" : " ", seeds[b]);
+	}
+	printf("\n};\n\n");
+
+	printf("/* index into keyword_symbols plus one, 0 for an empty slot */\n");
+	printf("static const unsigned short keyword_slots[%u] = {", 1U << slot_bits);
+	for (unsigned s = 0; s < 1U << slot_bits; ++s) {
+		printf("%s%d,", s % 16 == 0 ? "\n\t" : " ", slots[s] + 1);
+	}
+	printf("\n};\n\n");
+
+	printf("static symbol_t keyword_symbols[%u] = {\n", n_keys);
+	for (unsigned k = 0; k < n_keys; ++k) {
+		printf("\t{ .string = ");
+		print_string(keys[k]);
+		printf(", .ID = T_IDENTIFIER, .pp_ID = TP_IDENTIFIER, .length = %u },\n",
+		       (unsigned) strlen(keys[k]));
+	}
+	printf("};\n");
+
+	free(seeds);
+	free(slots);
+	return EXIT_SUCCESS;
+}
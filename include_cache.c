@@ -0,0 +1,219 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <config.h>
+
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "include_cache.h"
+#include "adt/obst.h"
+#include "adt/strset.h"
+#include "adt/hash_string.h"
+
+struct include_dir_t {
+	const char *path;      /**< ends with '/', empty for the working directory */
+	bool        listed;    /**< entries contains the listing */
+	time_t      mtime;     /**< modification time of the listed directory */
+	time_t      listed_at; /**< time the listing was read */
+	unsigned    unit;      /**< the translation unit the listing was checked for */
+	strset_t    entries;   /**< names of all directory entries */
+};
+
+static struct obstack include_obstack;
+static unsigned       current_unit = 1;
+
+static include_dir_t *init_include_dir(const char *path)
+{
+	include_dir_t *dir = obstack_alloc(&include_obstack, sizeof(*dir));
+	memset(dir, 0, sizeof(*dir));
+	dir->path = path;
+	return dir;
+}
+
+#define HashSet                    include_dirset_t
+#define HashSetIterator            include_dirset_iterator_t
+#define HashSetEntry               include_dirset_entry_t
+#define ValueType                  include_dir_t*
+#define NullValue                  NULL
+#define DeletedValue               ((include_dir_t*)-1)
+#define KeyType                    const char*
+#define ConstKeyType               const char*
+#define GetKey(value)              (value)
+#define InitData(this,value,key)   ((void)((value) = init_include_dir((key))))
+#define Hash(this, key)            hash_string(key)
+#define KeysEqual(this,key1,key2)  (strcmp((key1)->path, (key2)) == 0)
+#define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(include_dirset_entry_t))
+#define SCALAR_RETURN
+
+#define hashset_init            _include_dirset_init
+#define hashset_init_size       _include_dirset_init_size
+#define hashset_destroy         _include_dirset_destroy
+#define hashset_insert          _include_dirset_insert
+#define hashset_remove          _include_dirset_remove
+#define hashset_find            _include_dirset_find
+#define hashset_size            _include_dirset_size
+#define hashset_iterator_init   _include_dirset_iterator_init
+#define hashset_iterator_next   _include_dirset_iterator_next
+#define hashset_remove_iterator _include_dirset_remove_iterator
+
+#include "adt/hashset.h"
+
+typedef struct include_dirset_t          include_dirset_t;
+typedef struct include_dirset_iterator_t include_dirset_iterator_t;
+
+#include "adt/hashset.c"
+
+static include_dirset_t include_dirs;
+
+void init_include_cache(void)
+{
+	obstack_init(&include_obstack);
+	_include_dirset_init(&include_dirs);
+}
+
+void exit_include_cache(void)
+{
+	include_dirset_iterator_t iter;
+	_include_dirset_iterator_init(&iter, &include_dirs);
+	for (include_dir_t *dir; (dir = _include_dirset_iterator_next(&iter)) != NULL; ) {
+		if (dir->listed)
+			strset_destroy(&dir->entries);
+	}
+	_include_dirset_destroy(&include_dirs);
+	obstack_free(&include_obstack, NULL);
+}
+
+void include_cache_new_unit(void)
+{
+	++current_unit;
+}
+
+/**
+ * Returns the directory for the path grown on the include obstack.
+ */
+static include_dir_t *finish_include_dir(void)
+{
+	obstack_1grow(&include_obstack, '\0');
+	char *key = obstack_finish(&include_obstack);
+
+	include_dir_t *dir = _include_dirset_find(&include_dirs, key);
+	if (dir != NULL) {
+		obstack_free(&include_obstack, key);
+		return dir;
+	}
+	/* the key stays allocated as the path of the new directory */
+	return _include_dirset_insert(&include_dirs, key);
+}
+
+include_dir_t *get_include_dir(const char *path, size_t len)
+{
+	obstack_grow(&include_obstack, path, len);
+	if (len > 0 && path[len-1] != '/')
+		obstack_1grow(&include_obstack, '/');
+	return finish_include_dir();
+}
+
+const char *get_include_dir_path(const include_dir_t *dir)
+{
+	return dir->path;
+}
+
+/**
+ * A listing is checked once per translation unit: it is read again if the
+ * directory was modified since (or in the same second as) it was read.
+ */
+void read_include_dir(include_dir_t *dir)
+{
+	if (dir->unit == current_unit)
+		return;
+	dir->unit = current_unit;
+
+	const char *path = dir->path[0] != '\0' ? dir->path : ".";
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		/* a missing directory contains nothing */
+		st.st_mtime = 0;
+	} else if (dir->listed && st.st_mtime == dir->mtime
+	           && dir->mtime < dir->listed_at) {
+		return;
+	}
+
+	if (dir->listed) {
+		strset_destroy(&dir->entries);
+		dir->listed = false;
+	}
+
+	DIR *listing = NULL;
+	if (st.st_mtime != 0) {
+		listing = opendir(path);
+		/* not readable: lookups have to ask the file system */
+		if (listing == NULL)
+			return;
+	}
+
+	strset_init(&dir->entries);
+	if (listing != NULL) {
+		for (struct dirent *entry; (entry = readdir(listing)) != NULL; ) {
+			const char *name = entry->d_name;
+			strset_insert(&dir->entries,
+			              obstack_copy0(&include_obstack, name, strlen(name)));
+		}
+		closedir(listing);
+	}
+	dir->listed    = true;
+	dir->mtime     = st.st_mtime;
+	dir->listed_at = time(NULL);
+}
+
+bool include_dir_may_contain(include_dir_t *dir, const char *name)
+{
+	while (true) {
+		read_include_dir(dir);
+		if (!dir->listed)
+			return true;
+
+		const char *slash = strchr(name, '/');
+		size_t      len   = slash != NULL ? (size_t) (slash - name) : strlen(name);
+		char        component[256];
+		if (len >= sizeof(component))
+			return true;
+		memcpy(component, name, len);
+		component[len] = '\0';
+		if (strset_find(&dir->entries, component) == NULL)
+			return false;
+		if (slash == NULL)
+			return true;
+
+		/* continue in the subdirectory */
+		obstack_grow(&include_obstack, dir->path, strlen(dir->path));
+		obstack_grow(&include_obstack, name, len);
+		obstack_1grow(&include_obstack, '/');
+		dir = finish_include_dir();
+
+		name = slash;
+		while (*name == '/')
+			++name;
+		if (*name == '\0')
+			return true;
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef INCLUDE_CACHE_H
+#define INCLUDE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A directory searched for include files. Its listing is kept, so looking
+ * up names that don't exist in it needs no system call.
+ */
+typedef struct include_dir_t include_dir_t;
+
+void init_include_cache(void);
+void exit_include_cache(void);
+
+/**
+ * Starts a new translation unit: the listings are checked for modifications
+ * again when they are used next.
+ */
+void include_cache_new_unit(void);
+
+/**
+ * Returns the directory for the first len characters of path.
+ */
+include_dir_t *get_include_dir(const char *path, size_t len);
+
+/**
+ * Returns the path of a directory. It ends with a '/' or is empty for the
+ * working directory, so a file name can be appended directly.
+ */
+const char *get_include_dir_path(const include_dir_t *dir);
+
+/**
+ * Reads the listing of a directory if it isn't up to date.
+ */
+void read_include_dir(include_dir_t *dir);
+
+/**
+ * Checks with the directory listings whether the (relative) file name may
+ * exist in a directory. Returns false only if it surely doesn't exist.
+ */
+bool include_dir_may_contain(include_dir_t *dir, const char *name);
+
+#endif
@@ -25,7 +25,7 @@
 #include "token_t.h"
 #include "symbol_table_t.h"
 #include "adt/error.h"
-#include "adt/strset.h"
+#include "adt/hash_string.h"
 #include "adt/util.h"
 #include "types.h"
 #include "type_t.h"
@@ -33,6 +33,8 @@
 #include "parser.h"
 #include "warning.h"
 #include "lang_features.h"
+#include "preprocessor.h"
+#include "cache.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -60,9 +62,55 @@ static FILE        *input;
 static utf32        buf[BUF_SIZE + MAX_PUTBACK];
 static const utf32 *bufend;
 static const utf32 *bufpos;
-static strset_t     stringset;
+static uint32_t     loc;       /**< location of c */
+static presumed_position_t position;  /**< presumed name and line of c */
+static bool         use_preprocessor;
 bool                allow_dollar_in_symbol = true;
 
+/* the set of all literal strings, they may contain 0 characters so the size
+ * is part of the key */
+static const string_t null_string = { NULL, 0 };
+
+#define HashSet                   stringset_t
+#define HashSetIterator           stringset_iterator_t
+#define HashSetEntry              stringset_entry_t
+#define ValueType                 string_t
+#define NullValue                 null_string
+#define KeyType                   string_t
+#define ConstKeyType              string_t
+#define GetKey(value)             (value)
+#define InitData(self,value,key)  (value) = (key)
+#define Hash(self,key)            hash_string_words((key).begin, (key).size)
+#define KeysEqual(self,key1,key2) \
+	((key1).size == (key2).size \
+	 && memcmp((key1).begin, (key2).begin, (key1).size) == 0)
+#define SetRangeEmpty(ptr,size)   memset(ptr, 0, (size) * sizeof((ptr)[0]))
+#define EntrySetEmpty(entry)      (entry).data.begin = NULL
+#define EntrySetDeleted(entry)    (entry).data.begin = (const char*) -1
+#define EntryIsEmpty(entry)       ((entry).data.begin == NULL)
+#define EntryIsDeleted(entry)     ((entry).data.begin == (const char*) -1)
+#define SCALAR_RETURN
+
+#define hashset_init            stringset_init
+#define hashset_init_size       _stringset_init_size
+#define hashset_destroy         stringset_destroy
+#define hashset_insert          stringset_insert
+#define hashset_remove          _stringset_remove
+#define hashset_find            _stringset_find
+#define hashset_size            _stringset_size
+#define hashset_iterator_init   _stringset_iterator_init
+#define hashset_iterator_next   _stringset_iterator_next
+#define hashset_remove_iterator _stringset_remove_iterator
+
+#include "adt/hashset.h"
+
+typedef struct stringset_t          stringset_t;
+typedef struct stringset_iterator_t stringset_iterator_t;
+
+#include "adt/hashset.c"
+
+static stringset_t stringset;
+
 /**
  * Prints a parse error message at the current token.
  *
@@ -367,6 +415,7 @@ static inline void next_real_char(void)
 		decoder();
 	}
 	c = *bufpos++;
+	++loc;
 }
 
 /**
@@ -378,6 +427,7 @@ static inline void put_back(utf32 const pc)
 {
 	assert(bufpos > buf);
 	*(--bufpos - buf + buf) = pc;
+	--loc;
 
 #ifdef DEBUG_CHARS
 	printf("putback '%lc'\n", pc);
@@ -386,17 +436,26 @@ static inline void put_back(utf32 const pc)
 
 static inline void next_char(void);
 
+/**
+ * Counts a newline, c starts the next line.
+ */
+static inline void new_line(void)
+{
+	++position.linenr;
+	source_line_begin(loc);
+}
+
 #define MATCH_NEWLINE(code)                   \
 	case '\r':                                \
 		next_char();                          \
 		if (c == '\n') {                      \
 			next_char();                      \
 		}                                     \
-		lexer_token.source_position.linenr++; \
+		new_line();                           \
 		code                                  \
 	case '\n':                                \
 		next_char();                          \
-		lexer_token.source_position.linenr++; \
+		new_line();                           \
 		code
 
 #define eat(c_type)  do { assert(c == c_type); next_char(); } while (0)
@@ -602,18 +661,14 @@ finish_suffix:
 	lexer_token.symbol = symbol;
 }
 
-static string_t identify_string(char *string, size_t len)
+string_t identify_string(char *string, size_t len)
 {
-	/* TODO hash */
-#if 0
-	const char *result = strset_insert(&stringset, concat);
-	if (result != concat) {
-		obstack_free(&symbol_obstack, concat);
+	string_t key    = { string, len };
+	string_t result = stringset_insert(&stringset, key);
+	if (result.begin != string) {
+		obstack_free(&symbol_obstack, string);
 	}
-#else
-	const char *result = string;
-#endif
-	return (string_t) {result, len};
+	return result;
 }
 
 /**
@@ -955,8 +1010,6 @@ static void grow_symbol(utf32 const tc)
  */
 static void parse_string_literal(void)
 {
-	const unsigned start_linenr = lexer_token.source_position.linenr;
-
 	eat('"');
 
 	while (true) {
@@ -971,14 +1024,10 @@ static void parse_string_literal(void)
 			break;
 		}
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = lexer_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "string has no end");
+		case EOF:
+			errorf(&lexer_token.source_position, "string has no end");
 			lexer_token.type = T_ERROR;
 			return;
-		}
 
 		case '"':
 			next_char();
@@ -1009,8 +1058,6 @@ end_of_string:
  */
 static void parse_wide_character_constant(void)
 {
-	const unsigned start_linenr = lexer_token.source_position.linenr;
-
 	eat('\'');
 
 	while (true) {
@@ -1030,13 +1077,11 @@ static void parse_wide_character_constant(void)
 			next_char();
 			goto end_of_wide_char_constant;
 
-		case EOF: {
-			source_position_t source_position = lexer_token.source_position;
-			source_position.linenr = start_linenr;
-			errorf(&source_position, "EOF while parsing character constant");
+		case EOF:
+			errorf(&lexer_token.source_position,
+			       "EOF while parsing character constant");
 			lexer_token.type = T_ERROR;
 			return;
-		}
 
 		default:
 			grow_symbol(c);
@@ -1069,8 +1114,6 @@ static void parse_wide_string_literal(void)
  */
 static void parse_character_constant(void)
 {
-	const unsigned start_linenr = lexer_token.source_position.linenr;
-
 	eat('\'');
 
 	while (true) {
@@ -1094,14 +1137,11 @@ static void parse_character_constant(void)
 			next_char();
 			goto end_of_char_constant;
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = lexer_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "EOF while parsing character constant");
+		case EOF:
+			errorf(&lexer_token.source_position,
+			       "EOF while parsing character constant");
 			lexer_token.type = T_ERROR;
 			return;
-		}
 
 		default:
 			grow_symbol(c);
@@ -1125,8 +1165,6 @@ end_of_char_constant:;
  */
 static void skip_multiline_comment(void)
 {
-	unsigned start_linenr = lexer_token.source_position.linenr;
-
 	while (true) {
 		switch (c) {
 		case '/':
@@ -1148,13 +1186,10 @@ static void skip_multiline_comment(void)
 
 		MATCH_NEWLINE(break;)
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = lexer_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "at end of file while looking for comment end");
+		case EOF:
+			errorf(&lexer_token.source_position,
+			       "at end of file while looking for comment end");
 			return;
-		}
 
 		default:
 			next_char();
@@ -1255,13 +1290,14 @@ static void parse_line_directive(void)
 		parse_error("expected integer");
 	} else {
 		/* use offset -1 as this is about the next line */
-		lexer_token.source_position.linenr = atoi(pp_token.literal.begin) - 1;
+		position.linenr = atoi(pp_token.literal.begin) - 1;
 		next_pp_token();
 	}
 	if (pp_token.type == T_STRING_LITERAL) {
-		lexer_token.source_position.input_name = pp_token.literal.begin;
+		position.input_name = pp_token.literal.begin;
 		next_pp_token();
 	}
+	loc = source_segment_begin(position.input_name, position.linenr, loc);
 
 	eat_until_newline();
 }
@@ -1448,6 +1484,7 @@ static void parse_preprocessor_directive(void)
 void lexer_next_preprocessing_token(void)
 {
 	while (true) {
+		lexer_token.source_position.loc = loc;
 		switch (c) {
 		case ' ':
 		case '\t':
@@ -1627,30 +1664,39 @@ dollar_sign:
 
 void lexer_next_token(void)
 {
-	lexer_next_preprocessing_token();
+	if (use_preprocessor) {
+		preprocessor_next_token();
+	} else {
+		lexer_next_preprocessing_token();
 
-	while (lexer_token.type == '\n') {
+		while (lexer_token.type == '\n') {
 newline_found:
-		lexer_next_preprocessing_token();
-	}
+			lexer_next_preprocessing_token();
+		}
 
-	if (lexer_token.type == '#') {
-		parse_preprocessor_directive();
-		goto newline_found;
+		if (lexer_token.type == '#') {
+			parse_preprocessor_directive();
+			goto newline_found;
+		}
 	}
+
+	if (cache_hash_tokens)
+		cache_hash_token(&lexer_token);
 }
 
 void init_lexer(void)
 {
-	strset_init(&stringset);
+	stringset_init(&stringset);
 	symbol_L = symbol_table_insert("L");
 }
 
 void lexer_open_stream(FILE *stream, const char *input_name)
 {
+	use_preprocessor                       = false;
 	input                                  = stream;
-	lexer_token.source_position.linenr     = 0;
-	lexer_token.source_position.input_name = input_name;
+	position.input_name                    = input_name;
+	position.linenr                        = 0;
+	loc = source_segment_begin(input_name, 0, loc);
 
 	bufpos = NULL;
 	bufend = NULL;
@@ -1660,11 +1706,25 @@ void lexer_open_stream(FILE *stream, const char *input_name)
 	c = '\n';
 }
 
+void lexer_open_preprocessor(FILE *stream, const char *input_name)
+{
+	use_preprocessor = true;
+	preprocessor_open_stream(stream, input_name);
+}
+
+void lexer_open_preprocessor_buffer(char *text, size_t len,
+                                    const char *input_name)
+{
+	use_preprocessor = true;
+	preprocessor_open_buffer(text, len, input_name);
+}
+
 void lexer_open_buffer(const char *buffer, size_t len, const char *input_name)
 {
+	use_preprocessor                       = false;
 	input                                  = NULL;
-	lexer_token.source_position.linenr     = 0;
-	lexer_token.source_position.input_name = input_name;
+	position.input_name                    = input_name;
+	position.linenr                        = 0;
 
 #if 0 // TODO
 	bufpos = buffer;
@@ -1682,13 +1742,15 @@ void lexer_open_buffer(const char *buffer, size_t len, const char *input_name)
 
 void exit_lexer(void)
 {
-	strset_destroy(&stringset);
+	stringset_destroy(&stringset);
 }
 
 static __attribute__((unused))
 void dbg_pos(const source_position_t source_position)
 {
-	fprintf(stdout, "%s:%u\n", source_position.input_name,
-	        source_position.linenr);
+	presumed_position_t presumed;
+	get_presumed_position(&source_position, &presumed);
+	fprintf(stdout, "%s:%u:%u\n", presumed.input_name, presumed.linenr,
+	        presumed.colnr);
 	fflush(stdout);
 }
@@ -37,8 +37,28 @@ void exit_lexer(void);
 void select_input_encoding(char const* encoding);
 
 void lexer_open_stream(FILE *stream, const char *input_name);
+
+/**
+ * Open an unpreprocessed source file, the tokens are delivered by the builtin
+ * preprocessor.
+ */
+void lexer_open_preprocessor(FILE *stream, const char *input_name);
+
+/**
+ * Like lexer_open_preprocessor() for source text in memory, which is lexed in
+ * place (see preprocessor_open_buffer()).
+ */
+void lexer_open_preprocessor_buffer(char *text, size_t len,
+                                    const char *input_name);
 void lexer_open_buffer(const char *buffer, size_t len, const char *input_name);
 
+/**
+ * Returns the unique copy of a literal string. string has to be the last
+ * object on the symbol obstack, it is freed if an equal string exists
+ * already.
+ */
+string_t identify_string(char *string, size_t len);
+
 string_t concat_strings(const string_t *s1, const string_t *s2);
 string_t make_string(const char *str);
 
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
+#include <signal.h>
 
 #ifdef _WIN32
 
@@ -54,18 +55,28 @@
 
 #else
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #define HAVE_MKSTEMP
+#define HAVE_FORK
 #endif
 
 #include <libfirm/firm.h>
 #include <libfirm/be.h>
 
 #include "lexer.h"
+#include "preprocessor.h"
+#include "pp_stats.h"
+#include "server.h"
+#include "cache.h"
 #include "token_t.h"
 #include "types.h"
 #include "type_hash.h"
 #include "parser.h"
 #include "type_t.h"
+#include "ast_t.h"
+#include "symbol_table.h"
+#include "source_position.h"
 #include "ast2firm.h"
 #include "diagnostic.h"
 #include "lang_features.h"
@@ -90,6 +101,10 @@
 #endif
 #endif
 
+#ifndef SYSTEM_INCLUDE_DIRS
+#define SYSTEM_INCLUDE_DIRS "/usr/local/include:/usr/include"
+#endif
+
 #ifndef LINKER
 #define LINKER    "gcc"
 #endif
@@ -123,6 +138,7 @@ static struct obstack    ldflags_obst;
 static struct obstack    asflags_obst;
 static char              dep_target[1024];
 static const char       *outname;
+static bool              external_preprocessor;
 
 typedef enum lang_standard_t {
 	STANDARD_DEFAULT, /* gnu99 (for C, GCC does gnu89) or gnu++98 (for C++) */
@@ -186,7 +202,40 @@ static void get_output_name(char *buf, size_t buflen, const char *inputname,
 
 #include "gen_builtins.h"
 
-static translation_unit_t *do_parsing(FILE *const in, const char *const input_name)
+/**
+ * Select the language features for a C file according to -std.
+ */
+static void set_c_mode_for_c(void)
+{
+	char const* invalid_mode;
+	switch (standard) {
+		case STANDARD_ANSI:
+		case STANDARD_C89:   c_mode = _C89;                break;
+		/* TODO determine difference between these two */
+		case STANDARD_C90:   c_mode = _C89;                break;
+		case STANDARD_C99:   c_mode = _C89 | _C99;         break;
+		case STANDARD_GNU89: c_mode = _C89 |        _GNUC; break;
+
+default_c_warn:
+			fprintf(stderr,
+					"warning: command line option \"-std=%s\" is not valid for C\n",
+					invalid_mode);
+			/* FALLTHROUGH */
+		case STANDARD_DEFAULT:
+		case STANDARD_GNU99:   c_mode = _C89 | _C99 | _GNUC; break;
+
+		case STANDARD_CXX98:   invalid_mode = "c++98"; goto default_c_warn;
+		case STANDARD_GNUXX98: invalid_mode = "gnu98"; goto default_c_warn;
+	}
+}
+
+/** set when debug information is generated (-g) */
+static bool debug_info;
+
+/** set when a prefix header was parsed into the current translation unit */
+static bool prefix_header_parsed;
+
+static void start_unit(void)
 {
 	start_parsing();
 
@@ -194,9 +243,41 @@ static translation_unit_t *do_parsing(FILE *const in, const char *const input_na
 		lexer_open_buffer(builtins, sizeof(builtins)-1, "<builtin>");
 		parse();
 	}
+}
+
+static translation_unit_t *do_parsing(FILE *const in, const char *const input_name,
+                                      bool preprocess)
+{
+	/* a parsed prefix header already started the translation unit */
+	if (!prefix_header_parsed)
+		start_unit();
+
+	if (preprocess) {
+		lexer_open_preprocessor(in, input_name);
+		parse();
+		preprocessor_close();
+	} else {
+		lexer_open_stream(in, input_name);
+		parse();
+	}
 
-	lexer_open_stream(in, input_name);
+	translation_unit_t *unit = finish_parsing();
+	return unit;
+}
+
+/**
+ * Parse source text in memory with the builtin preprocessor. The text is
+ * lexed in place like a mapped file.
+ */
+static translation_unit_t *do_parsing_buffer(char *text, size_t size,
+                                             const char *input_name)
+{
+	if (!prefix_header_parsed)
+		start_unit();
+
+	lexer_open_preprocessor_buffer(text, size, input_name);
 	parse();
+	preprocessor_close();
 
 	translation_unit_t *unit = finish_parsing();
 	return unit;
@@ -266,6 +347,138 @@ static const char *type_to_string(type_t *type)
 	return get_atomic_kind_name(type->atomic.akind);
 }
 
+/**
+ * Adds a -D option to the builtin preprocessor.
+ */
+static void add_define_option(const char *opt)
+{
+	char *name  = xstrdup(opt);
+	char *value = strchr(name, '=');
+	if (value != NULL)
+		*value++ = '\0';
+	add_define(name, value, false);
+	free(name);
+}
+
+/**
+ * Adds the default system include directories to the search path of the
+ * builtin preprocessor.
+ */
+static void add_system_include_dirs(void)
+{
+	const char *dirs = SYSTEM_INCLUDE_DIRS;
+	while (*dirs != '\0') {
+		const char *end = strchr(dirs, ':');
+		size_t      len = end != NULL ? (size_t) (end - dirs) : strlen(dirs);
+		if (len > 0) {
+			char *dir = XMALLOCN(char, len + 1);
+			memcpy(dir, dirs, len);
+			dir[len] = '\0';
+			add_include_path(dir, true);
+			free(dir);
+		}
+		dirs += len;
+		if (*dirs == ':')
+			++dirs;
+	}
+}
+
+/**
+ * Sets up the macros predefined by the builtin preprocessor, they depend on
+ * the language of the current file and the target machine.
+ */
+static void setup_predefined_macros(void)
+{
+	clear_standard_defines();
+
+	add_define("__STDC__", "1", true);
+	if (c_mode & _CXX) {
+		add_define("__cplusplus", "1", true);
+	} else if (c_mode & _C99) {
+		add_define("__STDC_VERSION__", "199901L", true);
+	}
+	add_define("__STDC_HOSTED__", freestanding ? "0" : "1", true);
+	if (c_mode & _GNUC) {
+		add_define("__GNUC__",            "4", true);
+		add_define("__GNUC_MINOR__",      "2", true);
+		add_define("__GNUC_PATCHLEVEL__", "0", true);
+		if (!(c_mode & _CXX))
+			add_define("__GNUC_STDC_INLINE__", "1", true);
+	} else {
+		add_define("__STRICT_ANSI__", "1", true);
+	}
+	add_define("__VERSION__", "\"" cparser_REVISION "\"", true);
+
+	/* types and limits */
+	add_define("__CHAR_BIT__", "8", true);
+	if (!char_is_signed)
+		add_define("__CHAR_UNSIGNED__", NULL, true);
+	add_define("__SIZE_TYPE__",    type_to_string(type_size_t),    true);
+	add_define("__PTRDIFF_TYPE__", type_to_string(type_ptrdiff_t), true);
+	add_define("__WCHAR_TYPE__",   type_to_string(type_wchar_t),   true);
+	add_define("__WINT_TYPE__",    type_to_string(type_wint_t),    true);
+	add_define("__SCHAR_MAX__",     "127",                  true);
+	add_define("__SHRT_MAX__",      "32767",                true);
+	add_define("__INT_MAX__",       "2147483647",           true);
+	add_define("__LONG_LONG_MAX__", "9223372036854775807LL", true);
+	if (machine_size == 64) {
+		add_define("__LONG_MAX__", "9223372036854775807L", true);
+		add_define("__LP64__", "1", true);
+		add_define("_LP64",    "1", true);
+	} else {
+		add_define("__LONG_MAX__", "2147483647L", true);
+		add_define("__ILP32__", "1", true);
+	}
+	if (wchar_atomic_kind == ATOMIC_TYPE_USHORT) {
+		add_define("__WCHAR_MAX__", "65535", true);
+	} else {
+		add_define("__WCHAR_MAX__", "2147483647", true);
+	}
+
+	/* target machine */
+	const char *cpu = target_machine->cpu_type;
+	if (cpu[0] == 'i' && streq(cpu + 2, "86")) {
+		add_define("__i386__", "1", true);
+		add_define("__i386",   "1", true);
+		if (c_mode & _GNUC)
+			add_define("i386", "1", true);
+	} else if (streq(cpu, "x86_64")) {
+		add_define("__x86_64__", "1", true);
+		add_define("__x86_64",   "1", true);
+		add_define("__amd64__",  "1", true);
+		add_define("__amd64",    "1", true);
+	} else if (streq(cpu, "sparc")) {
+		add_define("__sparc__", "1", true);
+		add_define("__sparc",   "1", true);
+	} else if (streq(cpu, "arm")) {
+		add_define("__arm__", "1", true);
+	}
+
+	const char *os = target_machine->operating_system;
+	if (strstr(os, "linux") != NULL) {
+		add_define("__linux__",     "1", true);
+		add_define("__linux",       "1", true);
+		add_define("__gnu_linux__", "1", true);
+		if (c_mode & _GNUC)
+			add_define("linux", "1", true);
+	}
+	if (strstr(os, "linux") != NULL || strstr(os, "bsd") != NULL
+			|| streq(os, "solaris")) {
+		add_define("__unix__", "1", true);
+		add_define("__unix",   "1", true);
+		add_define("__ELF__",  "1", true);
+		if (c_mode & _GNUC)
+			add_define("unix", "1", true);
+	} else if (streq(os, "darwin")) {
+		add_define("__APPLE__", "1", true);
+		add_define("__MACH__",  "1", true);
+	} else if (strstr(os, "mingw") != NULL || streq(os, "win32")) {
+		add_define("_WIN32",     "1", true);
+		add_define("__WIN32__",  "1", true);
+		add_define("__MINGW32__", "1", true);
+	}
+}
+
 static FILE *preprocess(const char *fname, filetype_t filetype)
 {
 	static const char *common_flags = NULL;
@@ -346,10 +559,17 @@ static FILE *preprocess(const char *fname, filetype_t filetype)
 	return f;
 }
 
-static void assemble(const char *out, const char *in)
+/**
+ * Build the command line running the assembler. The assembly is read from
+ * in or from stdin if in is NULL.
+ */
+static char *get_assembler_commandline(const char *out, const char *in)
 {
-	obstack_1grow(&asflags_obst, '\0');
-	const char *flags = obstack_finish(&asflags_obst);
+	static const char *flags;
+	if (flags == NULL) {
+		obstack_1grow(&asflags_obst, '\0');
+		flags = obstack_finish(&asflags_obst);
+	}
 
 	const char *assembler = getenv("CPARSER_AS");
 	if (assembler != NULL) {
@@ -362,14 +582,20 @@ static void assemble(const char *out, const char *in)
 	if (flags[0] != '\0')
 		obstack_printf(&asflags_obst, " %s", flags);
 
-	obstack_printf(&asflags_obst, " %s -o %s", in, out);
+	obstack_printf(&asflags_obst, " %s -o %s", in != NULL ? in : "-", out);
 	obstack_1grow(&asflags_obst, '\0');
 
 	char *commandline = obstack_finish(&asflags_obst);
 	if (verbose) {
 		puts(commandline);
 	}
-	int err = system(commandline);
+	return commandline;
+}
+
+static void assemble(const char *out, const char *in)
+{
+	char *commandline = get_assembler_commandline(out, in);
+	int   err         = system(commandline);
 	if (err != EXIT_SUCCESS) {
 		fprintf(stderr, "assembler reported an error\n");
 		exit(EXIT_FAILURE);
@@ -377,6 +603,53 @@ static void assemble(const char *out, const char *in)
 	obstack_free(&asflags_obst, commandline);
 }
 
+#ifdef SIGPIPE
+/** SIGPIPE handler to restore once the assembler pipe is closed */
+static void (*saved_sigpipe_handler)(int);
+#endif
+
+/**
+ * Start the assembler reading the assembly from a pipe, so it runs while
+ * the code is generated and no temporary assembler file is needed.
+ */
+static FILE *open_assembler_pipe(const char *out)
+{
+	char *commandline = get_assembler_commandline(out, NULL);
+	fflush(NULL);
+	FILE *pipe = popen(commandline, "w");
+	if (pipe == NULL) {
+		fprintf(stderr, "invoking assembler failed\n");
+		exit(EXIT_FAILURE);
+	}
+	/* ignored only after popen so the assembler does not inherit it: an
+	 * assembler exiting early must not kill us silently, its failure is
+	 * reported by close_assembler_pipe() */
+#ifdef SIGPIPE
+	saved_sigpipe_handler = signal(SIGPIPE, SIG_IGN);
+#endif
+	obstack_free(&asflags_obst, commandline);
+	return pipe;
+}
+
+static void close_assembler_pipe(FILE *pipe)
+{
+	bool write_failed = fflush(pipe) != 0 || ferror(pipe);
+	int  write_errno  = errno;
+	int  status       = pclose(pipe);
+#ifdef SIGPIPE
+	signal(SIGPIPE, saved_sigpipe_handler);
+#endif
+	if (status != EXIT_SUCCESS) {
+		fprintf(stderr, "assembler reported an error\n");
+		exit(EXIT_FAILURE);
+	}
+	if (write_failed) {
+		fprintf(stderr, "writing to assembler failed: %s\n",
+		        strerror(write_errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
 static void print_file_name(const char *file)
 {
 	add_flag(&ldflags_obst, "-print-file-name=%s", file);
@@ -509,6 +782,64 @@ static void free_temp_files(void)
 	temp_files = NULL;
 }
 
+/** maximum number of translation units compiled in parallel */
+static unsigned n_jobs = 1;
+
+#ifdef HAVE_FORK
+/** a worker process compiling a single input file */
+typedef struct worker_t {
+	pid_t              pid;
+	file_list_entry_t *file;
+	const char        *object_name; /**< object file produced or NULL */
+} worker_t;
+
+static worker_t *workers;
+static unsigned  n_workers;
+
+/**
+ * Wait until one of the running workers is finished. If the worker
+ * produced an object file for linking, it replaces the input file in the
+ * file list.
+ *
+ * @return true if the worker compiled its file successfully
+ */
+static bool wait_for_worker(void)
+{
+	assert(n_workers > 0);
+
+	for (;;) {
+		int   status;
+		pid_t pid = wait(&status);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "error: waiting for worker failed: %s\n",
+			        strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		for (unsigned i = 0; i < n_workers; ++i) {
+			worker_t *worker = &workers[i];
+			if (worker->pid != pid)
+				continue;
+
+			bool success
+				= WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+			if (WIFSIGNALED(status)) {
+				fprintf(stderr, "error: worker compiling '%s' died (signal %d)\n",
+				        worker->file->name, WTERMSIG(status));
+			}
+			if (success && worker->object_name != NULL) {
+				worker->file->name = worker->object_name;
+				worker->file->type = FILETYPE_OBJECT;
+			}
+			workers[i] = workers[--n_workers];
+			return success;
+		}
+	}
+}
+#endif
+
 typedef enum compile_mode_t {
 	BenchmarkParser,
 	PreprocessOnly,
@@ -645,8 +976,406 @@ static bool parse_target_triple(const char *arg)
 	return true;
 }
 
+/** number of runs done by --benchmark */
+static unsigned benchmark_runs = 10;
+/** print the --benchmark results as JSON */
+static bool     benchmark_json = false;
+
+/** measurements of a single benchmark run */
+typedef struct benchmark_run_t {
+	bool     success;
+	double   msec;
+	size_t   n_tokens;
+	size_t   ast_memory;
+	size_t   type_memory;
+	size_t   symbol_memory;
+} benchmark_run_t;
+
+/**
+ * Lex (lex_only) or parse the in-memory input once.
+ */
+static void benchmark_run(benchmark_run_t *run, bool lex_only, char *text,
+                          size_t size, const char *filename, bool preprocess)
+{
+	/* the builtin preprocessor lexes the text in place (like a mapped input
+	 * file), only the legacy lexer needs a stream */
+	FILE *in = NULL;
+	if (!preprocess) {
+		in = fmemopen(text, size, "r");
+		if (in == NULL) {
+			fprintf(stderr, "couldn't open input buffer: %s\n",
+			        strerror(errno));
+			return;
+		}
+	}
+
+	ir_timer_t *timer = ir_timer_new();
+	ir_timer_start(timer);
+	if (lex_only) {
+		if (preprocess) {
+			lexer_open_preprocessor_buffer(text, size, filename);
+		} else {
+			lexer_open_stream(in, filename);
+		}
+		size_t n_tokens = 0;
+		do {
+			lexer_next_token();
+			++n_tokens;
+		} while (lexer_token.type != T_EOF);
+		if (preprocess)
+			preprocessor_close();
+		run->n_tokens = n_tokens;
+	} else if (preprocess) {
+		do_parsing_buffer(text, size, filename);
+	} else {
+		do_parsing(in, filename, false);
+	}
+	ir_timer_stop(timer);
+	if (in != NULL)
+		fclose(in);
+
+	run->success       = error_count == 0;
+	run->msec          = ir_timer_elapsed_usec(timer) / 1000.0;
+	run->ast_memory    = obstack_memory_used(&ast_obstack);
+	run->type_memory   = obstack_memory_used(type_obst);
+	run->symbol_memory = obstack_memory_used(&symbol_obstack);
+	ir_timer_free(timer);
+}
+
+/**
+ * Do a benchmark run in a process of its own, so every run starts with the
+ * same state (no macros or declarations left over from the previous run).
+ */
+static void benchmark_run_isolated(benchmark_run_t *run, bool lex_only,
+                                   char *text, size_t size,
+                                   const char *filename, bool preprocess)
+{
+	memset(run, 0, sizeof(*run));
+#ifdef HAVE_FORK
+	int fds[2];
+	if (pipe(fds) != 0) {
+		fprintf(stderr, "couldn't create pipe: %s\n", strerror(errno));
+		return;
+	}
+	fflush(NULL);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		benchmark_run(run, lex_only, text, size, filename, preprocess);
+		ssize_t written = write(fds[1], run, sizeof(*run));
+		_exit(written == (ssize_t) sizeof(*run) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(fds[1]);
+	if (pid > 0) {
+		if (read(fds[0], run, sizeof(*run)) != (ssize_t) sizeof(*run))
+			run->success = false;
+		waitpid(pid, NULL, 0);
+	}
+	close(fds[0]);
+#else
+	/* the preprocessor may write to the text it lexes in place */
+	char *copy = XMALLOCN(char, size);
+	memcpy(copy, text, size);
+	benchmark_run(run, lex_only, copy, size, filename, preprocess);
+	free(copy);
+#endif
+}
+
+static int compare_double(const void *p1, const void *p2)
+{
+	double d1 = *(const double*) p1;
+	double d2 = *(const double*) p2;
+	return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+/** min/median/max of the times of one phase */
+typedef struct benchmark_phase_t {
+	double min;
+	double median;
+	double max;
+} benchmark_phase_t;
+
+static benchmark_phase_t summarize_phase(double *msecs, unsigned n)
+{
+	qsort(msecs, n, sizeof(msecs[0]), compare_double);
+
+	benchmark_phase_t phase;
+	phase.min    = msecs[0];
+	phase.max    = msecs[n - 1];
+	phase.median = n % 2 != 0 ? msecs[n / 2]
+	                          : (msecs[n / 2 - 1] + msecs[n / 2]) / 2;
+	return phase;
+}
+
+/**
+ * Print a string as JSON string literal.
+ */
+static void print_json_string(FILE *out, const char *string)
+{
+	fputc('"', out);
+	for (const char *c = string; *c != '\0'; ++c) {
+		unsigned char ch = (unsigned char) *c;
+		if (ch == '"' || ch == '\\') {
+			fputc('\\', out);
+			fputc(ch, out);
+		} else if (ch < 0x20) {
+			fprintf(out, "\\u%04x", ch);
+		} else {
+			fputc(ch, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static double per_second(double count, double msec)
+{
+	return msec > 0 ? count * 1000.0 / msec : 0;
+}
+
+/**
+ * Repeatedly lex and parse an in-memory copy of the input and print
+ * throughput and memory statistics.
+ */
+static int benchmark_parser(FILE *in, const char *filename, bool preprocess,
+                            FILE *out)
+{
+	/* read the whole input into memory */
+	size_t  size     = 0;
+	size_t  capacity = 16384;
+	char   *text     = XMALLOCN(char, capacity);
+	for (;;) {
+		size += fread(text + size, 1, capacity - size, in);
+		if (size < capacity)
+			break;
+		capacity *= 2;
+		text      = XREALLOC(text, char, capacity);
+	}
+	size_t n_lines = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (text[i] == '\n')
+			++n_lines;
+	}
+
+	unsigned         n_runs       = benchmark_runs;
+	double          *lex_msecs    = XMALLOCN(double, n_runs);
+	double          *parse_msecs  = XMALLOCN(double, n_runs);
+	size_t           n_tokens     = 0;
+	benchmark_run_t  peak;
+	memset(&peak, 0, sizeof(peak));
+	for (unsigned i = 0; i < n_runs; ++i) {
+		benchmark_run_t run;
+		benchmark_run_isolated(&run, true, text, size, filename, preprocess);
+		if (!run.success)
+			goto failed;
+		lex_msecs[i] = run.msec;
+		n_tokens     = run.n_tokens;
+
+		benchmark_run_isolated(&run, false, text, size, filename, preprocess);
+		if (!run.success)
+			goto failed;
+		parse_msecs[i] = run.msec;
+		if (run.ast_memory > peak.ast_memory)
+			peak.ast_memory = run.ast_memory;
+		if (run.type_memory > peak.type_memory)
+			peak.type_memory = run.type_memory;
+		if (run.symbol_memory > peak.symbol_memory)
+			peak.symbol_memory = run.symbol_memory;
+	}
+
+	benchmark_phase_t lexing  = summarize_phase(lex_msecs, n_runs);
+	benchmark_phase_t parsing = summarize_phase(parse_msecs, n_runs);
+	double            median  = parsing.median;
+
+	if (benchmark_json) {
+		fprintf(out, "{\n");
+		fprintf(out, "  \"file\": ");
+		print_json_string(out, filename);
+		fprintf(out, ",\n");
+		fprintf(out, "  \"runs\": %u,\n", n_runs);
+		fprintf(out, "  \"bytes\": %lu,\n", (unsigned long) size);
+		fprintf(out, "  \"lines\": %lu,\n", (unsigned long) n_lines);
+		fprintf(out, "  \"tokens\": %lu,\n", (unsigned long) n_tokens);
+		fprintf(out, "  \"lexing_msec\": { \"min\": %.3f, \"median\": %.3f, \"max\": %.3f },\n",
+		        lexing.min, lexing.median, lexing.max);
+		fprintf(out, "  \"parsing_msec\": { \"min\": %.3f, \"median\": %.3f, \"max\": %.3f },\n",
+		        parsing.min, parsing.median, parsing.max);
+		fprintf(out, "  \"tokens_per_sec\": %.0f,\n", per_second(n_tokens, median));
+		fprintf(out, "  \"lines_per_sec\": %.0f,\n", per_second(n_lines, median));
+		fprintf(out, "  \"bytes_per_sec\": %.0f,\n", per_second(size, median));
+		fprintf(out, "  \"peak_ast_obstack\": %lu,\n", (unsigned long) peak.ast_memory);
+		fprintf(out, "  \"peak_type_obstack\": %lu,\n", (unsigned long) peak.type_memory);
+		fprintf(out, "  \"peak_symbol_obstack\": %lu\n", (unsigned long) peak.symbol_memory);
+		fprintf(out, "}\n");
+	} else {
+		fprintf(out, "benchmark of '%s': %u runs, %lu bytes, %lu lines, %lu tokens\n",
+		        filename, n_runs, (unsigned long) size, (unsigned long) n_lines,
+		        (unsigned long) n_tokens);
+		fprintf(out, "%-10s %10s %10s %10s\n", "phase", "min", "median", "max");
+		fprintf(out, "%-10s %10.3f %10.3f %10.3f msec\n", "lexing",
+		        lexing.min, lexing.median, lexing.max);
+		fprintf(out, "%-10s %10.3f %10.3f %10.3f msec\n", "parsing",
+		        parsing.min, parsing.median, parsing.max);
+		fprintf(out, "throughput (median parse): %.0f tokens/s, %.0f lines/s, %.0f bytes/s\n",
+		        per_second(n_tokens, median), per_second(n_lines, median),
+		        per_second(size, median));
+		fprintf(out, "peak obstack usage: ast %lu, types %lu, symbols %lu bytes\n",
+		        (unsigned long) peak.ast_memory,
+		        (unsigned long) peak.type_memory,
+		        (unsigned long) peak.symbol_memory);
+	}
+
+	free(parse_msecs);
+	free(lex_msecs);
+	free(text);
+	return EXIT_SUCCESS;
+
+failed:
+	fprintf(stderr, "benchmark of '%s' failed (input has errors?)\n", filename);
+	free(parse_msecs);
+	free(lex_msecs);
+	free(text);
+	return EXIT_FAILURE;
+}
+
+/**
+ * Add everything except the input tokens that influences the generated code
+ * to the key of the compilation cache.
+ */
+static void hash_cache_configuration(int argc, char **argv,
+                                     const file_list_entry_t *files)
+{
+	cache_hash_string(cparser_REVISION);
+	cache_hash_string(target_machine->cpu_type);
+	cache_hash_string(target_machine->manufacturer);
+	cache_hash_string(target_machine->operating_system);
+
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+
+		/* the input and output files are no configuration */
+		bool is_input = false;
+		for (const file_list_entry_t *entry = files; entry != NULL;
+				entry = entry->next) {
+			if (entry->name == arg)
+				is_input = true;
+		}
+		if (is_input)
+			continue;
+		if (streq(arg, "-o")) {
+			++i;
+			continue;
+		}
+		if (arg[0] == '-' && arg[1] == 'o')
+			continue;
+
+		cache_hash_string(arg);
+	}
+}
+
+/**
+ * Parse a prefix header into a new translation unit. Its declarations and
+ * macros stay in memory and compiling a C file continues this unit instead
+ * of parsing the header again. Workers and compile server jobs are forked
+ * after the header was parsed, so they all share the work.
+ *
+ * The parsed header only lives in this process: a separate cparser
+ * invocation parses it again.
+ */
+static void parse_prefix_header(const char *header, unsigned features_on,
+                                unsigned features_off)
+{
+	FILE *in = open_file(header);
+
+	set_c_mode_for_c();
+	c_mode |= features_on;
+	c_mode &= ~features_off;
+
+	init_tokens();
+	setup_predefined_macros();
+	timer_trace_begin("prefix header", header);
+	cache_start(debug_info);
+	start_unit();
+	lexer_open_preprocessor(in, header);
+	parse();
+	preprocessor_close();
+	cache_save_base();
+	timer_trace_end();
+	if (in != stdin)
+		fclose(in);
+
+	if (error_count > 0) {
+		fprintf(stderr, "%u error(s), %u warning(s)\n", error_count,
+		        warning_count);
+		exit(EXIT_FAILURE);
+	}
+	prefix_header_parsed = true;
+}
+
+/**
+ * Returns the optimization level selected by the last -O option.
+ */
+static int get_opt_level(int argc, char **argv)
+{
+	int opt_level = 1;
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (arg[0] == '-' && arg[1] == 'O')
+			sscanf(&arg[2], "%d", &opt_level);
+	}
+	return opt_level;
+}
+
+/**
+ * The settings which are fixed when a compile server starts. A job which
+ * asks for different ones is rejected and compiled by the client itself.
+ */
+typedef struct server_config_t {
+	int         opt_level;
+	const char *target;        /**< TARGET from the environment */
+	const char *target_triple; /**< -mtarget/-mtriple */
+	const char *cache_dir;
+	const char *prefix_header;
+	bool        no_std_includes;
+} server_config_t;
+
+static bool optional_streq(const char *a, const char *b)
+{
+	return a == NULL || b == NULL ? a == b : streq(a, b);
+}
+
+static bool server_config_equal(const server_config_t *config1,
+                                const server_config_t *config2)
+{
+	return config1->opt_level == config2->opt_level
+	    && optional_streq(config1->target, config2->target)
+	    && optional_streq(config1->target_triple, config2->target_triple)
+	    && optional_streq(config1->cache_dir, config2->cache_dir)
+	    && optional_streq(config1->prefix_header, config2->prefix_header)
+	    && config1->no_std_includes == config2->no_std_includes;
+}
+
+/**
+ * Check whether the command line asks for starting a compile server.
+ */
+static bool is_server_command_line(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (streq(argv[i], "--server"))
+			return true;
+	}
+	return false;
+}
+
 int main(int argc, char **argv)
 {
+	/* hand the job to a running compile server if there is one */
+	const char *server = getenv("CPARSER_SERVER");
+	if (server != NULL && !is_server_command_line(argc, argv)) {
+		int status = compile_server_submit(server, argc, argv);
+		if (status >= 0)
+			return status;
+	}
+
 	firm_early_init();
 
 	const char        *dumpfunction         = NULL;
@@ -659,6 +1388,13 @@ int main(int argc, char **argv)
 	file_list_entry_t *last_file            = NULL;
 	bool               construct_dep_target = false;
 	bool               do_timing            = false;
+	bool               no_std_includes      = false;
+	const char        *server_socket        = NULL;
+	const char        *prefix_header        = NULL;
+	const char        *time_trace           = NULL;
+	const char        *cache_dir            = getenv("CPARSER_CACHE_DIR");
+	bool               is_server_job        = false;
+	server_config_t    server_config;
 	struct obstack     file_obst;
 
 	atexit(free_temp_files);
@@ -694,16 +1430,7 @@ int main(int argc, char **argv)
 #define SINGLE_OPTION(ch) (option[0] == (ch) && option[1] == '\0')
 
 	/* early options parsing (find out optimisation level and OS) */
-	for (int i = 1; i < argc; ++i) {
-		const char *arg = argv[i];
-		if (arg[0] != '-')
-			continue;
-
-		const char *option = &arg[1];
-		if (option[0] == 'O') {
-			sscanf(&option[1], "%d", &opt_level);
-		}
-	}
+	opt_level = get_opt_level(argc, argv);
 
 	const char *target = getenv("TARGET");
 	if (target != NULL)
@@ -722,6 +1449,7 @@ int main(int argc, char **argv)
 	filetype_t forced_filetype = FILETYPE_AUTODETECT;
 	bool       help_displayed  = false;
 	bool       argument_errors = false;
+parse_options:
 	for (int i = 1; i < argc; ++i) {
 		const char *arg = argv[i];
 		if (arg[0] == '-' && arg[1] != '\0') {
@@ -730,6 +1458,7 @@ int main(int argc, char **argv)
 			if (option[0] == 'o') {
 				GET_ARG_AFTER(outname, "-o");
 			} else if (option[0] == 'g') {
+				debug_info = true;
 				set_be_option("debuginfo=stabs");
 				set_be_option("omitfp=no");
 				set_be_option("ia32-nooptcc=yes");
@@ -745,18 +1474,31 @@ int main(int argc, char **argv)
 				const char *opt;
 				GET_ARG_AFTER(opt, "-I");
 				add_flag(&cppflags_obst, "-I%s", opt);
+				add_include_path(opt, false);
 			} else if (option[0] == 'D') {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-D");
 				add_flag(&cppflags_obst, "-D%s", opt);
+				add_define_option(opt);
 			} else if (option[0] == 'U') {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-U");
 				add_flag(&cppflags_obst, "-U%s", opt);
+				add_undef(opt);
 			} else if (option[0] == 'l') {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-l");
 				add_flag(&ldflags_obst, "-l%s", opt);
+			} else if (option[0] == 'j') {
+				const char *opt;
+				GET_ARG_AFTER(opt, "-j");
+				int jobs = atoi(opt);
+				if (jobs <= 0) {
+					fprintf(stderr, "error: invalid number of jobs '%s'\n", opt);
+					argument_errors = true;
+					continue;
+				}
+				n_jobs = (unsigned) jobs;
 			} else if (option[0] == 'L') {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-L");
@@ -774,25 +1516,32 @@ int main(int argc, char **argv)
 					argument_errors = true;
 				}
 			} else if (streq(option, "M")) {
+				/* dependency generation is only supported by the external
+				 * preprocessor */
 				mode = PreprocessOnly;
+				external_preprocessor = true;
 				add_flag(&cppflags_obst, "-M");
 			} else if (streq(option, "MMD") ||
 			           streq(option, "MD")) {
 			    construct_dep_target = true;
+				external_preprocessor = true;
 				add_flag(&cppflags_obst, "-%s", option);
 			} else if (streq(option, "MM")  ||
 			           streq(option, "MP")) {
+				external_preprocessor = true;
 				add_flag(&cppflags_obst, "-%s", option);
 			} else if (streq(option, "MT") ||
 			           streq(option, "MQ") ||
 			           streq(option, "MF")) {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-MT");
+				external_preprocessor = true;
 				add_flag(&cppflags_obst, "-%s", option);
 				add_flag(&cppflags_obst, "%s", opt);
 			} else if (streq(option, "include")) {
 				const char *opt;
 				GET_ARG_AFTER(opt, "-include");
+				external_preprocessor = true;
 				add_flag(&cppflags_obst, "-include");
 				add_flag(&cppflags_obst, "%s", opt);
 			} else if (streq(option, "isystem")) {
@@ -800,17 +1549,29 @@ int main(int argc, char **argv)
 				GET_ARG_AFTER(opt, "-isystem");
 				add_flag(&cppflags_obst, "-isystem");
 				add_flag(&cppflags_obst, "%s", opt);
+				add_include_path(opt, true);
+			} else if (streq(option, "iquote")) {
+				const char *opt;
+				GET_ARG_AFTER(opt, "-iquote");
+				add_flag(&cppflags_obst, "-iquote");
+				add_flag(&cppflags_obst, "%s", opt);
+				add_quote_include_path(opt);
 #if defined(linux) || defined(__linux) || defined(__linux__) || defined(__CYGWIN__)
 			} else if (streq(option, "pthread")) {
 				/* set flags for the preprocessor */
 				add_flag(&cppflags_obst, "-D_REENTRANT");
+				add_define("_REENTRANT", NULL, false);
 				/* set flags for the linker */
 				add_flag(&ldflags_obst, "-lpthread");
 #endif
-			} else if (streq(option, "nostdinc")
-					|| streq(option, "trigraphs")) {
+			} else if (streq(option, "nostdinc")) {
 				/* pass these through to the preprocessor */
 				add_flag(&cppflags_obst, "%s", arg);
+				no_std_includes = true;
+			} else if (streq(option, "trigraphs")) {
+				/* pass these through to the preprocessor, the builtin
+				 * preprocessor always handles trigraphs */
+				add_flag(&cppflags_obst, "%s", arg);
 			} else if (streq(option, "pipe")) {
 				/* here for gcc compatibility */
 			} else if (streq(option, "static")) {
@@ -908,6 +1669,7 @@ int main(int argc, char **argv)
 					const char *opt;
 					GET_ARG_AFTER(opt, "-Wp,");
 					add_flag(&cppflags_obst, "-Wp,%s", opt);
+					external_preprocessor = true;
 				} else if (strstart(option + 1, "l,")) {
 					// pass options directly to the linker
 					const char *opt;
@@ -1062,8 +1824,23 @@ int main(int argc, char **argv)
 					strict_mode = true;
 				} else if (streq(option, "lextest")) {
 					mode = LexTest;
+				} else if (streq(option, "external-preprocessor")) {
+					external_preprocessor = true;
 				} else if (streq(option, "benchmark")) {
 					mode = BenchmarkParser;
+				} else if (strstart(option, "benchmark-runs=") != NULL) {
+					int runs = atoi(strstart(option, "benchmark-runs="));
+					if (runs <= 0) {
+						fprintf(stderr, "error: invalid number of benchmark runs '%s'\n",
+						        arg);
+						argument_errors = true;
+						continue;
+					}
+					benchmark_runs = (unsigned) runs;
+				} else if (strstart(option, "cache-dir=") != NULL) {
+					cache_dir = strstart(option, "cache-dir=");
+				} else if (streq(option, "benchmark-json")) {
+					benchmark_json = true;
 				} else if (streq(option, "print-ast")) {
 					mode = PrintAst;
 				} else if (streq(option, "print-implicit-cast")) {
@@ -1094,6 +1871,13 @@ int main(int argc, char **argv)
 					jna_set_libname(argv[i]);
 				} else if (streq(option, "time")) {
 					do_timing = true;
+				} else if (strstart(option, "time-trace=") != NULL) {
+					time_trace = strstart(option, "time-trace=");
+				} else if (streq(option, "pp-stats")
+				           || streq(option, "pp-stats=text")) {
+					pp_stats_format = PP_STATS_TEXT;
+				} else if (streq(option, "pp-stats=json")) {
+					pp_stats_format = PP_STATS_JSON;
 				} else if (streq(option, "version")) {
 					print_cparser_version();
 					return EXIT_SUCCESS;
@@ -1112,6 +1896,24 @@ int main(int argc, char **argv)
 					mode         = CompileDump;
 				} else if (streq(option, "export-ir")) {
 					mode = CompileExportIR;
+				} else if (streq(option, "server")) {
+					++i;
+					if (i >= argc) {
+						fprintf(stderr, "error: "
+						        "expected argument after '--server'\n");
+						argument_errors = true;
+						break;
+					}
+					server_socket = argv[i];
+				} else if (streq(option, "prefix-header")) {
+					++i;
+					if (i >= argc) {
+						fprintf(stderr, "error: "
+						        "expected argument after '--prefix-header'\n");
+						argument_errors = true;
+						break;
+					}
+					prefix_header = argv[i];
 				} else {
 					fprintf(stderr, "error: unknown argument '%s'\n", arg);
 					argument_errors = true;
@@ -1176,7 +1978,7 @@ int main(int argc, char **argv)
 		print_file_name(print_file_name_file);
 		return EXIT_SUCCESS;
 	}
-	if (files == NULL) {
+	if (files == NULL && (server_socket == NULL || is_server_job)) {
 		fprintf(stderr, "error: no input files specified\n");
 		argument_errors = true;
 	}
@@ -1190,20 +1992,86 @@ int main(int argc, char **argv)
 	c_mode |= features_on;
 	c_mode &= ~features_off;
 
-	gen_firm_init();
-	byte_order_big_endian = be_get_backend_param()->byte_order_big_endian;
-	init_symbol_table();
-	init_types();
-	init_typehash();
-	init_basic_types();
-	init_lexer();
-	init_ast();
-	init_parser();
-	init_ast2firm();
-	init_mangle();
+	/* jobs of a compile server reuse the initialization of the server */
+	if (!is_server_job) {
+		gen_firm_init();
+		byte_order_big_endian = be_get_backend_param()->byte_order_big_endian;
+		init_symbol_table();
+		init_source_positions();
+		init_preprocessor();
+		init_types();
+		init_typehash();
+		init_basic_types();
+		init_lexer();
+		init_ast();
+		init_parser();
+		init_ast2firm();
+		init_mangle();
+	}
 
 	if (do_timing)
 		timer_init();
+	if (time_trace != NULL) {
+		timer_trace_init(time_trace);
+		/* server jobs append to the trace of the server */
+		time_trace = NULL;
+	}
+
+	/* an explicitly chosen preprocessor is still run as external program */
+	if (getenv("CPARSER_PP") != NULL)
+		external_preprocessor = true;
+	if (!no_std_includes && !is_server_job)
+		add_system_include_dirs();
+
+	if (cache_dir != NULL && !is_server_job)
+		init_cache(cache_dir);
+	/* server jobs add their command line to the key of the server */
+	hash_cache_configuration(argc, argv, files);
+	cache_save_base();
+
+	if (prefix_header != NULL && !is_server_job) {
+		if (mode == PreprocessOnly || mode == LexTest) {
+			fprintf(stderr, "warning: prefix header '%s' ignored\n",
+			        prefix_header);
+		} else {
+			parse_prefix_header(prefix_header, features_on, features_off);
+		}
+	}
+
+	if (server_socket != NULL && !is_server_job) {
+		server_config.opt_level       = opt_level;
+		server_config.target          = target;
+		server_config.target_triple   = target_triple;
+		server_config.cache_dir       = cache_dir;
+		server_config.prefix_header   = prefix_header;
+		server_config.no_std_includes = no_std_includes;
+
+		/* jobs start with the directory listings of the server */
+		cache_include_directories();
+		/* only returns in a forked process running a single job */
+		timer_trace_flush();
+		compile_server_run(server_socket, &argc, &argv);
+		is_server_job = true;
+
+		/* the job has the environment of the client now */
+		target_triple   = NULL;
+		cache_dir       = getenv("CPARSER_CACHE_DIR");
+		prefix_header   = NULL;
+		no_std_includes = false;
+		goto parse_options;
+	}
+
+	if (is_server_job) {
+		server_config_t job_config;
+		job_config.opt_level       = get_opt_level(argc, argv);
+		job_config.target          = getenv("TARGET");
+		job_config.target_triple   = target_triple;
+		job_config.cache_dir       = cache_dir;
+		job_config.prefix_header   = prefix_header;
+		job_config.no_std_includes = no_std_includes;
+		if (!server_config_equal(&job_config, &server_config))
+			compile_server_reject_job();
+	}
 
 	if (construct_dep_target) {
 		if (outname != 0 && strlen(outname) >= 2) {
@@ -1215,8 +2083,37 @@ int main(int argc, char **argv)
 		dep_target[0] = '\0';
 	}
 
+	/* every translation unit needs a fresh firm program, so multiple units
+	 * are compiled by worker processes forked from the initialized compiler */
+	bool use_workers     = false;
+	bool per_file_output = false;
+#ifdef HAVE_FORK
+	if (mode == ParseOnly || mode == Compile || mode == CompileAssemble
+			|| mode == CompileAssembleLink) {
+		unsigned n_units = 0;
+		for (file_list_entry_t *entry = files; entry != NULL;
+				entry = entry->next) {
+			if (entry->type != FILETYPE_OBJECT)
+				++n_units;
+		}
+		use_workers = n_units > 1;
+	}
+	if (use_workers && (mode == Compile || mode == CompileAssemble)) {
+		if (outname != NULL) {
+			fprintf(stderr, "error: cannot specify -o with -c or -S with multiple files\n");
+			return EXIT_FAILURE;
+		}
+		per_file_output = true;
+	}
+	if (use_workers) {
+		workers = XMALLOCN(worker_t, n_jobs);
+		/* the workers start with the directory listings read here */
+		cache_include_directories();
+	}
+#endif
+
 	char outnamebuf[4096];
-	if (outname == NULL) {
+	if (outname == NULL && !per_file_output) {
 		const char *filename = files->name;
 
 		switch(mode) {
@@ -1256,10 +2153,12 @@ int main(int argc, char **argv)
 		}
 	}
 
-	assert(outname != NULL);
+	assert(outname != NULL || per_file_output);
 
-	FILE *out;
-	if (streq(outname, "-")) {
+	FILE *out = NULL;
+	if (per_file_output) {
+		/* each worker opens the output file for its input */
+	} else if (streq(outname, "-")) {
 		out = stdout;
 	} else {
 		out = fopen(outname, "w");
@@ -1270,9 +2169,16 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* the cache stores the assembler output */
+	bool use_cache = cache_dir != NULL && (mode == Compile
+			|| mode == CompileAssemble || mode == CompileAssembleLink);
+
 	file_list_entry_t *file;
 	bool               already_constructed_firm = false;
-	for (file = files; file != NULL; file = file->next) {
+	bool               is_worker                = false;
+	const char        *worker_object            = NULL;
+	/* a worker only compiles the file it was started for */
+	for (file = files; file != NULL; file = is_worker ? NULL : file->next) {
 		char        asm_tempfile[1024];
 		const char *filename = file->name;
 		filetype_t  filetype = file->type;
@@ -1280,6 +2186,57 @@ int main(int argc, char **argv)
 		if (filetype == FILETYPE_OBJECT)
 			continue;
 
+#ifdef HAVE_FORK
+		if (use_workers) {
+			while (n_workers >= n_jobs) {
+				if (!wait_for_worker())
+					result = EXIT_FAILURE;
+			}
+
+			/* the object file is created here so the driver cleans it up */
+			const char *object_name = NULL;
+			if (mode == CompileAssembleLink) {
+				char  temp[1024];
+				FILE *tempf = make_temp_file(temp, sizeof(temp), "cco");
+				fclose(tempf);
+				object_name = obstack_copy(&file_obst, temp, strlen(temp) + 1);
+			}
+
+			fflush(NULL);
+			timer_trace_flush();
+			pid_t pid = fork();
+			if (pid == -1) {
+				fprintf(stderr, "error: couldn't start worker process: %s\n",
+				        strerror(errno));
+				return EXIT_FAILURE;
+			}
+			if (pid != 0) {
+				worker_t *worker    = &workers[n_workers++];
+				worker->pid         = pid;
+				worker->file        = file;
+				worker->object_name = object_name;
+				continue;
+			}
+
+			/* we are the worker: temporary files of the driver are not ours */
+			is_worker     = true;
+			n_workers     = 0;
+			temp_files    = NULL;
+			worker_object = object_name;
+			if (per_file_output) {
+				get_output_name(outnamebuf, sizeof(outnamebuf), filename,
+				                mode == Compile ? ".s" : ".o");
+				outname = outnamebuf;
+				out     = fopen(outname, "w");
+				if (out == NULL) {
+					fprintf(stderr, "Couldn't open '%s' for writing: %s\n",
+					        outname, strerror(errno));
+					return EXIT_FAILURE;
+				}
+			}
+		}
+#endif
+
 		FILE *in = NULL;
 		if (mode == LexTest) {
 			if (in == NULL)
@@ -1290,6 +2247,7 @@ int main(int argc, char **argv)
 		}
 
 		FILE *preprocessed_in = NULL;
+		bool  run_preprocessor = false;
 		filetype_t next_filetype = filetype;
 		switch (filetype) {
 			case FILETYPE_C:
@@ -1302,6 +2260,13 @@ int main(int argc, char **argv)
 				next_filetype = FILETYPE_PREPROCESSED_ASSEMBLER;
 				goto preprocess;
 preprocess:
+				if (!external_preprocessor && filetype != FILETYPE_ASSEMBLER) {
+					/* C and C++ are preprocessed while parsing */
+					run_preprocessor = true;
+					filetype         = next_filetype;
+					break;
+				}
+
 				/* no support for input on FILE* yet */
 				if (in != NULL)
 					panic("internal compiler error: in for preprocessor != NULL");
@@ -1326,10 +2291,31 @@ preprocess:
 				break;
 		}
 
-		FILE *asm_out;
+		/* the object file produced for -c and linking */
+		char        obj_tempfile[1024];
+		const char *filename_o = NULL;
+		if (mode == CompileAssemble) {
+			filename_o = outname;
+		} else if (mode == CompileAssembleLink) {
+			if (worker_object != NULL) {
+				filename_o = worker_object;
+			} else {
+				FILE *tempf = make_temp_file(obj_tempfile, sizeof(obj_tempfile),
+				                             "cco");
+				fclose(tempf);
+				filename_o = obj_tempfile;
+			}
+		}
+
+		/* the assembly is piped into the assembler unless the cache needs
+		 * it as file or a custom assembler might not read from stdin */
+		bool pipe_assembler = filename_o != NULL && !use_cache
+			&& getenv("CPARSER_AS") == NULL;
+
+		FILE *asm_out = NULL;
 		if (mode == Compile) {
 			asm_out = out;
-		} else {
+		} else if (!pipe_assembler) {
 			asm_out = make_temp_file(asm_tempfile, sizeof(asm_tempfile), "ccs");
 		}
 
@@ -1338,26 +2324,7 @@ preprocess:
 
 		/* preprocess and compile */
 		if (filetype == FILETYPE_PREPROCESSED_C) {
-			char const* invalid_mode;
-			switch (standard) {
-				case STANDARD_ANSI:
-				case STANDARD_C89:   c_mode = _C89;                break;
-				/* TODO determine difference between these two */
-				case STANDARD_C90:   c_mode = _C89;                break;
-				case STANDARD_C99:   c_mode = _C89 | _C99;         break;
-				case STANDARD_GNU89: c_mode = _C89 |        _GNUC; break;
-
-default_c_warn:
-					fprintf(stderr,
-							"warning: command line option \"-std=%s\" is not valid for C\n",
-							invalid_mode);
-					/* FALLTHROUGH */
-				case STANDARD_DEFAULT:
-				case STANDARD_GNU99:   c_mode = _C89 | _C99 | _GNUC; break;
-
-				case STANDARD_CXX98:   invalid_mode = "c++98"; goto default_c_warn;
-				case STANDARD_GNUXX98: invalid_mode = "gnu98"; goto default_c_warn;
-			}
+			set_c_mode_for_c();
 			goto do_parsing;
 		} else if (filetype == FILETYPE_PREPROCESSED_CXX) {
 			char const* invalid_mode;
@@ -1383,13 +2350,66 @@ do_parsing:
 			c_mode |= features_on;
 			c_mode &= ~features_off;
 
+			if (prefix_header_parsed) {
+				/* tokens and macros were set up for the prefix header */
+				if (filetype != FILETYPE_PREPROCESSED_C || !run_preprocessor) {
+					fprintf(stderr, "error: prefix header can't be used for '%s' (only C files with builtin preprocessor)\n",
+					        filename);
+					result = EXIT_FAILURE;
+					continue;
+				}
+			} else {
+				init_tokens();
+				if (run_preprocessor)
+					setup_predefined_macros();
+			}
+
+			if (run_preprocessor && mode == PreprocessOnly) {
+				preprocessor_open_stream(in, filename);
+				preprocessor_write_text(out);
+				preprocessor_close();
+				if (in != stdin)
+					fclose(in);
+				fclose(out);
+				/* remove output file in case of error */
+				if (error_count > 0) {
+					if (out != stdout)
+						unlink(outname);
+					return EXIT_FAILURE;
+				}
+				return EXIT_SUCCESS;
+			}
+
+			if (mode == BenchmarkParser) {
+				int bench_result
+					= benchmark_parser(in, filename, run_preprocessor, out);
+				if (in == preprocessed_in) {
+					pclose(preprocessed_in);
+				} else if (in != stdin) {
+					fclose(in);
+				}
+				return bench_result;
+			}
+
+			if (use_cache) {
+				char c_mode_string[16];
+				snprintf(c_mode_string, sizeof(c_mode_string), "%u", c_mode);
+				cache_start(debug_info);
+				cache_hash_string(filename);
+				cache_hash_string(c_mode_string);
+			}
+
 			/* do the actual parsing */
 			ir_timer_t *t_parsing = ir_timer_new();
 			timer_register(t_parsing, "Frontend: Parsing");
 			timer_push(t_parsing);
-			init_tokens();
-			translation_unit_t *const unit = do_parsing(in, filename);
+			timer_trace_begin("parse", filename);
+			translation_unit_t *const unit
+				= do_parsing(in, filename, run_preprocessor);
+			timer_trace_end();
 			timer_pop(t_parsing);
+			if (run_preprocessor && in != stdin)
+				fclose(in);
 
 			/* prints the AST even if errors occurred */
 			if (mode == PrintAst) {
@@ -1417,9 +2437,7 @@ do_parsing:
 				}
 			}
 
-			if (mode == BenchmarkParser) {
-				return result;
-			} else if (mode == PrintFluffy) {
+			if (mode == PrintFluffy) {
 				write_fluffy_decls(out, unit);
 				continue;
 			} else if (mode == PrintJna) {
@@ -1427,6 +2445,10 @@ do_parsing:
 				continue;
 			}
 
+			/* reuse the assembler output of an identical compilation */
+			if (use_cache && cache_lookup(asm_out))
+				goto output_done;
+
 			/* build the firm graph */
 			ir_timer_t *t_construct = ir_timer_new();
 			timer_register(t_construct, "Frontend: Graph construction");
@@ -1434,9 +2456,17 @@ do_parsing:
 			if (already_constructed_firm) {
 				panic("compiling multiple files/translation units not possible");
 			}
+			unsigned const n_diagnostics
+				= error_count + warning_count + diagnostic_count;
+			timer_trace_begin("construct", filename);
 			translation_unit_to_firm(unit);
+			timer_trace_end();
 			already_constructed_firm = true;
 			timer_pop(t_construct);
+			/* a cache hit skips graph construction and would lose the
+			 * diagnostics issued by it, so don't cache such units */
+			if (error_count + warning_count + diagnostic_count != n_diagnostics)
+				cache_discard();
 
 graph_built:
 			if (mode == ParseOnly) {
@@ -1474,8 +2504,21 @@ graph_built:
 				return EXIT_SUCCESS;
 			}
 
+			if (pipe_assembler)
+				asm_out = open_assembler_pipe(filename_o);
 			gen_firm_finish(asm_out, filename);
-			if (asm_out != out) {
+			if (use_cache) {
+				const char *asm_name = asm_out == out ? outname : asm_tempfile;
+				if (!streq(asm_name, "-")) {
+					fflush(asm_out);
+					cache_store(asm_name);
+				}
+			}
+
+output_done:
+			if (pipe_assembler) {
+				close_assembler_pipe(asm_out);
+			} else if (asm_out != out) {
 				fclose(asm_out);
 			}
 		} else if (filetype == FILETYPE_IR) {
@@ -1483,6 +2526,8 @@ graph_built:
 			ir_import(filename);
 			goto graph_built;
 		} else if (filetype == FILETYPE_PREPROCESSED_ASSEMBLER) {
+			if (pipe_assembler)
+				asm_out = open_assembler_pipe(filename_o);
 			copy_file(asm_out, in);
 			if (in == preprocessed_in) {
 				int pp_result = pclose(preprocessed_in);
@@ -1493,48 +2538,47 @@ graph_built:
 					return pp_result;
 				}
 			}
-			if (asm_out != out) {
+			if (pipe_assembler) {
+				close_assembler_pipe(asm_out);
+			} else if (asm_out != out) {
 				fclose(asm_out);
 			}
 		}
 
-		if (mode == Compile)
+		/* nothing to assemble for -S (or when only printing the AST) */
+		if (filename_o == NULL)
 			continue;
 
-		/* if we're here then we have preprocessed assembly */
-		filename = asm_tempfile;
-		filetype = FILETYPE_PREPROCESSED_ASSEMBLER;
-
 		/* assemble */
-		if (filetype == FILETYPE_PREPROCESSED_ASSEMBLER) {
-			char        temp[1024];
-			const char *filename_o;
-			if (mode == CompileAssemble) {
-				fclose(out);
-				filename_o = outname;
-			} else {
-				FILE *tempf = make_temp_file(temp, sizeof(temp), "cco");
-				fclose(tempf);
-				filename_o = temp;
-			}
-
-			assemble(filename_o, filename);
+		if (mode == CompileAssemble)
+			fclose(out);
+		if (!pipe_assembler)
+			assemble(filename_o, asm_tempfile);
 
-			size_t len = strlen(filename_o) + 1;
-			filename = obstack_copy(&file_obst, filename_o, len);
-			filetype = FILETYPE_OBJECT;
-		}
+		size_t len = strlen(filename_o) + 1;
+		filename = obstack_copy(&file_obst, filename_o, len);
+		filetype = FILETYPE_OBJECT;
 
 		/* ok we're done here, process next file */
 		file->name = filename;
 		file->type = filetype;
 	}
 
+#ifdef HAVE_FORK
+	while (n_workers > 0) {
+		if (!wait_for_worker())
+			result = EXIT_FAILURE;
+	}
+	free(workers);
+#endif
+
 	if (result != EXIT_SUCCESS) {
-		if (out != stdout)
+		if (out != stdout && outname != NULL)
 			unlink(outname);
 		return result;
 	}
+	if (is_worker)
+		return EXIT_SUCCESS;
 
 	/* link program file */
 	if (mode == CompileAssembleLink) {
@@ -1584,6 +2628,7 @@ graph_built:
 	obstack_free(&asflags_obst, NULL);
 	obstack_free(&file_obst, NULL);
 
+	exit_cache();
 	exit_mangle();
 	exit_ast2firm();
 	exit_parser();
@@ -1592,6 +2637,8 @@ graph_built:
 	exit_typehash();
 	exit_types();
 	exit_tokens();
+	exit_preprocessor();
+	exit_source_positions();
 	exit_symbol_table();
 	return EXIT_SUCCESS;
 }
@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "parser.h"
 #include "diagnostic.h"
@@ -91,6 +92,9 @@ static function_t          *current_function  = NULL;
 static entity_t            *current_entity    = NULL;
 static entity_t            *current_init_decl = NULL;
 static switch_statement_t  *current_switch    = NULL;
+/** case ranges of current_switch in label order (flexible array), see
+ * merge_case_ranges() */
+static case_range_t        *current_case_ranges = NULL;
 static statement_t         *current_loop      = NULL;
 static statement_t         *current_parent    = NULL;
 static ms_try_statement_t  *current_try       = NULL;
@@ -427,7 +431,8 @@ static size_t get_initializer_size(initializer_kind_t kind)
 		[INITIALIZER_STRING]      = sizeof(initializer_string_t),
 		[INITIALIZER_WIDE_STRING] = sizeof(initializer_wide_string_t),
 		[INITIALIZER_LIST]        = sizeof(initializer_list_t),
-		[INITIALIZER_DESIGNATOR]  = sizeof(initializer_designator_t)
+		[INITIALIZER_DESIGNATOR]  = sizeof(initializer_designator_t),
+		[INITIALIZER_DATA]        = sizeof(initializer_data_t)
 	};
 	assert(kind < lengthof(sizes));
 	assert(sizes[kind] != 0);
@@ -766,7 +771,7 @@ static void stack_push(stack_entry_t **stack_ptr, entity_t *entity)
  */
 static void environment_push(entity_t *entity)
 {
-	assert(entity->base.source_position.input_name != NULL);
+	assert(entity->base.source_position.loc != SOURCE_LOC_UNKNOWN);
 	assert(entity->base.parent_scope != NULL);
 	stack_push(&environment_stack, entity);
 }
@@ -1953,13 +1958,10 @@ static bool walk_designator(type_path_t *path, const designator_t *designator,
 				orig_type             = type_error_type;
 			} else {
 				compound_t *compound = type->compound.compound;
-				entity_t   *iter     = compound->members.entities;
-				for (; iter != NULL; iter = iter->base.next) {
-					if (iter->base.symbol == symbol) {
-						break;
-					}
-				}
-				if (iter == NULL) {
+				entity_t   *iter
+					= find_compound_member(compound, symbol, NULL);
+				/* no designators for members of anonymous structs/unions */
+				if (iter == NULL || iter->base.symbol != symbol) {
 					errorf(&designator->source_position,
 					       "'%T' has no member named '%Y'", orig_type, symbol);
 					goto failed;
@@ -2097,6 +2099,107 @@ static initializer_t *create_empty_initializer(void)
 	return &empty_initializer;
 }
 
+/**
+ * Checks whether constant values of a type can be packed into an
+ * initializer data node.
+ */
+static bool is_data_element_type(const type_t *type)
+{
+	if (type->kind != TYPE_ATOMIC)
+		return false;
+
+	atomic_type_kind_t const akind = type->atomic.akind;
+	unsigned           const flags = get_atomic_type_flags(akind);
+	if (!(flags & ATOMIC_TYPE_FLAG_INTEGER))
+		return false;
+
+	/* the values must survive the round trip through long */
+	unsigned const size = get_atomic_type_size(akind);
+	return size < sizeof(long)
+	    || (size == sizeof(long) && (flags & ATOMIC_TYPE_FLAG_SIGNED));
+}
+
+/**
+ * Checks whether an expression tree consists only of nodes, which are not
+ * referenced from anywhere else, so its memory may be released after folding.
+ */
+static bool is_disposable_constant(const expression_t *expression)
+{
+	switch (expression->kind) {
+	case EXPR_LITERAL_INTEGER:
+	case EXPR_LITERAL_INTEGER_OCTAL:
+	case EXPR_LITERAL_INTEGER_HEXADECIMAL:
+	case EXPR_LITERAL_CHARACTER:
+	case EXPR_LITERAL_WIDE_CHARACTER:
+		return true;
+
+	case EXPR_UNARY_NEGATE:
+	case EXPR_UNARY_PLUS:
+	case EXPR_UNARY_BITWISE_NEGATE:
+	case EXPR_UNARY_CAST_IMPLICIT:
+		return is_disposable_constant(expression->unary.value);
+
+	case EXPR_BINARY_ADD:
+	case EXPR_BINARY_SUB:
+	case EXPR_BINARY_MUL:
+	case EXPR_BINARY_DIV:
+	case EXPR_BINARY_MOD:
+	case EXPR_BINARY_SHIFTLEFT:
+	case EXPR_BINARY_SHIFTRIGHT:
+	case EXPR_BINARY_BITWISE_AND:
+	case EXPR_BINARY_BITWISE_OR:
+	case EXPR_BINARY_BITWISE_XOR:
+		return is_disposable_constant(expression->binary.left)
+		    && is_disposable_constant(expression->binary.right);
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * Creates a value initializer for one byte of #embed data, used for element
+ * types which can't be packed into an initializer data node.
+ */
+static initializer_t *create_embed_byte_initializer(type_t *orig_type,
+                                                    unsigned char byte,
+                                                    const source_position_t *pos)
+{
+	expression_t *literal = allocate_expression_zero(EXPR_LITERAL_INTEGER);
+	literal->base.source_position = *pos;
+	literal->base.type            = type_int;
+
+	char buf[8];
+	snprintf(buf, sizeof(buf), "%u", (unsigned) byte);
+	literal->literal.value = make_string(buf);
+	determine_literal_type(&literal->literal);
+
+	return initializer_from_expression(orig_type, literal);
+}
+
+/**
+ * Appends an initializer data node with the collected bytes of a run of
+ * constant values (if any) to an initializer list and resets the collection.
+ */
+static void flush_initializer_data(initializer_t ***initializers,
+                                   unsigned char **data, type_t *element_type)
+{
+	size_t const n_bytes = ARR_LEN(*data);
+	if (n_bytes == 0)
+		return;
+
+	size_t const   size   = sizeof(initializer_data_t) + n_bytes;
+	initializer_t *result = allocate_ast_zero(size);
+	result->kind              = INITIALIZER_DATA;
+	result->data.element_type = element_type;
+	result->data.len
+		= n_bytes / get_atomic_type_size(element_type->atomic.akind);
+	memcpy(result->data.data, *data, n_bytes);
+	ARR_APP1(initializer_t*, *initializers, result);
+
+	ARR_SHRINKLEN(*data, 0);
+}
+
 /**
  * Parse a part of an initialiser for a struct or union,
  */
@@ -2120,6 +2223,11 @@ static initializer_t *parse_sub_initializer(type_path_t *path,
 
 	initializer_t **initializers = NEW_ARR_F(initializer_t*, 0);
 
+	/* runs of integer constants are collected as packed data, so huge tables
+	 * do not need an expression and an initializer per element */
+	unsigned char *data      = NEW_ARR_F(unsigned char, 0);
+	type_t        *data_type = NULL;
+
 	while (true) {
 		designator_t *designator = NULL;
 		if (token.type == '.' || token.type == '[') {
@@ -2141,6 +2249,8 @@ finish_designator:
 				goto end_error;
 			}
 
+			flush_initializer_data(&initializers, &data, data_type);
+
 			initializer_t *designator_initializer
 				= allocate_initializer_zero(INITIALIZER_DESIGNATOR);
 			designator_initializer->designator.designator = designator;
@@ -2181,8 +2291,84 @@ finish_designator:
 					goto error_parse_next;
 				}
 			}
+		} else if (token.type == T_EMBED) {
+			/* the bytes of an #embed directive initialize the current and the
+			 * following objects like a list of integer constants */
+			source_position_t const    pos     = token.source_position;
+			const unsigned char *const bytes
+				= (const unsigned char*) token.literal.begin;
+			size_t               const n_bytes = token.literal.size;
+			next_token();
+
+			for (size_t i = 0; i < n_bytes && type != NULL;) {
+				/* we might have to descend into types until we're at a scalar
+				 * type */
+				while (!is_type_scalar(type)) {
+					if (!is_type_valid(type))
+						goto end_error;
+					descend_into_subtype(path);
+					orig_type = path->top_type;
+					if (orig_type == NULL)
+						goto end_error;
+					type = skip_typeref(orig_type);
+				}
+				if (!is_data_element_type(type)) {
+					/* e.g. unsigned long or double elements get one value
+					 * initializer per byte */
+					if (!is_type_arithmetic(type)) {
+						errorf(&pos, "#embed data cannot initialize type '%T'",
+						       orig_type);
+						goto end_error;
+					}
+					initializer_t *const init
+						= create_embed_byte_initializer(orig_type, bytes[i],
+						                                &pos);
+					flush_initializer_data(&initializers, &data, data_type);
+					ARR_APP1(initializer_t*, initializers, init);
+					++i;
+					goto next_embed_element;
+				}
+
+				if (data_type != type)
+					flush_initializer_data(&initializers, &data, data_type);
+				data_type = type;
+
+				unsigned           const size
+					= get_atomic_type_size(type->atomic.akind);
+				type_path_entry_t *const top      = get_type_path_top(path);
+				type_t            *const top_type = skip_typeref(top->type);
+				if (size == 1 && is_type_array(top_type)) {
+					/* copy as many bytes as the array takes at once */
+					size_t n = n_bytes - i;
+					if (top_type->array.size_constant
+					    && n > top_type->array.size - top->v.index)
+						n = top_type->array.size - top->v.index;
+					size_t const old_len = ARR_LEN(data);
+					ARR_RESIZE(unsigned char, data, old_len + n);
+					memcpy(&data[old_len], &bytes[i], n);
+					top->v.index += n - 1;
+					i            += n;
+				} else {
+					ARR_APP1(unsigned char, data, bytes[i]);
+					for (unsigned b = 1; b < size; ++b) {
+						ARR_APP1(unsigned char, data, 0);
+					}
+					++i;
+				}
+next_embed_element:
+				if (i == n_bytes)
+					break;
+
+				advance_current_object(path, top_path_level);
+				orig_type = path->top_type;
+				type      = orig_type != NULL ? skip_typeref(orig_type) : NULL;
+			}
+			if (type == NULL)
+				goto error_excess;
+			sub = NULL;
 		} else {
 			/* must be an expression */
+			void         *mark       = obstack_alloc(&ast_obstack, 0);
 			expression_t *expression = parse_assignment_expression();
 			mark_vars_read(expression, NULL);
 
@@ -2216,6 +2402,7 @@ finish_designator:
 								 orig_type);
 					}
 					/* TODO: eat , ... */
+					DEL_ARR_F(data);
 					return sub;
 				}
 			}
@@ -2241,6 +2428,28 @@ finish_designator:
 
 				descend_into_subtype(path);
 			}
+
+			/* values which can't be folded (e.g. a division by zero) stay
+			 * value initializers */
+			long val;
+			if (sub->kind == INITIALIZER_VALUE && is_data_element_type(type)
+			    && is_constant_expression(sub->value.value)
+			       == EXPR_CLASS_CONSTANT
+			    && try_fold_constant_to_int(sub->value.value, &val)) {
+				expression_t  *const value = sub->value.value;
+				unsigned       const size
+					= get_atomic_type_size(type->atomic.akind);
+				if (data_type != type)
+					flush_initializer_data(&initializers, &data, data_type);
+				data_type = type;
+				for (unsigned i = 0; i < size; ++i) {
+					ARR_APP1(unsigned char, data,
+					         (unsigned char) ((unsigned long) val >> (8 * i)));
+				}
+				if (is_disposable_constant(value))
+					obstack_free(&ast_obstack, mark);
+				sub = NULL;
+			}
 		}
 
 		/* update largest index of top array */
@@ -2255,7 +2464,10 @@ finish_designator:
 
 		if (type != NULL) {
 			/* append to initializers list */
-			ARR_APP1(initializer_t*, initializers, sub);
+			if (sub != NULL) {
+				flush_initializer_data(&initializers, &data, data_type);
+				ARR_APP1(initializer_t*, initializers, sub);
+			}
 		} else {
 error_excess:
 			if (warning.other) {
@@ -2288,6 +2500,9 @@ error_parse_next:
 		}
 	}
 
+	flush_initializer_data(&initializers, &data, data_type);
+	DEL_ARR_F(data);
+
 	size_t len  = ARR_LEN(initializers);
 	size_t size = sizeof(initializer_list_t) + len * sizeof(initializers[0]);
 	initializer_t *result = allocate_ast_zero(size);
@@ -2303,6 +2518,7 @@ error_parse_next:
 
 end_error:
 	skip_initializers();
+	DEL_ARR_F(data);
 	DEL_ARR_F(initializers);
 	ascend_to(path, top_path_level+1);
 	return NULL;
@@ -2401,13 +2617,8 @@ end_error:
 
 static void append_entity(scope_t *scope, entity_t *entity)
 {
-	if (scope->last_entity != NULL) {
-		scope->last_entity->base.next = entity;
-	} else {
-		scope->entities = entity;
-	}
 	entity->base.parent_entity = current_entity;
-	scope->last_entity         = entity;
+	scope_append_entity(scope, entity);
 }
 
 
@@ -2443,7 +2654,11 @@ static compound_t *parse_compound_type_specifier(bool is_struct)
 				       is_struct ? "struct" : "union", symbol,
 				       &compound->base.source_position);
 				/* clear members in the hope to avoid further errors */
-				compound->members.entities = NULL;
+				compound->members.entities    = NULL;
+				compound->members.last_entity = NULL;
+				compound->members.n_entities  = 0;
+				compound->members.index       = NULL;
+				compound->member_index        = NULL;
 			}
 		}
 	} else if (token.type != '{') {
@@ -2500,6 +2715,7 @@ static void parse_enum_entries(type_t *const enum_type)
 		return;
 	}
 
+	long next_value = 0;
 	add_anchor_token('}');
 	do {
 		if (token.type != T_IDENTIFIER) {
@@ -2523,7 +2739,10 @@ static void parse_enum_entries(type_t *const enum_type)
 			entity->enum_value.value = value;
 
 			/* TODO semantic */
+			if (is_constant_expression(value) == EXPR_CLASS_CONSTANT)
+				next_value = fold_constant_to_int(value);
 		}
+		entity->enum_value.folded_value = next_value++;
 
 		record_entity(entity, false);
 	} while (next_if(',') && token.type != '}');
@@ -4158,6 +4377,17 @@ static void merge_in_attributes(declaration_t *decl, attribute_t *attributes)
 	}
 }
 
+/**
+ * Returns true if the entity was declared by the builtin declarations
+ * main.c feeds to the parser before the real input.
+ */
+static bool is_declared_in_builtins(const entity_t *entity)
+{
+	const char *input_name
+		= get_source_position_input_name(&entity->base.source_position);
+	return input_name != NULL && strcmp(input_name, "<builtin>") == 0;
+}
+
 /**
  * record entities for the NAMESPACE_NORMAL, and produce error messages/warnings
  * for various problems that occur for multiple definitions
@@ -4322,8 +4552,7 @@ warn_redundant_declaration: ;
 					} else if (!is_definition        &&
 							warning.redundant_decls  &&
 							is_type_valid(prev_type) &&
-							strcmp(previous_entity->base.source_position.input_name,
-								"<builtin>") != 0) {
+							!is_declared_in_builtins(previous_entity)) {
 						warningf(pos,
 						         "redundant declaration for '%Y' (declared %P)",
 						         symbol, &previous_entity->base.source_position);
@@ -4794,7 +5023,8 @@ static void print_in_function(void)
 	if (first_err) {
 		first_err = false;
 		diagnosticf("%s: In function '%Y':\n",
-		            current_function->base.base.source_position.input_name,
+		            get_source_position_input_name(
+		                &current_function->base.base.source_position),
 		            current_function->base.base.symbol);
 	}
 }
@@ -4815,7 +5045,7 @@ static void check_labels(void)
 		label_t *label = goto_statement->label;
 
 		label->used = true;
-		if (label->base.source_position.input_name == NULL) {
+		if (label->base.source_position.loc == SOURCE_LOC_UNKNOWN) {
 			print_in_function();
 			errorf(&goto_statement->base.source_position,
 			       "label '%Y' used but not defined", label->base.symbol);
@@ -5030,6 +5260,7 @@ static bool initializer_returns(initializer_t const *const init)
 		case INITIALIZER_STRING:
 		case INITIALIZER_WIDE_STRING:
 		case INITIALIZER_DESIGNATOR: // designators have no payload
+		case INITIALIZER_DATA:
 			return true;
 	}
 	panic("unhandled initializer");
@@ -5725,26 +5956,7 @@ static type_t *make_bitfield_type(type_t *base_type, expression_t *size,
 
 static entity_t *find_compound_entry(compound_t *compound, symbol_t *symbol)
 {
-	entity_t *iter = compound->members.entities;
-	for (; iter != NULL; iter = iter->base.next) {
-		if (iter->kind != ENTITY_COMPOUND_MEMBER)
-			continue;
-
-		if (iter->base.symbol == symbol) {
-			return iter;
-		} else if (iter->base.symbol == NULL) {
-			/* search in anonymous structs and unions */
-			type_t *type = skip_typeref(iter->declaration.type);
-			if (is_type_compound(type)) {
-				if (find_compound_entry(type->compound.compound, symbol)
-						!= NULL)
-					return iter;
-			}
-			continue;
-		}
-	}
-
-	return NULL;
+	return find_compound_member(compound, symbol, NULL);
 }
 
 static void check_deprecated(const source_position_t *source_position,
@@ -5807,36 +6019,26 @@ static expression_t *find_create_select(const source_position_t *pos,
                                         type_qualifiers_t qualifiers,
                                         compound_t *compound, symbol_t *symbol)
 {
-	entity_t *iter = compound->members.entities;
-	for (; iter != NULL; iter = iter->base.next) {
-		if (iter->kind != ENTITY_COMPOUND_MEMBER)
-			continue;
-
-		symbol_t *iter_symbol = iter->base.symbol;
-		if (iter_symbol == NULL) {
-			type_t *type = iter->declaration.type;
-			if (type->kind != TYPE_COMPOUND_STRUCT
-					&& type->kind != TYPE_COMPOUND_UNION)
-				continue;
-
-			compound_t *sub_compound = type->compound.compound;
+	entity_t *entry = find_compound_entry(compound, symbol);
+	if (entry == NULL)
+		return NULL;
 
-			if (find_compound_entry(sub_compound, symbol) == NULL)
-				continue;
+	if (entry->base.symbol == NULL) {
+		type_t *type = entry->declaration.type;
+		if (type->kind != TYPE_COMPOUND_STRUCT
+				&& type->kind != TYPE_COMPOUND_UNION)
+			return NULL;
 
-			expression_t *sub_addr = create_select(pos, addr, qualifiers, iter);
-			sub_addr->base.source_position = *pos;
-			sub_addr->select.implicit      = true;
-			return find_create_select(pos, sub_addr, qualifiers, sub_compound,
-			                          symbol);
-		}
+		compound_t *sub_compound = type->compound.compound;
 
-		if (iter_symbol == symbol) {
-			return create_select(pos, addr, qualifiers, iter);
-		}
+		expression_t *sub_addr = create_select(pos, addr, qualifiers, entry);
+		sub_addr->base.source_position = *pos;
+		sub_addr->select.implicit      = true;
+		return find_create_select(pos, sub_addr, qualifiers, sub_compound,
+		                          symbol);
 	}
 
-	return NULL;
+	return create_select(pos, addr, qualifiers, entry);
 }
 
 static void parse_compound_declarators(compound_t *compound,
@@ -6343,22 +6545,14 @@ type_t *revert_automatic_type_conversion(const expression_t *expression)
  * Find an entity matching a symbol in a scope.
  * Uses current scope if scope is NULL
  */
-static entity_t *lookup_entity(const scope_t *scope, symbol_t *symbol,
+static entity_t *lookup_entity(scope_t *scope, symbol_t *symbol,
                                namespace_tag_t namespc)
 {
 	if (scope == NULL) {
 		return get_entity(symbol, namespc);
 	}
 
-	/* we should optimize here, if scope grows above a certain size we should
-	   construct a hashmap here... */
-	entity_t *entity = scope->entities;
-	for ( ; entity != NULL; entity = entity->base.next) {
-		if (entity->base.symbol == symbol && entity->base.namespc == namespc)
-			break;
-	}
-
-	return entity;
+	return scope_lookup_entity(scope, symbol, namespc);
 }
 
 static entity_t *parse_qualified_identifier(void)
@@ -6366,7 +6560,7 @@ static entity_t *parse_qualified_identifier(void)
 	/* namespace containing the symbol */
 	symbol_t          *symbol;
 	source_position_t  pos;
-	const scope_t     *lookup_scope = NULL;
+	scope_t           *lookup_scope = NULL;
 
 	if (next_if(T_COLONCOLON))
 		lookup_scope = &unit->scope;
@@ -7160,6 +7354,11 @@ static expression_t *parse_primary_expression(void)
 	case '(':                            return parse_parenthesized_expression();
 	case T___noop:                       return parse_noop_expression();
 
+	case T_EMBED:
+		errorf(HERE, "#embed data is only supported in initializer lists");
+		next_token();
+		return create_invalid_expression();
+
 	/* Gracefully handle type names while parsing expressions. */
 	case T_COLONCOLON:
 		return parse_reference();
@@ -9370,6 +9569,121 @@ static statement_t *parse_label_inner_statement(statement_t const *const label,
 	return inner_stmt;
 }
 
+/**
+ * Returns the index of the first range in ranges not below value.
+ */
+static size_t find_case_range(const case_range_t *ranges, size_t n_ranges,
+                              long value)
+{
+	size_t lower = 0;
+	size_t upper = n_ranges;
+	while (lower < upper) {
+		size_t middle = lower + (upper - lower) / 2;
+		if (ranges[middle].last < value) {
+			lower = middle + 1;
+		} else {
+			upper = middle;
+		}
+	}
+	return lower;
+}
+
+/**
+ * Orders case ranges by their first value, ranges starting at the same value
+ * in the order of their labels.
+ */
+static int compare_case_ranges(const void *p1, const void *p2)
+{
+	const case_range_t *r1 = *(const case_range_t *const*) p1;
+	const case_range_t *r2 = *(const case_range_t *const*) p2;
+	if (r1->first != r2->first)
+		return r1->first < r2->first ? -1 : 1;
+	/* both point into current_case_ranges, which is in label order */
+	return r1 < r2 ? -1 : r1 > r2 ? 1 : 0;
+}
+
+/** a case range overlapping one of an earlier label */
+typedef struct duplicate_case_t {
+	const case_range_t *later;    /**< range of the later label */
+	const case_range_t *previous; /**< range of the earlier label */
+} duplicate_case_t;
+
+/**
+ * Orders duplicate cases by the later label, so they are reported in source
+ * order.
+ */
+static int compare_duplicate_cases(const void *p1, const void *p2)
+{
+	const duplicate_case_t *d1 = (const duplicate_case_t*) p1;
+	const duplicate_case_t *d2 = (const duplicate_case_t*) p2;
+	/* all ranges point into current_case_ranges, which is in label order */
+	if (d1->later != d2->later)
+		return d1->later < d2->later ? -1 : 1;
+	return d1->previous < d2->previous ? -1 : d1->previous > d2->previous;
+}
+
+/**
+ * Sorts the case ranges of the current switch and merges overlapping ranges.
+ * An overlap is reported as duplicate case value at the later label; these
+ * errors are issued in label order once the switch body is parsed.
+ *
+ * @param result  receives the disjoint ranges sorted by value, needs room for
+ *                all ranges of the switch
+ * @return the number of ranges stored to result
+ */
+static size_t merge_case_ranges(case_range_t *result)
+{
+	case_range_t   *ranges = current_case_ranges;
+	size_t          n      = ARR_LEN(ranges);
+	case_range_t  **sorted = NEW_ARR_F(case_range_t*, n);
+	for (size_t i = 0; i < n; ++i) {
+		sorted[i] = &ranges[i];
+	}
+	qsort(sorted, n, sizeof(sorted[0]), compare_case_ranges);
+
+	duplicate_case_t   *duplicates = NEW_ARR_F(duplicate_case_t, 0);
+	size_t              n_result = 0;
+	const case_range_t *earliest = NULL; /* first label of the merged range */
+	const case_range_t *furthest = NULL; /* reaches the end of it */
+	for (size_t i = 0; i < n; ++i) {
+		const case_range_t *range = sorted[i];
+		if (n_result == 0 || range->first > result[n_result - 1].last) {
+			result[n_result++] = *range;
+			earliest           = range;
+			furthest           = range;
+			continue;
+		}
+
+		duplicate_case_t duplicate;
+		duplicate.later    = range > furthest ? range : furthest;
+		duplicate.previous = range > furthest ? furthest : range;
+		ARR_APP1(duplicate_case_t, duplicates, duplicate);
+
+		case_range_t *merged = &result[n_result - 1];
+		if (range < earliest) {
+			earliest      = range;
+			merged->label = range->label;
+		}
+		if (range->last > merged->last) {
+			merged->last = range->last;
+			furthest     = range;
+		}
+	}
+	DEL_ARR_F(sorted);
+
+	size_t n_duplicates = ARR_LEN(duplicates);
+	qsort(duplicates, n_duplicates, sizeof(duplicates[0]),
+	      compare_duplicate_cases);
+	for (size_t i = 0; i < n_duplicates; ++i) {
+		const duplicate_case_t *duplicate = &duplicates[i];
+		errorf(&duplicate->later->label->base.source_position,
+		       "duplicate case value (previously used %P)",
+		       &duplicate->previous->label->base.source_position);
+	}
+	DEL_ARR_F(duplicates);
+	return n_result;
+}
+
 /**
  * Parse a case statement.
  */
@@ -9422,20 +9736,11 @@ static statement_t *parse_case_statement(void)
 end_error:
 
 	if (current_switch != NULL) {
-		if (! statement->case_label.is_bad) {
-			/* Check for duplicate case values */
-			case_label_statement_t *c = &statement->case_label;
-			for (case_label_statement_t *l = current_switch->first_case; l != NULL; l = l->next) {
-				if (l->is_bad || l->is_empty_range || l->expression == NULL)
-					continue;
-
-				if (c->last_case < l->first_case || c->first_case > l->last_case)
-					continue;
-
-				errorf(pos, "duplicate case value (previously used %P)",
-				       &l->base.source_position);
-				break;
-			}
+		case_label_statement_t *c = &statement->case_label;
+		if (!c->is_bad && !c->is_empty_range) {
+			/* duplicate case values are checked at the end of the switch */
+			case_range_t const range = { c->first_case, c->last_case, c };
+			ARR_APP1(case_range_t, current_case_ranges, range);
 		}
 		/* link all cases into the switch statement */
 		if (current_switch->last_case == NULL) {
@@ -9595,29 +9900,18 @@ static void check_enum_cases(const switch_statement_t *statement)
 	if (statement->default_label != NULL)
 		return;
 
-	/* FIXME: calculation of value should be done while parsing */
-	/* TODO: quadratic algorithm here. Change to an n log n one */
-	long            last_value = -1;
-	const entity_t *entry      = enumt->enume->base.next;
+	const case_range_t *ranges   = statement->case_ranges;
+	size_t              n_ranges = statement->n_case_ranges;
+	const entity_t     *entry    = enumt->enume->base.next;
 	for (; entry != NULL && entry->kind == ENTITY_ENUM_VALUE;
 	     entry = entry->base.next) {
-		const expression_t *expression = entry->enum_value.value;
-		long                value      = expression != NULL ? fold_constant_to_int(expression) : last_value + 1;
-		bool                found      = false;
-		for (const case_label_statement_t *l = statement->first_case; l != NULL; l = l->next) {
-			if (l->expression == NULL)
-				continue;
-			if (l->first_case <= value && value <= l->last_case) {
-				found = true;
-				break;
-			}
-		}
-		if (! found) {
+		long   value = entry->enum_value.folded_value;
+		size_t i     = find_case_range(ranges, n_ranges, value);
+		if (i == n_ranges || ranges[i].first > value) {
 			warningf(&statement->base.source_position,
 			         "enumeration value '%Y' not handled in switch",
 			         entry->base.symbol);
 		}
-		last_value = value;
 	}
 }
 
@@ -9655,10 +9949,20 @@ static statement_t *parse_switch(void)
 	expect(')', end_error);
 	rem_anchor_token(')');
 
-	switch_statement_t *rem = current_switch;
+	switch_statement_t *rem        = current_switch;
+	case_range_t       *rem_ranges = current_case_ranges;
 	current_switch          = &statement->switchs;
+	current_case_ranges     = NEW_ARR_F(case_range_t, 0);
 	statement->switchs.body = parse_statement();
-	current_switch          = rem;
+
+	size_t        n_ranges = ARR_LEN(current_case_ranges);
+	case_range_t *ranges   = allocate_ast(n_ranges * sizeof(ranges[0]));
+	n_ranges = merge_case_ranges(ranges);
+	statement->switchs.case_ranges   = ranges;
+	statement->switchs.n_case_ranges = n_ranges;
+	DEL_ARR_F(current_case_ranges);
+	current_switch      = rem;
+	current_case_ranges = rem_ranges;
 
 	if (warning.switch_default &&
 	    statement->switchs.default_label == NULL) {
@@ -10350,7 +10654,7 @@ static statement_t *intern_parse_statement(void)
 	rem_anchor_token(';');
 
 	assert(statement != NULL
-			&& statement->base.source_position.input_name != NULL);
+			&& statement->base.source_position.loc != SOURCE_LOC_UNKNOWN);
 
 	return statement;
 }
@@ -0,0 +1,291 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <config.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libfirm/timing.h>
+
+#include "pp_stats.h"
+#include "symbol_t.h"
+#include "adt/array.h"
+#include "adt/obst.h"
+#include "adt/util.h"
+
+/** an #include in the include tree */
+typedef struct include_event_t {
+	pp_header_stats_t *header;
+	unsigned           depth;
+	bool               skipped;
+} include_event_t;
+
+pp_stats_format_t pp_stats_format = PP_STATS_NONE;
+
+static struct obstack      stats_obst;
+static ir_timer_t         *stats_clock;
+static const char         *unit_name;
+static pp_header_stats_t **headers;
+static pp_macro_stats_t  **macros;
+static include_event_t    *include_tree;
+
+static unsigned long get_usec(void)
+{
+	/* the clock only accumulates while stopped */
+	ir_timer_stop(stats_clock);
+	unsigned long usec = ir_timer_elapsed_usec(stats_clock);
+	ir_timer_start(stats_clock);
+	return usec;
+}
+
+void init_pp_stats(void)
+{
+	obstack_init(&stats_obst);
+	headers      = NEW_ARR_F(pp_header_stats_t*, 0);
+	macros       = NEW_ARR_F(pp_macro_stats_t*, 0);
+	include_tree = NEW_ARR_F(include_event_t, 0);
+}
+
+void exit_pp_stats(void)
+{
+	DEL_ARR_F(include_tree);
+	DEL_ARR_F(macros);
+	DEL_ARR_F(headers);
+	obstack_free(&stats_obst, NULL);
+	if (stats_clock != NULL) {
+		ir_timer_free(stats_clock);
+		stats_clock = NULL;
+	}
+}
+
+void pp_stats_begin_unit(const char *input_name)
+{
+	if (stats_clock == NULL) {
+		stats_clock = ir_timer_new();
+		ir_timer_start(stats_clock);
+	}
+	unit_name = obstack_copy0(&stats_obst, input_name, strlen(input_name));
+}
+
+pp_header_stats_t *pp_stats_new_header(const char *name)
+{
+	pp_header_stats_t *header = obstack_alloc(&stats_obst, sizeof(*header));
+	memset(header, 0, sizeof(*header));
+	header->name = obstack_copy0(&stats_obst, name, strlen(name));
+	ARR_APP1(pp_header_stats_t*, headers, header);
+	return header;
+}
+
+pp_macro_stats_t *pp_stats_new_macro(symbol_t *symbol)
+{
+	pp_macro_stats_t *macro = obstack_alloc(&stats_obst, sizeof(*macro));
+	memset(macro, 0, sizeof(*macro));
+	macro->symbol = symbol;
+	ARR_APP1(pp_macro_stats_t*, macros, macro);
+	return macro;
+}
+
+static void add_include_event(pp_header_stats_t *header, unsigned depth,
+                              bool skipped)
+{
+	include_event_t event;
+	event.header  = header;
+	event.depth   = depth;
+	event.skipped = skipped;
+	ARR_APP1(include_event_t, include_tree, event);
+}
+
+void pp_stats_enter_header(pp_header_stats_t *header, unsigned depth)
+{
+	++header->n_included;
+	/* a header including itself is only timed once */
+	if (header->active++ == 0)
+		header->enter_usec = get_usec();
+	add_include_event(header, depth, false);
+}
+
+void pp_stats_leave_header(pp_header_stats_t *header)
+{
+	assert(header->active > 0);
+	if (--header->active == 0)
+		header->usec += get_usec() - header->enter_usec;
+}
+
+void pp_stats_skip_header(pp_header_stats_t *header, unsigned depth)
+{
+	++header->n_skipped;
+	add_include_event(header, depth, true);
+}
+
+static int compare_header_time(const void *p1, const void *p2)
+{
+	const pp_header_stats_t *header1 = *(const pp_header_stats_t**) p1;
+	const pp_header_stats_t *header2 = *(const pp_header_stats_t**) p2;
+	if (header1->usec != header2->usec)
+		return header1->usec < header2->usec ? 1 : -1;
+	return strcmp(header1->name, header2->name);
+}
+
+static int compare_macro_symbol(const void *p1, const void *p2)
+{
+	const pp_macro_stats_t *macro1 = *(const pp_macro_stats_t**) p1;
+	const pp_macro_stats_t *macro2 = *(const pp_macro_stats_t**) p2;
+	return strcmp(macro1->symbol->string, macro2->symbol->string);
+}
+
+static int compare_macro_tokens(const void *p1, const void *p2)
+{
+	const pp_macro_stats_t *macro1 = *(const pp_macro_stats_t**) p1;
+	const pp_macro_stats_t *macro2 = *(const pp_macro_stats_t**) p2;
+	if (macro1->n_tokens != macro2->n_tokens)
+		return macro1->n_tokens < macro2->n_tokens ? 1 : -1;
+	if (macro1->n_expansions != macro2->n_expansions)
+		return macro1->n_expansions < macro2->n_expansions ? 1 : -1;
+	return strcmp(macro1->symbol->string, macro2->symbol->string);
+}
+
+/**
+ * Merges the statistics of the definitions of the same macro (a macro may
+ * be undefined and defined again) and returns the number of macros left.
+ */
+static size_t merge_macros(void)
+{
+	size_t n_macros = ARR_LEN(macros);
+	if (n_macros == 0)
+		return 0;
+
+	qsort(macros, n_macros, sizeof(macros[0]), compare_macro_symbol);
+	size_t n_merged = 1;
+	for (size_t i = 1; i < n_macros; ++i) {
+		pp_macro_stats_t *last  = macros[n_merged - 1];
+		pp_macro_stats_t *macro = macros[i];
+		if (macro->symbol == last->symbol) {
+			last->n_expansions += macro->n_expansions;
+			last->n_tokens     += macro->n_tokens;
+		} else {
+			macros[n_merged++] = macro;
+		}
+	}
+	qsort(macros, n_merged, sizeof(macros[0]), compare_macro_tokens);
+	return n_merged;
+}
+
+static void print_json_string(FILE *out, const char *string)
+{
+	fputc('"', out);
+	for (const char *c = string; *c != '\0'; ++c) {
+		unsigned char ch = (unsigned char) *c;
+		if (ch == '"' || ch == '\\') {
+			fputc('\\', out);
+			fputc(ch, out);
+		} else if (ch < 0x20) {
+			fprintf(out, "\\u%04x", ch);
+		} else {
+			fputc(ch, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void print_text(FILE *out, size_t n_headers, size_t n_macros)
+{
+	fprintf(out, "preprocessor statistics of '%s'\n", unit_name);
+
+	fprintf(out, "\nheaders:\n%8s %8s %10s %10s %10s  %s\n", "included",
+	        "skipped", "bytes", "tokens", "msec", "name");
+	for (size_t i = 0; i < n_headers; ++i) {
+		const pp_header_stats_t *header = headers[i];
+		fprintf(out, "%8u %8u %10lu %10lu %10.3f  %s\n", header->n_included,
+		        header->n_skipped, header->n_bytes, header->n_tokens,
+		        header->usec / 1000.0, header->name);
+	}
+
+	fprintf(out, "\nmacros:\n%10s %10s  %s\n", "expansions", "tokens", "name");
+	for (size_t i = 0; i < n_macros; ++i) {
+		const pp_macro_stats_t *macro = macros[i];
+		fprintf(out, "%10lu %10lu  %s\n", macro->n_expansions, macro->n_tokens,
+		        macro->symbol->string);
+	}
+
+	fprintf(out, "\ninclude tree:\n");
+	for (size_t i = 0; i < ARR_LEN(include_tree); ++i) {
+		const include_event_t *event = &include_tree[i];
+		for (unsigned d = 0; d < event->depth; ++d) {
+			fputc('.', out);
+		}
+		fprintf(out, "%s%s%s\n", event->depth > 0 ? " " : "",
+		        event->header->name, event->skipped ? " (skipped)" : "");
+	}
+}
+
+static void print_json(FILE *out, size_t n_headers, size_t n_macros)
+{
+	fprintf(out, "{\n  \"file\": ");
+	print_json_string(out, unit_name);
+
+	fprintf(out, ",\n  \"headers\": [");
+	for (size_t i = 0; i < n_headers; ++i) {
+		const pp_header_stats_t *header = headers[i];
+		fprintf(out, "%s\n    { \"name\": ", i > 0 ? "," : "");
+		print_json_string(out, header->name);
+		fprintf(out, ", \"included\": %u, \"skipped\": %u, \"bytes\": %lu, \"tokens\": %lu, \"msec\": %.3f }",
+		        header->n_included, header->n_skipped, header->n_bytes,
+		        header->n_tokens, header->usec / 1000.0);
+	}
+
+	fprintf(out, "\n  ],\n  \"macros\": [");
+	for (size_t i = 0; i < n_macros; ++i) {
+		const pp_macro_stats_t *macro = macros[i];
+		fprintf(out, "%s\n    { \"name\": ", i > 0 ? "," : "");
+		print_json_string(out, macro->symbol->string);
+		fprintf(out, ", \"expansions\": %lu, \"tokens\": %lu }",
+		        macro->n_expansions, macro->n_tokens);
+	}
+
+	fprintf(out, "\n  ],\n  \"include_tree\": [");
+	for (size_t i = 0; i < ARR_LEN(include_tree); ++i) {
+		const include_event_t *event = &include_tree[i];
+		fprintf(out, "%s\n    { \"depth\": %u, \"name\": ", i > 0 ? "," : "",
+		        event->depth);
+		print_json_string(out, event->header->name);
+		fprintf(out, ", \"skipped\": %s }", event->skipped ? "true" : "false");
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
+
+void pp_stats_print(FILE *out)
+{
+	size_t n_headers = ARR_LEN(headers);
+	qsort(headers, n_headers, sizeof(headers[0]), compare_header_time);
+	size_t n_macros = merge_macros();
+
+	if (pp_stats_format == PP_STATS_JSON) {
+		print_json(out, n_headers, n_macros);
+	} else {
+		print_text(out, n_headers, n_macros);
+	}
+
+	ARR_SHRINKLEN(headers, 0);
+	ARR_SHRINKLEN(macros, 0);
+	ARR_SHRINKLEN(include_tree, 0);
+	obstack_free(&stats_obst, NULL);
+	obstack_init(&stats_obst);
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PP_STATS_H
+#define PP_STATS_H
+
+#include <stdio.h>
+
+#include "symbol.h"
+
+/**
+ * Statistics about the cost of headers and macros, reported for each
+ * translation unit (--pp-stats).
+ */
+typedef enum pp_stats_format_t {
+	PP_STATS_NONE,  /**< no statistics are collected */
+	PP_STATS_TEXT,
+	PP_STATS_JSON
+} pp_stats_format_t;
+
+extern pp_stats_format_t pp_stats_format;
+
+/** Statistics of a header (or the main file) in the current unit. */
+typedef struct pp_header_stats_t pp_header_stats_t;
+struct pp_header_stats_t {
+	const char    *name;        /**< name the header was first read with */
+	unsigned       n_included;  /**< number of times it was read */
+	unsigned       n_skipped;   /**< number of includes skipped because of
+	                                 an include guard or #pragma once */
+	unsigned long  n_bytes;     /**< bytes read */
+	unsigned long  n_tokens;    /**< preprocessing tokens read */
+	unsigned long  usec;        /**< time spent inside, including nested
+	                                 headers */
+	unsigned       active;      /**< inclusions currently being read */
+	unsigned long  enter_usec;  /**< start of the outermost active one */
+};
+
+/** Statistics of a macro definition in the current unit. */
+typedef struct pp_macro_stats_t pp_macro_stats_t;
+struct pp_macro_stats_t {
+	symbol_t      *symbol;
+	unsigned long  n_expansions;
+	unsigned long  n_tokens;     /**< tokens of the replacement lists */
+};
+
+void init_pp_stats(void);
+void exit_pp_stats(void);
+
+/**
+ * Starts collecting the statistics of a translation unit.
+ */
+void pp_stats_begin_unit(const char *input_name);
+
+pp_header_stats_t *pp_stats_new_header(const char *name);
+pp_macro_stats_t  *pp_stats_new_macro(symbol_t *symbol);
+
+/**
+ * Records that a header starts being read at the given include depth.
+ */
+void pp_stats_enter_header(pp_header_stats_t *header, unsigned depth);
+
+/**
+ * Records that a header has been read completely.
+ */
+void pp_stats_leave_header(pp_header_stats_t *header);
+
+/**
+ * Records that the include of a header was skipped without opening it.
+ */
+void pp_stats_skip_header(pp_header_stats_t *header, unsigned depth);
+
+/**
+ * Prints the report of the current translation unit and releases its
+ * statistics.
+ */
+void pp_stats_print(FILE *out);
+
+#endif
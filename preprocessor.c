@@ -1,43 +1,125 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
 #include <config.h>
 
+#define _GNU_SOURCE
+
+#include "preprocessor.h"
 #include "token_t.h"
 #include "symbol_t.h"
+#include "lexer.h"
 #include "adt/util.h"
 #include "adt/error.h"
+#include "adt/array.h"
+#include "adt/xmalloc.h"
+#include "adt/strutil.h"
+#include "adt/hash_string.h"
 #include "lang_features.h"
 #include "diagnostic.h"
 #include "string_rep.h"
+#include "warning.h"
+#include "driver/firm_timing.h"
+#include "include_cache.h"
+#include "pp_stats.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#define HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 //#define DEBUG_CHARS
 #define MAX_PUTBACK 3
+#define BUF_SIZE    16384
 #define INCLUDE_LIMIT 199  /* 199 is for gcc "compatibility" */
 
+typedef struct searchpath_entry_t searchpath_entry_t;
+struct searchpath_entry_t {
+	const char         *path;
+	bool                is_system_dir;
+	include_dir_t      *directory;
+	searchpath_entry_t *next;
+};
+
+typedef struct pp_argument_t pp_argument_t;
 struct pp_argument_t {
 	size_t   list_len;
 	token_t *token_list;
+	bool     is_expanded;    /**< the expanded list has been created */
+	size_t   expanded_begin; /**< start of the fully macro expanded list in
+	                              the expanded tokens of the invocation */
+	size_t   expanded_len;
 };
 
 struct pp_definition_t {
 	symbol_t          *symbol;
 	source_position_t  source_position;
-	pp_definition_t   *parent_expansion;
-	size_t             expand_pos;
-	bool               is_variadic    : 1;
-	bool               is_expanding   : 1;
-	bool               has_parameters : 1;
+	bool               is_variadic       : 1;
+	bool               is_expanding      : 1;
+	bool               has_parameters    : 1;
+	bool               has_concatenation : 1; /**< replacement list contains ## */
 	size_t             n_parameters;
-	symbol_t          *parameters;
+	symbol_t         **parameters;
 
 	/* replacement */
 	size_t             list_len;
 	token_t           *token_list;
 
+	pp_macro_stats_t  *stats;      /**< statistics for --pp-stats */
+	unsigned           stats_unit; /**< the translation unit of stats */
+};
+
+/**
+ * A macro invocation (or a macro argument being expanded) whose tokens are
+ * currently read. Finished states are kept in a pool and reused together
+ * with their buffers, so expanding a macro usually allocates no memory.
+ */
+typedef struct pp_expansion_state_t pp_expansion_state_t;
+struct pp_expansion_state_t {
+	pp_definition_t      *definition; /**< NULL marks the end of a macro argument */
+	const token_t        *tokens;
+	size_t                n_tokens;
+	size_t                pos;
+	source_position_t     position;   /**< position of the invocation */
+	bool                  space_before; /**< whitespace precedes the invocation */
+	pp_expansion_state_t *parent;     /**< next free state when in the pool */
+
+	/* buffers of a function-like macro invocation or a macro with ## */
+	token_t              *buffer;          /**< ARR_F, the substituted tokens */
+	token_t              *argument_tokens; /**< ARR_F, tokens of all arguments */
+	pp_argument_t        *arguments;       /**< ARR_F */
+	token_t              *expanded_tokens; /**< ARR_F, the expanded arguments */
 };
 
 typedef struct pp_conditional_t pp_conditional_t;
@@ -49,80 +131,339 @@ struct pp_conditional_t {
 	pp_conditional_t  *parent;
 };
 
+/**
+ * A file read by the preprocessor. Files are identified by device and inode,
+ * so a header is recognized under any name it is included with.
+ */
+typedef struct pp_file_t pp_file_t;
+struct pp_file_t {
+	dev_t              dev;
+	ino_t              ino;
+	unsigned           unit;  /**< the translation unit the fields below
+	                               are about */
+	bool               once;  /**< contains #pragma once */
+	symbol_t          *guard; /**< the include guard macro, NULL if
+	                               unguarded */
+	pp_header_stats_t *stats; /**< statistics for --pp-stats */
+};
+
+/**
+ * States of the include guard detection: a file is guarded if everything but
+ * whitespace and comments is inside one #ifndef.
+ */
+typedef enum guard_state_t {
+	GUARD_AT_START,  /**< nothing read yet */
+	GUARD_INSIDE,    /**< inside the #ifndef of the guard */
+	GUARD_AFTER,     /**< after the #endif of the guard */
+	GUARD_NONE       /**< not guarded */
+} guard_state_t;
+
 typedef struct pp_input_t pp_input_t;
 struct pp_input_t {
-	FILE              *file;
-	int                c;
-	char               buf[1024+MAX_PUTBACK];
-	const char        *bufend;
-	const char        *bufpos;
-	source_position_t  position;
-	bool               had_non_space;
-	pp_input_t        *parent;
+	FILE               *file;      /**< NULL for inputs read from memory */
+	int                 c;
+	char               *buf;       /**< input buffer, when reading blocks from
+	                                    file the first MAX_PUTBACK bytes are
+	                                    reserved for put_back() */
+	size_t              map_size;  /**< size of the mapping if buf is the
+	                                    whole mmap()ed file, 0 otherwise */
+	bool                free_buf;  /**< buf is owned by this input */
+	const char         *bufend;
+	const char         *bufpos;
+	uint32_t            loc_base;  /**< location of buf[0], see
+	                                    current_position() */
+	presumed_position_t position;  /**< presumed name and line of CC */
+	const char         *filename;  /**< name the file was opened with */
+	searchpath_entry_t *path;      /**< searchpath entry the file was found in */
+	pp_file_t          *file_info; /**< NULL for inputs read from memory */
+	pp_header_stats_t  *stats;     /**< NULL if no statistics are collected */
+	guard_state_t       guard_state;
+	symbol_t           *guard;     /**< include guard candidate */
+	pp_conditional_t   *guard_conditional; /**< the #ifndef of guard */
+	pp_conditional_t   *conditional_stack; /**< conditionals of the parent */
+	bool                close_file;
+	pp_input_t         *parent;
 };
 
-pp_input_t input;
+static pp_input_t      input;
 #define CC input.c
 
 static pp_input_t     *input_stack;
 static unsigned        n_inputs;
 static struct obstack  input_obstack;
 
+/** the contents of a file read by #embed, kept until the end of the unit */
+typedef struct pp_embedded_t pp_embedded_t;
+struct pp_embedded_t {
+	char          *data;
+	size_t         size;
+	bool           mapped; /**< data is mmap()ed, malloc()ed otherwise */
+	pp_embedded_t *next;
+};
+
+static pp_embedded_t *embedded_files;
+static token_t        embed_token; /**< pending token of an #embed */
+
+/** the files read so far, identified by device and inode */
+#define HashSet                    pp_fileset_t
+#define HashSetIterator            pp_fileset_iterator_t
+#define HashSetEntry               pp_fileset_entry_t
+#define ValueType                  pp_file_t*
+#define NullValue                  NULL
+#define DeletedValue               ((pp_file_t*)-1)
+#define KeyType                    const struct stat*
+#define ConstKeyType               const struct stat*
+#define GetKey(value)              (value)
+#define InitData(this,value,key)   ((void)((value) = init_pp_file((key))))
+#define Hash(this, key)            ((unsigned) (key)->st_ino ^ (unsigned) (key)->st_dev * 0x9E3779B1U)
+#define KeysEqual(this,key1,key2)  ((key1)->ino == (key2)->st_ino && (key1)->dev == (key2)->st_dev)
+#define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(pp_fileset_entry_t))
+#define SCALAR_RETURN
+
+#define hashset_init            _pp_fileset_init
+#define hashset_init_size       _pp_fileset_init_size
+#define hashset_destroy         _pp_fileset_destroy
+#define hashset_insert          _pp_fileset_insert
+#define hashset_remove          _pp_fileset_remove
+#define hashset_find            _pp_fileset_find
+#define hashset_size            _pp_fileset_size
+#define hashset_iterator_init   _pp_fileset_iterator_init
+#define hashset_iterator_next   _pp_fileset_iterator_next
+#define hashset_remove_iterator _pp_fileset_remove_iterator
+
+#include "adt/hashset.h"
+
+typedef struct pp_fileset_t          pp_fileset_t;
+typedef struct pp_fileset_iterator_t pp_fileset_iterator_t;
+
+static pp_file_t *init_pp_file(const struct stat *st);
+
+#include "adt/hashset.c"
+
+static pp_fileset_t    pp_files;
+static unsigned        current_unit;
+
+/* the search path: -iquote, -I and system directories in this order */
+static searchpath_entry_t  *searchpath;
+static searchpath_entry_t **quote_searchpath_anchor  = &searchpath;
+static searchpath_entry_t **user_searchpath_anchor   = &searchpath;
+static searchpath_entry_t **system_searchpath_anchor = &searchpath;
+
 static pp_conditional_t *conditional_stack;
 
-token_t                   pp_token;
-static bool               resolve_escape_sequences = false;
-static bool               do_print_spaces          = true;
-static bool               do_expansions;
+static pp_expansion_state_t *expansion_stack;
+static pp_expansion_state_t *free_expansion_states;
+static struct obstack        expansion_obstack;
+static char                 *expansion_obstack_start;
+
+static struct obstack     builtin_defines;
+static struct obstack     user_defines;
+
+static token_t            pp_token;
+static bool               do_print_spaces = true;
+static bool               do_expansions   = true;
 static bool               skip_mode;
+static bool               in_pp_directive;
+static bool               at_line_begin;
+static unsigned           pending_newlines;
+static bool               pending_space;
+static unsigned           counter;
 static FILE              *out;
 static struct obstack     pp_obstack;
 static unsigned           counted_newlines;
 static unsigned           counted_spaces;
+static bool               line_has_output;
+static int                last_output_type;
 static const char        *printed_input_name = NULL;
-static pp_definition_t   *current_expansion  = NULL;
+static symbol_t          *symbol_va_args;
 
 static inline void next_char(void);
 static void next_preprocessing_token(void);
-static void print_line_directive(const source_position_t *pos, const char *add);
+static void print_line_marker(const presumed_position_t *pos, const char *add);
 
-static bool open_input(const char *filename)
+static pp_file_t *init_pp_file(const struct stat *st)
 {
-	FILE *file = fopen(filename, "r");
+	pp_file_t *file = obstack_alloc(&input_obstack, sizeof(*file));
+	memset(file, 0, sizeof(*file));
+	file->dev = st->st_dev;
+	file->ino = st->st_ino;
+	return file;
+}
+
+/**
+ * Returns the file with the given status, NULL if the file system has no
+ * inode numbers to identify files.
+ */
+static pp_file_t *get_pp_file(const struct stat *st)
+{
+	if (st->st_ino == 0)
+		return NULL;
+
+	pp_file_t *file = _pp_fileset_insert(&pp_files, st);
+	if (file->unit != current_unit) {
+		/* what we know is about another translation unit */
+		file->unit  = current_unit;
+		file->once  = false;
+		file->guard = NULL;
+		file->stats = NULL;
+	}
+	return file;
+}
+
+/**
+ * Returns true if including a file again has no effect because of a
+ * #pragma once or because its include guard macro is still defined.
+ */
+static bool is_include_skipped(const pp_file_t *file)
+{
+	if (file->once)
+		return true;
+	return file->guard != NULL && file->guard->pp_definition != NULL;
+}
+
+/**
+ * Returns the statistics of a file, NULL if none are collected.
+ */
+static pp_header_stats_t *get_header_stats(pp_file_t *file, const char *name)
+{
+	if (pp_stats_format == PP_STATS_NONE)
+		return NULL;
 	if (file == NULL)
+		return pp_stats_new_header(name);
+	if (file->stats == NULL)
+		file->stats = pp_stats_new_header(name);
+	return file->stats;
+}
+
+/**
+ * Starts collecting the statistics of the file input just opened.
+ */
+static void begin_header_stats(void)
+{
+	input.stats = get_header_stats(input.file_info, input.filename);
+	if (input.stats == NULL)
+		return;
+	/* a mapped file is read as a whole */
+	input.stats->n_bytes += input.map_size;
+	pp_stats_enter_header(input.stats, n_inputs);
+}
+
+/**
+ * Remembers the include guard of the current input at its end.
+ */
+static void record_include_guard(void)
+{
+	if (input.file_info != NULL) {
+		input.file_info->guard
+			= input.guard_state == GUARD_AFTER ? input.guard : NULL;
+	}
+}
+
+#ifdef HAVE_MMAP
+/**
+ * Maps a regular file as a whole so it can be lexed in place without
+ * copying it through the input buffer.
+ */
+static bool map_file_input(FILE *file)
+{
+	/* pipes, terminals and fmemopen() streams are read with fread(), as are
+	 * streams somebody already started reading from */
+	int         fd = fileno(file);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+			|| st.st_size <= 0 || (off_t) (size_t) st.st_size != st.st_size
+			|| ftell(file) != 0)
+		return false;
+
+	/* the mapping is private and writable because put_back() may store a
+	 * different character than the one read (after a trigraph), the few
+	 * touched pages are copied on write and never reach the file */
+	size_t size = (size_t) st.st_size;
+	void  *map  = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
 		return false;
 
+	input.buf      = map;
+	input.bufpos   = input.buf;
+	input.bufend   = input.buf + size;
+	input.map_size = size;
+	return true;
+}
+#endif
+
+static void open_file_input(FILE *file, const char *filename,
+                            searchpath_entry_t *path)
+{
+	memset(&input, 0, sizeof(input));
 	input.file                = file;
-	input.bufend              = NULL;
-	input.bufpos              = NULL;
-	input.had_non_space       = false;
+	input.filename            = filename;
+	input.path                = path;
+	input.conditional_stack   = conditional_stack;
 	input.position.input_name = filename;
 	input.position.linenr     = 1;
 
-	/* indicate that we're at a new input */
-	print_line_directive(&input.position, input_stack != NULL ? "1" : NULL);
+#ifdef HAVE_MMAP
+	if (!map_file_input(file))
+#endif
+	{
+		input.buf      = XMALLOCN(char, BUF_SIZE + MAX_PUTBACK);
+		input.bufpos   = input.buf + MAX_PUTBACK;
+		input.bufend   = input.bufpos;
+		input.free_buf = true;
+	}
+}
 
-	counted_newlines = 0;
-	counted_spaces   = 0;
+/**
+ * Reads from a buffer in memory. The text is lexed in place and must stay
+ * alive and writable (see put_back()) until the input is closed.
+ */
+static void open_buffer_input(char *text, size_t len, const char *input_name)
+{
+	memset(&input, 0, sizeof(input));
+	input.buf                 = text;
+	input.bufpos              = text;
+	input.bufend              = text + len;
+	input.filename            = input_name;
+	input.conditional_stack   = conditional_stack;
+	input.position.input_name = input_name;
+	input.position.linenr     = 1;
+}
 
-	/* read first char and first token */
-	next_char();
-	next_preprocessing_token();
+static void check_unclosed_conditionals(void)
+{
+	while (conditional_stack != input.conditional_stack) {
+		pp_conditional_t *conditional = conditional_stack;
 
-	return true;
+		if (conditional->in_else) {
+			errorf(&conditional->source_position, "unterminated #else");
+		} else {
+			errorf(&conditional->source_position, "unterminated condition");
+		}
+		conditional_stack = conditional->parent;
+		free(conditional);
+	}
+	/* an input is only entered when not skipping */
+	skip_mode = false;
 }
 
 static void close_input(void)
 {
-	/* ensure we have a newline at EOF */
-	if (input.had_non_space) {
-		fputc('\n', out);
-	}
-
-	assert(input.file != NULL);
+	check_unclosed_conditionals();
 
-	fclose(input.file);
+	if (input.close_file) {
+		fclose(input.file);
+		timer_trace_end();
+	}
+	if (input.stats != NULL)
+		pp_stats_leave_header(input.stats);
+#ifdef HAVE_MMAP
+	if (input.map_size > 0)
+		munmap(input.buf, input.map_size);
+#endif
+	if (input.free_buf)
+		free(input.buf);
 	input.file   = NULL;
+	input.buf    = NULL;
 	input.bufend = NULL;
 	input.bufpos = NULL;
 	input.c      = EOF;
@@ -130,17 +471,9 @@ static void close_input(void)
 
 static void push_input(void)
 {
-	pp_input_t *saved_input
-		= obstack_alloc(&input_obstack, sizeof(*saved_input));
-
+	pp_input_t *saved_input = XMALLOC(pp_input_t);
 	memcpy(saved_input, &input, sizeof(*saved_input));
 
-	/* adjust buffer positions */
-	if (input.bufpos != NULL)
-		saved_input->bufpos = saved_input->buf + (input.bufpos - input.buf);
-	if (input.bufend != NULL)
-		saved_input->bufend = saved_input->buf + (input.bufend - input.buf);
-
 	saved_input->parent = input_stack;
 	input_stack         = saved_input;
 	++n_inputs;
@@ -156,14 +489,8 @@ static void pop_restore_input(void)
 	memcpy(&input, saved_input, sizeof(input));
 	input.parent = NULL;
 
-	/* adjust buffer positions */
-	if (saved_input->bufpos != NULL)
-		input.bufpos = input.buf + (saved_input->bufpos - saved_input->buf);
-	if (saved_input->bufend != NULL)
-		input.bufend = input.buf + (saved_input->bufend - saved_input->buf);
-
 	input_stack = saved_input->parent;
-	obstack_free(&input_obstack, saved_input);
+	free(saved_input);
 	--n_inputs;
 }
 
@@ -181,16 +508,62 @@ static inline void next_real_char(void)
 {
 	assert(input.bufpos <= input.bufend);
 	if (input.bufpos >= input.bufend) {
-		size_t s = fread(input.buf + MAX_PUTBACK, 1,
-		                 sizeof(input.buf) - MAX_PUTBACK, input.file);
+		/* memory inputs and mapped files are complete */
+		if (input.file == NULL || input.map_size > 0) {
+			CC = EOF;
+			return;
+		}
+		size_t s = fread(input.buf + MAX_PUTBACK, 1, BUF_SIZE, input.file);
 		if (s == 0) {
 			CC = EOF;
 			return;
 		}
-		input.bufpos = input.buf + MAX_PUTBACK;
-		input.bufend = input.buf + MAX_PUTBACK + s;
+		if (input.stats != NULL)
+			input.stats->n_bytes += s;
+		/* the first byte read continues the locations of the last block */
+		uint32_t last_loc
+			= input.loc_base + (uint32_t) (input.bufend - input.buf) - 1;
+		source_locations_check(last_loc, s);
+		input.loc_base += (uint32_t) (input.bufend - input.buf) - MAX_PUTBACK;
+		input.bufpos    = input.buf + MAX_PUTBACK;
+		input.bufend    = input.buf + MAX_PUTBACK + s;
 	}
-	CC = *input.bufpos++;
+	CC = (unsigned char) *input.bufpos++;
+}
+
+/**
+ * Returns the position of the current character.
+ */
+static inline source_position_t current_position(void)
+{
+	source_position_t position;
+	position.loc = input.loc_base + (uint32_t) (input.bufpos - input.buf) - 1;
+	return position;
+}
+
+/**
+ * Starts a new segment of source locations for the current input. The
+ * character at first gets the first location of the segment.
+ *
+ * @param last_loc  the last location used by the previous segment
+ */
+static void begin_position_segment(const char *first, uint32_t last_loc)
+{
+	uint32_t base  = source_segment_begin(input.position.input_name,
+	                                      input.position.linenr, last_loc);
+	/* the rest of the buffer (all of a mapped file) follows first */
+	if (first < input.bufend)
+		source_locations_check(base, (size_t) (input.bufend - first) - 1);
+	input.loc_base = base - (uint32_t) (first - input.buf);
+}
+
+/**
+ * Counts a newline, the current character starts the next line.
+ */
+static inline void new_line(void)
+{
+	++input.position.linenr;
+	source_line_begin(current_position().loc);
 }
 
 /**
@@ -200,8 +573,14 @@ static inline void next_real_char(void)
  */
 static inline void put_back(int pc)
 {
+	/* nothing to put back at the end of the input, we will read EOF again */
+	if (pc == EOF)
+		return;
+
 	assert(input.bufpos > input.buf);
-	*(--input.bufpos - input.buf + input.buf) = (char) pc;
+	char *bufpos = input.buf + (input.bufpos - input.buf) - 1;
+	*bufpos      = (char) pc;
+	input.bufpos = bufpos;
 
 #ifdef DEBUG_CHARS
 	printf("putback '%c'\n", pc);
@@ -211,14 +590,14 @@ static inline void put_back(int pc)
 #define MATCH_NEWLINE(code)                   \
 	case '\r':                                \
 		next_char();                          \
-		if(CC == '\n') {                      \
+		if (CC == '\n') {                     \
 			next_char();                      \
 		}                                     \
-		++input.position.linenr;              \
+		new_line();                           \
 		code                                  \
 	case '\n':                                \
 		next_char();                          \
-		++input.position.linenr;              \
+		new_line();                           \
 		code
 
 #define eat(c_type)  do { assert(CC == c_type); next_char(); } while(0)
@@ -247,16 +626,16 @@ static inline void next_char(void)
 	next_real_char();
 
 	/* filter trigraphs and concatenated lines */
-	if(UNLIKELY(CC == '\\')) {
+	if (UNLIKELY(CC == '\\')) {
 		maybe_concat_lines();
 		goto end_of_next_char;
 	}
 
-	if(LIKELY(CC != '?'))
+	if (LIKELY(CC != '?'))
 		goto end_of_next_char;
 
 	next_real_char();
-	if(LIKELY(CC != '?')) {
+	if (LIKELY(CC != '?')) {
 		put_back(CC);
 		CC = '?';
 		goto end_of_next_char;
@@ -286,8 +665,6 @@ end_of_next_char:;
 #endif
 }
 
-
-
 /**
  * Returns true if the given char is a octal digit.
  *
@@ -345,70 +722,38 @@ static int digit_value(int digit)
 }
 
 /**
- * Parses an octal character sequence.
+ * Resolves an escape sequence in the spelling of a string literal or
+ * character constant.
  *
- * @param first_digit  the already read first digit
- */
-static int parse_octal_sequence(const int first_digit)
-{
-	assert(is_octal_digit(first_digit));
-	int value = digit_value(first_digit);
-	if (!is_octal_digit(CC)) return value;
-	value = 8 * value + digit_value(CC);
-	next_char();
-	if (!is_octal_digit(CC)) return value;
-	value = 8 * value + digit_value(CC);
-	next_char();
-
-	if(char_is_signed) {
-		return (signed char) value;
-	} else {
-		return (unsigned char) value;
-	}
-}
-
-/**
- * Parses a hex character sequence.
- */
-static int parse_hex_sequence(void)
-{
-	int value = 0;
-	while(isxdigit(CC)) {
-		value = 16 * value + digit_value(CC);
-		next_char();
-	}
-
-	if(char_is_signed) {
-		return (signed char) value;
-	} else {
-		return (unsigned char) value;
-	}
-}
-
-/**
- * Parse an escape sequence.
+ * @param p    points behind the backslash, is advanced behind the sequence
+ * @param pos  the position for error messages
  */
-static int parse_escape_sequence(void)
+static utf32 resolve_escape_sequence(const char **p,
+                                     const source_position_t *pos)
 {
-	eat('\\');
-
-	int ec = CC;
-	next_char();
-
-	switch(ec) {
-	case '"':  return '"';
-	case '\'': return '\'';
-	case '\\': return '\\';
-	case '?': return '\?';
-	case 'a': return '\a';
-	case 'b': return '\b';
-	case 'f': return '\f';
-	case 'n': return '\n';
-	case 'r': return '\r';
-	case 't': return '\t';
-	case 'v': return '\v';
+	const char *s  = *p;
+	int         ec = (unsigned char) *s++;
+
+	utf32 value;
+	switch (ec) {
+	case '"':  value = '"';  break;
+	case '\'': value = '\''; break;
+	case '\\': value = '\\'; break;
+	case '?':  value = '\?'; break;
+	case 'a':  value = '\a'; break;
+	case 'b':  value = '\b'; break;
+	case 'f':  value = '\f'; break;
+	case 'n':  value = '\n'; break;
+	case 'r':  value = '\r'; break;
+	case 't':  value = '\t'; break;
+	case 'v':  value = '\v'; break;
 	case 'x':
-		return parse_hex_sequence();
+		value = 0;
+		while (isxdigit((unsigned char) *s)) {
+			value = 16 * value + digit_value(*s);
+			++s;
+		}
+		break;
 	case '0':
 	case '1':
 	case '2':
@@ -417,166 +762,196 @@ static int parse_escape_sequence(void)
 	case '5':
 	case '6':
 	case '7':
-		return parse_octal_sequence(ec);
-	case EOF:
-		parse_error("reached end of file while parsing escape sequence");
-		return EOF;
+		value = digit_value(ec);
+		if (is_octal_digit(*s)) {
+			value = 8 * value + digit_value(*s++);
+			if (is_octal_digit(*s))
+				value = 8 * value + digit_value(*s++);
+		}
+		break;
+	/* \E is not documented, but handled, by GCC.  It is acceptable according
+	 * to §6.11.4, whereas \e is not. */
+	case 'E':
+	case 'e':
+		if (c_mode & _GNUC) {
+			value = 27;   /* hopefully 27 is ALWAYS the code for ESCAPE */
+			break;
+		}
+		goto unknown_escape;
+	case 'u':
+	case 'U':
+		errorf(pos, "universal character parsing not implemented yet");
+		value = 0;
+		break;
 	default:
-		parse_error("unknown escape sequence");
-		return EOF;
+unknown_escape:
+		/* §6.4.4.4:8 footnote 64 */
+		errorf(pos, "unknown escape sequence");
+		value = ec == '\0' ? 0 : (utf32) ec;
+		if (ec == '\0')
+			--s;
+		break;
 	}
-}
-
-static void parse_string_literal(void)
-{
-	const unsigned start_linenr = input.position.linenr;
-
-	eat('"');
-
-	int tc;
-	while(1) {
-		switch(CC) {
-		case '\\':
-			if(resolve_escape_sequences) {
-				tc = parse_escape_sequence();
-				obstack_1grow(&symbol_obstack, (char) tc);
-			} else {
-				obstack_1grow(&symbol_obstack, (char) CC);
-				next_char();
-				obstack_1grow(&symbol_obstack, (char) CC);
-				next_char();
-			}
-			break;
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = pp_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "string has no end");
-			pp_token.type = TP_ERROR;
-			return;
-		}
+	*p = s;
+	return value;
+}
 
-		case '"':
-			next_char();
-			goto end_of_string;
+/*
+ * The scanners below skip runs of characters that next_char() would return
+ * unchanged and that need no further attention by the caller. They look at
+ * the raw input buffer starting at p and return the first position the
+ * caller has to process with next_char() again (which may be end). With SSE2
+ * 16 characters are checked at once.
+ */
 
-		default:
-			obstack_1grow(&symbol_obstack, (char) CC);
-			next_char();
-			break;
-		}
-	}
+#ifdef __SSE2__
+static inline unsigned match_char(__m128i chars, char c)
+{
+	return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+}
 
-end_of_string:
-	/* add finishing 0 to the string */
-	obstack_1grow(&symbol_obstack, '\0');
-	const size_t      size   = (size_t)obstack_object_size(&symbol_obstack);
-	const char *const string = obstack_finish(&symbol_obstack);
+static inline unsigned match_range(__m128i chars, char low, char high)
+{
+	/* non-ASCII characters are negative and never match */
+	__m128i const ge = _mm_cmpgt_epi8(chars, _mm_set1_epi8((char) (low - 1)));
+	__m128i const le = _mm_cmplt_epi8(chars, _mm_set1_epi8((char) (high + 1)));
+	return (unsigned) _mm_movemask_epi8(_mm_and_si128(ge, le));
+}
 
-#if 0 /* TODO hash */
-	/* check if there is already a copy of the string */
-	result = strset_insert(&stringset, string);
-	if(result != string) {
-		obstack_free(&symbol_obstack, string);
+#define SCAN_SSE2(p, end, stop_mask) \
+	for (; (end) - (p) >= 16; (p) += 16) { \
+		__m128i  const chars = _mm_loadu_si128((const __m128i*) (p)); \
+		unsigned const stop  = (stop_mask); \
+		if (stop != 0) \
+			return (p) + __builtin_ctz(stop); \
 	}
 #else
-	const char *const result = string;
+#define SCAN_SSE2(p, end, stop_mask)
 #endif
 
-	pp_token.type          = TP_STRING_LITERAL;
-	pp_token.literal.begin = result;
-	pp_token.literal.size  = size;
+/** Skips spaces and tabs. */
+static const char *skip_blank_run(const char *p, const char *end)
+{
+	SCAN_SSE2(p, end,
+	          ~(match_char(chars, ' ') | match_char(chars, '\t')) & 0xFFFF)
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		++p;
+	}
+	return p;
 }
 
-static void parse_wide_character_constant(void)
+/**
+ * Skips the body of a comment up to a newline or a possible line splice
+ * or trigraph. Multiline comments also stop at '*'.
+ */
+static const char *skip_comment_run(const char *p, const char *end,
+                                    bool multiline)
 {
-	eat('\'');
-
-	int found_char = 0;
-	while(1) {
-		switch(CC) {
-		case '\\':
-			found_char = parse_escape_sequence();
+	SCAN_SSE2(p, end,
+	          match_char(chars, '\n') | match_char(chars, '\r')
+	          | match_char(chars, '\\') | match_char(chars, '?')
+	          | (multiline ? match_char(chars, '*') : 0))
+	for (; p < end; ++p) {
+		char const c = *p;
+		if (c == '\n' || c == '\r' || c == '\\' || c == '?'
+				|| (multiline && c == '*'))
 			break;
+	}
+	return p;
+}
 
-		MATCH_NEWLINE(
-			parse_error("newline while parsing character constant");
+/**
+ * Skips the body of a string literal or character constant up to a quote,
+ * an escape sequence, a newline or a possible trigraph.
+ */
+static const char *skip_literal_run(const char *p, const char *end)
+{
+	SCAN_SSE2(p, end,
+	          match_char(chars, '"') | match_char(chars, '\'')
+	          | match_char(chars, '\n') | match_char(chars, '\r')
+	          | match_char(chars, '\\') | match_char(chars, '?'))
+	for (; p < end; ++p) {
+		char const c = *p;
+		if (c == '"' || c == '\'' || c == '\n' || c == '\r' || c == '\\'
+				|| c == '?')
 			break;
-		)
-
-		case '\'':
-			next_char();
-			goto end_of_wide_char_constant;
-
-		case EOF:
-			parse_error("EOF while parsing character constant");
-			pp_token.type = TP_ERROR;
-			return;
+	}
+	return p;
+}
 
-		default:
-			if(found_char != 0) {
-				parse_error("more than 1 characters in character "
-				            "constant");
-				goto end_of_wide_char_constant;
-			} else {
-				found_char = CC;
-				next_char();
-			}
+/**
+ * Skips the text of a line in a false conditional up to a newline, a possible
+ * comment, literal, line splice or trigraph.
+ */
+static const char *skip_text_run(const char *p, const char *end)
+{
+	SCAN_SSE2(p, end,
+	          match_char(chars, '\n') | match_char(chars, '\r')
+	          | match_char(chars, '/') | match_char(chars, '"')
+	          | match_char(chars, '\'') | match_char(chars, '\\')
+	          | match_char(chars, '?'))
+	for (; p < end; ++p) {
+		char const c = *p;
+		if (c == '\n' || c == '\r' || c == '/' || c == '"' || c == '\''
+				|| c == '\\' || c == '?')
 			break;
-		}
 	}
-
-end_of_wide_char_constant:
-	pp_token.type       = TP_WIDE_CHARACTER_CONSTANT;
-	/* TODO... */
+	return p;
 }
 
-static void parse_character_constant(void)
+/**
+ * Parses a string literal or character constant up to the terminating quote.
+ * Escape sequences are kept unresolved, so the spelling can be reproduced
+ * for stringification, token pasting and textual output.
+ */
+static void parse_quoted(int quote, int type)
 {
-	const unsigned start_linenr = input.position.linenr;
+	const source_position_t start = current_position();
 
-	eat('\'');
+	eat(quote);
 
-	int tc;
-	while(1) {
-		switch(CC) {
+	while (true) {
+		switch (CC) {
 		case '\\':
-			tc = parse_escape_sequence();
-			obstack_1grow(&symbol_obstack, (char) tc);
-			break;
-
-		MATCH_NEWLINE(
-			parse_error("newline while parsing character constant");
+			obstack_1grow(&symbol_obstack, '\\');
+			next_char();
+			if (CC == EOF)
+				break;
+			obstack_1grow(&symbol_obstack, (char) CC);
+			next_char();
 			break;
-		)
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = pp_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "EOF while parsing character constant");
-			pp_token.type = TP_ERROR;
-			return;
-		}
-
-		case '\'':
-			next_char();
-			goto end_of_char_constant;
+		case '\r':
+		case '\n':
+		case EOF:
+			if (!skip_mode) {
+				errorf(&start, quote == '"' ? "string has no end"
+				               : "EOF while parsing character constant");
+			}
+			goto end_of_literal;
 
 		default:
+			if (CC == quote) {
+				next_char();
+				goto end_of_literal;
+			}
 			obstack_1grow(&symbol_obstack, (char) CC);
+			const char *bufpos = input.bufpos;
+			input.bufpos = skip_literal_run(bufpos, input.bufend);
+			obstack_grow(&symbol_obstack, bufpos, input.bufpos - bufpos);
 			next_char();
 			break;
-
 		}
 	}
 
-end_of_char_constant:;
-	const size_t      size   = (size_t)obstack_object_size(&symbol_obstack);
+end_of_literal:
+	/* add finishing 0 to the string */
+	obstack_1grow(&symbol_obstack, '\0');
+	const size_t      size   = (size_t)obstack_object_size(&symbol_obstack) - 1;
 	const char *const string = obstack_finish(&symbol_obstack);
 
-	pp_token.type          = TP_CHARACTER_CONSTANT;
+	pp_token.type          = type;
 	pp_token.literal.begin = string;
 	pp_token.literal.size  = size;
 }
@@ -651,50 +1026,22 @@ end_of_char_constant:;
 	case '8':  \
 	case '9':
 
-/**
- * returns next final token from a preprocessor macro expansion
- */
-static void expand_next(void)
+/** Skips letters, digits and underscores. */
+static const char *skip_symbol_run(const char *p, const char *end)
 {
-	assert(current_expansion != NULL);
-
-	pp_definition_t *definition = current_expansion;
-
-restart:
-	if(definition->list_len == 0
-			|| definition->expand_pos >= definition->list_len) {
-		/* we're finished with the current macro, move up 1 level in the
-		 * expansion stack */
-		pp_definition_t *parent = definition->parent_expansion;
-		definition->parent_expansion = NULL;
-		definition->is_expanding     = false;
-
-		/* it was the outermost expansion, parse normal pptoken */
-		if(parent == NULL) {
-			current_expansion = NULL;
-			next_preprocessing_token();
-			return;
+	SCAN_SSE2(p, end,
+	          ~(match_range(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z')
+	            | match_range(chars, '0', '9') | match_char(chars, '_')) & 0xFFFF)
+	for (; p < end; ++p) {
+		switch (*p) {
+		DIGITS
+		SYMBOL_CHARS
+			continue;
+		default:
+			return p;
 		}
-		definition        = parent;
-		current_expansion = definition;
-		goto restart;
-	}
-	pp_token = definition->token_list[definition->expand_pos];
-	++definition->expand_pos;
-
-	if(pp_token.type != TP_IDENTIFIER)
-		return;
-
-	/* if it was an identifier then we might need to expand again */
-	pp_definition_t *symbol_definition = pp_token.symbol->pp_definition;
-	if(symbol_definition != NULL && !symbol_definition->is_expanding) {
-		symbol_definition->parent_expansion = definition;
-		symbol_definition->expand_pos       = 0;
-		symbol_definition->is_expanding     = true;
-		definition                          = symbol_definition;
-		current_expansion                   = definition;
-		goto restart;
 	}
+	return p;
 }
 
 static void skip_line_comment(void)
@@ -712,6 +1059,7 @@ static void skip_line_comment(void)
 			return;
 
 		default:
+			input.bufpos = skip_comment_run(input.bufpos, input.bufend, false);
 			next_char();
 			break;
 		}
@@ -723,7 +1071,7 @@ static void skip_multiline_comment(void)
 	if(do_print_spaces)
 		counted_spaces++;
 
-	unsigned start_linenr = input.position.linenr;
+	const source_position_t start = current_position();
 	while(1) {
 		switch(CC) {
 		case '/':
@@ -748,73 +1096,81 @@ static void skip_multiline_comment(void)
 			break;
 		)
 
-		case EOF: {
-			source_position_t source_position;
-			source_position.input_name = pp_token.source_position.input_name;
-			source_position.linenr     = start_linenr;
-			errorf(&source_position, "at end of file while looking for comment end");
+		case EOF:
+			errorf(&start, "at end of file while looking for comment end");
 			return;
-		}
 
 		default:
+			input.bufpos = skip_comment_run(input.bufpos, input.bufend, true);
 			next_char();
 			break;
 		}
 	}
 }
 
-/* skip spaces advancing at the start of the next preprocessing token */
-static void skip_spaces(bool skip_newline)
+/**
+ * skip spaces advancing at the start of the next preprocessing token.
+ * Returns true if anything was skipped.
+ */
+static bool skip_spaces(bool skip_newline)
 {
+	bool skipped = false;
 	while (true) {
 		switch (CC) {
 		case ' ':
 		case '\t':
+		case '\f':
+		case '\v':
 			if (do_print_spaces)
 				counted_spaces++;
 			next_char();
+			skipped = true;
 			continue;
 		case '/':
 			next_char();
 			if (CC == '/') {
 				next_char();
 				skip_line_comment();
+				skipped = true;
 				continue;
 			} else if (CC == '*') {
 				next_char();
 				skip_multiline_comment();
+				skipped = true;
 				continue;
 			} else {
 				put_back(CC);
 				CC = '/';
 			}
-			return;
+			return skipped;
 
 		case '\r':
 			if (!skip_newline)
-				return;
+				return skipped;
 
 			next_char();
 			if(CC == '\n') {
 				next_char();
 			}
-			++input.position.linenr;
+			new_line();
 			if (do_print_spaces)
 				++counted_newlines;
+			skipped = true;
 			continue;
 
 		case '\n':
 			if (!skip_newline)
-				return;
+				return skipped;
 
 			next_char();
-			++input.position.linenr;
+			new_line();
 			if (do_print_spaces)
 				++counted_newlines;
+			skipped = true;
 			continue;
 
 		default:
-			return;
+			return skipped;
 		}
 	}
 }
@@ -826,13 +1182,65 @@ static void eat_pp(int type)
 	next_preprocessing_token();
 }
 
+static void set_symbol_token(symbol_t *symbol)
+{
+	/* the C++ alternative tokens ("and", "not_eq", ...) are punctuators */
+	int pp_ID = symbol->pp_ID;
+	if (pp_ID != TP_IDENTIFIER && pp_ID < TP_if) {
+		pp_token.type = pp_ID;
+	} else {
+		pp_token.type = TP_IDENTIFIER;
+	}
+	pp_token.symbol = symbol;
+}
+
+static void parse_wide_literal(void)
+{
+	if (CC == '"') {
+		parse_quoted('"', TP_WIDE_STRING_LITERAL);
+	} else {
+		parse_quoted('\'', TP_WIDE_CHARACTER_CONSTANT);
+	}
+}
+
 static void parse_symbol(void)
 {
-	obstack_1grow(&symbol_obstack, (char) CC);
+	/* symbol characters are never part of a trigraph or line splice, so the
+	 * run of them can be taken from the input buffer in one go (CC is the
+	 * character before bufpos). */
+	const char *start = input.bufpos - 1;
+	assert(*start == (char) CC);
+	const char *end = skip_symbol_run(input.bufpos, input.bufend);
+	input.bufpos = end;
+
+	/* usually the symbol ends inside the buffer and is looked up right there
+	 * without copying it */
+	if (end < input.bufend && *end != '\\' && *end != '?' && *end != '$') {
+		size_t len = (size_t) (end - start);
+		next_char();
+
+		/* might be a wide string or character constant ( L"string"/L'c' ) */
+		if (len == 1 && *start == 'L' && (CC == '"' || CC == '\'')) {
+			parse_wide_literal();
+			return;
+		}
+
+		set_symbol_token(symbol_table_insert_string(start, len,
+		                 hash_string_words(start, len)));
+		return;
+	}
+
+	/* splices, trigraphs, '$' and the end of a block are left to next_char()
+	 * and the loop below */
+	obstack_grow(&symbol_obstack, start, end - start);
 	next_char();
 
 	while(1) {
 		switch(CC) {
+		case '$':
+			if (!allow_dollar_in_symbol)
+				goto end_symbol;
+			/* FALLTHROUGH */
 		DIGITS
 		SYMBOL_CHARS
 			obstack_1grow(&symbol_obstack, (char) CC);
@@ -848,52 +1256,20 @@ end_symbol:
 	obstack_1grow(&symbol_obstack, '\0');
 	char *string = obstack_finish(&symbol_obstack);
 
-	/* might be a wide string or character constant ( L"string"/L'c' ) */
-	if (CC == '"' && string[0] == 'L' && string[1] == '\0') {
-		obstack_free(&symbol_obstack, string);
-		/* TODO */
-		return;
-	} else if (CC == '\'' && string[0] == 'L' && string[1] == '\0') {
+	if (string[0] == 'L' && string[1] == '\0' && (CC == '"' || CC == '\'')) {
 		obstack_free(&symbol_obstack, string);
-		parse_wide_character_constant();
+		parse_wide_literal();
 		return;
 	}
 
 	symbol_t *symbol = symbol_table_insert(string);
-
-	pp_token.type   = symbol->pp_ID;
-	pp_token.symbol = symbol;
+	set_symbol_token(symbol);
 
 	/* we can free the memory from symbol obstack if we already had an entry in
 	 * the symbol table */
 	if (symbol->string != string) {
 		obstack_free(&symbol_obstack, string);
 	}
-	if (!do_expansions)
-		return;
-
-	pp_definition_t *pp_definition = symbol->pp_definition;
-	if (pp_definition == NULL)
-		return;
-
-	if (pp_definition->has_parameters) {
-		skip_spaces(true);
-		/* no opening brace -> no expansion */
-		if (CC != '(')
-			return;
-		next_preprocessing_token();
-		eat_pp('(');
-
-		/* parse arguments (TODO) */
-		while (pp_token.type != TP_EOF && pp_token.type != ')')
-			next_preprocessing_token();
-		next_preprocessing_token();
-	}
-
-	pp_definition->expand_pos   = 0;
-	pp_definition->is_expanding = true,
-	current_expansion           = pp_definition;
-	expand_next();
 }
 
 static void parse_number(void)
@@ -929,7 +1305,7 @@ static void parse_number(void)
 
 end_number:
 	obstack_1grow(&symbol_obstack, '\0');
-	size_t  size   = obstack_object_size(&symbol_obstack);
+	size_t  size   = obstack_object_size(&symbol_obstack) - 1;
 	char   *string = obstack_finish(&symbol_obstack);
 
 	pp_token.type          = TP_NUMBER;
@@ -962,21 +1338,45 @@ end_number:
 			return;                                        \
 		)
 
-static void next_preprocessing_token(void)
+/**
+ * Reads the next preprocessing token from the current input (without any
+ * macro expansion).
+ */
+static void lex_token(void)
 {
-	if(current_expansion != NULL) {
-		expand_next();
+	pp_token.space_before = pending_space;
+	pp_token.no_expand    = false;
+	pending_space         = false;
+	if (UNLIKELY(pending_newlines > 0)) {
+		/* newlines were skipped while looking for the '(' of a function-like
+		 * macro invocation */
+		counted_newlines        += pending_newlines;
+		counted_spaces           = 0;
+		pending_newlines         = 0;
+		pp_token.type            = '\n';
+		pp_token.source_position = current_position();
 		return;
 	}
 
-	pp_token.source_position = input.position;
-
 restart:
+	pp_token.source_position = current_position();
 	switch(CC) {
 	case ' ':
-	case '\t':
+	case '\t': {
+		const char *bufpos = input.bufpos;
+		input.bufpos = skip_blank_run(bufpos, input.bufend);
+		if (do_print_spaces)
+			counted_spaces += 1 + (unsigned) (input.bufpos - bufpos);
+		pp_token.space_before = true;
+		next_char();
+		goto restart;
+	}
+
+	case '\f':
+	case '\v':
 		if (do_print_spaces)
 			counted_spaces++;
+		pp_token.space_before = true;
 		next_char();
 		goto restart;
 
@@ -987,6 +1387,10 @@ restart:
 		return;
 	)
 
+	case '$':
+		if (!allow_dollar_in_symbol)
+			goto unknown_char;
+		/* FALLTHROUGH */
 	SYMBOL_CHARS
 		parse_symbol();
 		return;
@@ -996,25 +1400,16 @@ restart:
 		return;
 
 	case '"':
-		parse_string_literal();
+		parse_quoted('"', TP_STRING_LITERAL);
 		return;
 
 	case '\'':
-		parse_character_constant();
+		parse_quoted('\'', TP_CHARACTER_CONSTANT);
 		return;
 
 	case '.':
 		MAYBE_PROLOG
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
+			DIGITS
 				put_back(CC);
 				CC = '.';
 				parse_number();
@@ -1060,10 +1455,12 @@ restart:
 			case '*':
 				next_char();
 				skip_multiline_comment();
+				pp_token.space_before = true;
 				goto restart;
 			case '/':
 				next_char();
 				skip_line_comment();
+				pp_token.space_before = true;
 				goto restart;
 		ELSE('/')
 	case '%':
@@ -1113,6 +1510,13 @@ restart:
 	case ':':
 		MAYBE_PROLOG
 		MAYBE('>', ']')
+			case ':':
+				if (c_mode & _CXX) {
+					next_char();
+					pp_token.type = TP_COLONCOLON;
+					return;
+				}
+				/* FALLTHROUGH */
 		ELSE(':')
 	case '=':
 		MAYBE_PROLOG
@@ -1140,21 +1544,28 @@ restart:
 
 	case EOF:
 		if (input_stack != NULL) {
+			bool     was_file = input.file != NULL;
+			uint32_t last_loc = current_position().loc;
+			record_include_guard();
 			close_input();
 			pop_restore_input();
-			counted_newlines = 0;
-			counted_spaces   = 0;
+			begin_position_segment(input.bufpos - 1, last_loc);
 			/* hack to output correct line number */
-			print_line_directive(&input.position, "2");
-			next_preprocessing_token();
+			print_line_marker(&input.position, was_file ? "2" : NULL);
+			/* the end of an input always ends a line */
+			pp_token.type = '\n';
 		} else {
 			pp_token.type = TP_EOF;
 		}
 		return;
 
 	default:
+unknown_char:
+		if (!skip_mode) {
+			errorf(&pp_token.source_position, "unknown character '%c' found",
+			       CC);
+		}
 		next_char();
-		errorf(&pp_token.source_position, "unknown character '%c' found\n", CC);
 		pp_token.type = TP_ERROR;
 		return;
 	}
@@ -1187,8 +1598,11 @@ static void print_quoted_string(const char *const string)
 	fputc('"', out);
 }
 
-static void print_line_directive(const source_position_t *pos, const char *add)
+static void print_line_directive(const presumed_position_t *pos, const char *add)
 {
+	if (out == NULL)
+		return;
+
 	fprintf(out, "# %u ", pos->linenr);
 	print_quoted_string(pos->input_name);
 	if (add != NULL) {
@@ -1200,24 +1614,178 @@ static void print_line_directive(const source_position_t *pos, const char *add)
 	printed_input_name = pos->input_name;
 }
 
-static void print_spaces(void)
+/**
+ * Prints a line marker on a line of its own (when producing text output).
+ */
+static void print_line_marker(const presumed_position_t *pos, const char *add)
+{
+	if (out == NULL)
+		return;
+
+	if (line_has_output) {
+		fputc('\n', out);
+		line_has_output = false;
+	}
+	print_line_directive(pos, add);
+	counted_newlines = 0;
+	counted_spaces   = 0;
+}
+
+static void print_newlines(void)
 {
 	if (counted_newlines >= 9) {
-		if (input.had_non_space) {
-			fputc('\n', out);
-		}
-		print_line_directive(&pp_token.source_position, NULL);
-		counted_newlines = 0;
-	} else {
+		presumed_position_t position;
+		get_presumed_position(&pp_token.source_position, &position);
+		print_line_marker(&position, NULL);
+	} else if (counted_newlines > 0) {
 		for (unsigned i = 0; i < counted_newlines; ++i)
 			fputc('\n', out);
 		counted_newlines = 0;
+		line_has_output  = false;
+	}
+}
+
+/**
+ * Returns the first character of the spelling of a token.
+ */
+static int get_first_char(const token_t *token)
+{
+	switch (token->type) {
+	case TP_IDENTIFIER:
+		return (unsigned char) token->symbol->string[0];
+	case TP_NUMBER:
+		return (unsigned char) token->literal.begin[0];
+	case TP_STRING_LITERAL:
+		return '"';
+	case TP_CHARACTER_CONSTANT:
+		return '\'';
+	case TP_WIDE_STRING_LITERAL:
+	case TP_WIDE_CHARACTER_CONSTANT:
+		return 'L';
+	default: {
+		const symbol_t *symbol = get_pp_token_symbol(token);
+		return symbol != NULL ? symbol->string[0] : token->type;
+	}
+	}
+}
+
+/**
+ * Checks whether printing the current token directly behind a token of
+ * type prev_type would form a different token when the output is lexed
+ * again (can happen with tokens from macro expansions: "-EMPTY-").
+ */
+static bool would_paste(int prev_type)
+{
+	int  c           = get_first_char(&pp_token);
+	bool symbol_char = isalnum(c) || c == '_' || c == '$';
+	switch (prev_type) {
+	case TP_IDENTIFIER:
+		return symbol_char || c == '"' || c == '\'';
+	case TP_NUMBER:
+		return symbol_char || c == '.' || c == '+' || c == '-';
+	case '.':
+		return c == '.' || isdigit(c);
+	case '+':
+		return c == '+' || c == '=';
+	case '-':
+		return c == '-' || c == '=' || c == '>';
+	case '<':
+		return c == '<' || c == '=' || c == ':' || c == '%';
+	case '>':
+		return c == '>' || c == '=';
+	case '&':
+		return c == '&' || c == '=';
+	case '|':
+		return c == '|' || c == '=';
+	case ':':
+		return c == ':' || c == '>';
+	case '%':
+		return c == '=' || c == ':' || c == '>';
+	case '/':
+		return c == '=' || c == '/' || c == '*';
+	case '#':
+		return c == '#';
+	case '*':
+	case '=':
+	case '!':
+	case '^':
+	case TP_LESSLESS:
+	case TP_GREATERGREATER:
+		return c == '=';
+	default:
+		return false;
 	}
-	for (unsigned i = 0; i < counted_spaces; ++i)
+}
+
+static void print_spaces(void)
+{
+	print_newlines();
+	if (!line_has_output) {
+		/* keep the indentation of the line */
+		for (unsigned i = 0; i < counted_spaces; ++i)
+			fputc(' ', out);
+	} else if (pp_token.space_before || would_paste(last_output_type)) {
 		fputc(' ', out);
+	}
 	counted_spaces = 0;
 }
 
+/**
+ * Appends the spelling of a token to an obstack. If escape is set, quotes
+ * and backslashes in string literals and character constants are escaped
+ * (as needed for the # operator).
+ */
+static void grow_token_spelling(struct obstack *obst, const token_t *token,
+                                bool escape)
+{
+	char quote;
+	switch (token->type) {
+	case TP_IDENTIFIER: {
+		const char *string = token->symbol->string;
+		obstack_grow(obst, string, strlen(string));
+		return;
+	}
+	case TP_NUMBER:
+		obstack_grow(obst, token->literal.begin, token->literal.size);
+		return;
+	case TP_WIDE_STRING_LITERAL:
+	case TP_WIDE_CHARACTER_CONSTANT:
+		obstack_1grow(obst, 'L');
+		/* FALLTHROUGH */
+	case TP_STRING_LITERAL:
+	case TP_CHARACTER_CONSTANT:
+		quote = token->type == TP_STRING_LITERAL
+		     || token->type == TP_WIDE_STRING_LITERAL ? '"' : '\'';
+		if (escape && quote == '"')
+			obstack_1grow(obst, '\\');
+		obstack_1grow(obst, quote);
+		for (size_t i = 0; i < token->literal.size; ++i) {
+			char c = token->literal.begin[i];
+			if (escape && (c == '"' || c == '\\'))
+				obstack_1grow(obst, '\\');
+			obstack_1grow(obst, c);
+		}
+		if (escape && quote == '"')
+			obstack_1grow(obst, '\\');
+		obstack_1grow(obst, quote);
+		return;
+	case '\n':
+	case TP_EOF:
+	case TP_ERROR:
+		return;
+	default: {
+		const symbol_t *symbol = get_pp_token_symbol(token);
+		if (symbol != NULL) {
+			obstack_grow(obst, symbol->string, strlen(symbol->string));
+		} else {
+			/* stray characters like '\\' */
+			obstack_1grow(obst, (char) token->type);
+		}
+		return;
+	}
+	}
+}
+
 static void emit_pp_token(void)
 {
 	if (skip_mode)
@@ -1225,7 +1793,8 @@ static void emit_pp_token(void)
 
 	if (pp_token.type != '\n') {
 		print_spaces();
-		input.had_non_space = true;
+		line_has_output  = true;
+		last_output_type = pp_token.type;
 	}
 
 	switch(pp_token.type) {
@@ -1235,12 +1804,24 @@ static void emit_pp_token(void)
 	case TP_NUMBER:
 		fputs(pp_token.literal.begin, out);
 		break;
+	case TP_WIDE_STRING_LITERAL:
+		fputc('L', out);
+		/* FALLTHROUGH */
 	case TP_STRING_LITERAL:
 		fputc('"', out);
 		fputs(pp_token.literal.begin, out);
 		fputc('"', out);
 		break;
+	case TP_WIDE_CHARACTER_CONSTANT:
+		fputc('L', out);
+		/* FALLTHROUGH */
+	case TP_CHARACTER_CONSTANT:
+		fputc('\'', out);
+		fputs(pp_token.literal.begin, out);
+		fputc('\'', out);
+		break;
 	case '\n':
+	case TP_ERROR:
 		break;
 	default:
 		print_pp_token_type(out, pp_token.type);
@@ -1255,108 +1836,792 @@ static void eat_pp_directive(void)
 	}
 }
 
-static bool strings_equal(const string_t *string1, const string_t *string2)
+/**
+ * Frees all memory used by macro expansions, may only be called when no
+ * expansion is active.
+ */
+static void free_expansion_memory(void)
 {
-	size_t size = string1->size;
-	if(size != string2->size)
-		return false;
+	assert(expansion_stack == NULL);
+	obstack_free(&expansion_obstack, expansion_obstack_start);
+	expansion_obstack_start = obstack_alloc(&expansion_obstack, 1);
+}
 
-	const char *c1 = string1->begin;
-	const char *c2 = string2->begin;
-	for(size_t i = 0; i < size; ++i, ++c1, ++c2) {
-		if(*c1 != *c2)
-			return false;
+/**
+ * Returns an unused expansion state with empty buffers.
+ */
+static pp_expansion_state_t *alloc_expansion_state(void)
+{
+	pp_expansion_state_t *state = free_expansion_states;
+	if (state == NULL) {
+		state                  = XMALLOCZ(pp_expansion_state_t);
+		state->buffer          = NEW_ARR_F(token_t, 0);
+		state->argument_tokens = NEW_ARR_F(token_t, 0);
+		state->arguments       = NEW_ARR_F(pp_argument_t, 0);
+		state->expanded_tokens = NEW_ARR_F(token_t, 0);
+		return state;
 	}
-	return true;
+	free_expansion_states = state->parent;
+	ARR_SHRINKLEN(state->buffer, 0);
+	ARR_SHRINKLEN(state->argument_tokens, 0);
+	ARR_SHRINKLEN(state->arguments, 0);
+	ARR_SHRINKLEN(state->expanded_tokens, 0);
+	return state;
 }
 
-static bool pp_tokens_equal(const token_t *token1, const token_t *token2)
+static void free_expansion_state(pp_expansion_state_t *state)
 {
-	if(token1->type != token2->type)
-		return false;
+	state->parent         = free_expansion_states;
+	free_expansion_states = state;
+}
 
-	switch(token1->type) {
-	case TP_HEADERNAME:
-		/* TODO */
-		return false;
-	case TP_IDENTIFIER:
-		return token1->symbol == token2->symbol;
-	case TP_NUMBER:
-	case TP_CHARACTER_CONSTANT:
-	case TP_STRING_LITERAL:
-		return strings_equal(&token1->literal, &token2->literal);
+/**
+ * Counts an expansion of a macro into n_tokens tokens for --pp-stats.
+ */
+static void count_expansion(pp_definition_t *definition, size_t n_tokens)
+{
+	if (definition->stats == NULL || definition->stats_unit != current_unit) {
+		definition->stats      = pp_stats_new_macro(definition->symbol);
+		definition->stats_unit = current_unit;
+	}
+	++definition->stats->n_expansions;
+	definition->stats->n_tokens += n_tokens;
+}
 
-	default:
-		return true;
+static void push_expansion(pp_expansion_state_t *state,
+                           pp_definition_t *definition, const token_t *tokens,
+                           size_t n_tokens, const source_position_t *position)
+{
+	state->definition   = definition;
+	state->tokens       = tokens;
+	state->n_tokens     = n_tokens;
+	state->pos          = 0;
+	state->space_before = false;
+	state->parent       = expansion_stack;
+	/* tokens of nested expansions get the position of the outermost
+	 * invocation */
+	if (expansion_stack != NULL && expansion_stack->definition != NULL) {
+		state->position = expansion_stack->position;
+	} else {
+		state->position = *position;
+	}
+	expansion_stack = state;
+
+	if (definition != NULL) {
+		definition->is_expanding = true;
+		if (pp_stats_format != PP_STATS_NONE)
+			count_expansion(definition, n_tokens);
 	}
 }
 
-static bool pp_definitions_equal(const pp_definition_t *definition1,
-                                 const pp_definition_t *definition2)
+static void pop_expansion(void)
 {
-	if(definition1->list_len != definition2->list_len)
-		return false;
+	pp_expansion_state_t *state = expansion_stack;
+	if (state->definition != NULL)
+		state->definition->is_expanding = false;
+	expansion_stack = state->parent;
+	free_expansion_state(state);
+}
 
-	size_t         len = definition1->list_len;
-	const token_t *t1  = definition1->token_list;
-	const token_t *t2  = definition2->token_list;
-	for(size_t i = 0; i < len; ++i, ++t1, ++t2) {
-		if(!pp_tokens_equal(t1, t2))
+/**
+ * Reads the next token without macro expansion, either from the active macro
+ * expansions or from the input. Returns false when the end of a macro
+ * argument is reached.
+ */
+static bool next_raw_token(void)
+{
+	/* the whitespace in front of an invocation goes to the first token of
+	 * the expansion (or the token behind an empty expansion) */
+	bool space_before = false;
+	while (expansion_stack != NULL) {
+		pp_expansion_state_t *state = expansion_stack;
+		if (state->pos == 0)
+			space_before |= state->space_before;
+		if (state->pos < state->n_tokens) {
+			pp_token = state->tokens[state->pos++];
+			if (state->definition != NULL)
+				pp_token.source_position = state->position;
+			pp_token.space_before |= space_before;
+			return true;
+		}
+		if (state->definition == NULL)
 			return false;
+		pop_expansion();
 	}
+
+	lex_token();
+	pp_token.space_before |= space_before;
+	if (input.stats != NULL && pp_token.type != '\n')
+		++input.stats->n_tokens;
 	return true;
 }
 
-static void parse_define_directive(void)
+/**
+ * Checks whether the next token is a '(' without consuming it (needed to
+ * decide whether a function-like macro is invoked).
+ */
+static bool next_is_lparen(void)
 {
-	eat_pp(TP_define);
-	assert(obstack_object_size(&pp_obstack) == 0);
-
-	if (pp_token.type != TP_IDENTIFIER) {
-		errorf(&pp_token.source_position,
-		       "expected identifier after #define, got '%t'", &pp_token);
-		goto error_out;
+	for (pp_expansion_state_t *state = expansion_stack; state != NULL;
+	     state = expansion_stack) {
+		if (state->pos < state->n_tokens)
+			return state->tokens[state->pos].type == '(';
+		if (state->definition == NULL)
+			return false;
+		pop_expansion();
 	}
-	symbol_t *symbol = pp_token.symbol;
-
-	pp_definition_t *new_definition
-		= obstack_alloc(&pp_obstack, sizeof(new_definition[0]));
-	memset(new_definition, 0, sizeof(new_definition[0]));
-	new_definition->source_position = input.position;
 
-	/* this is probably the only place where spaces are significant in the
-	 * lexer (except for the fact that they separate tokens). #define b(x)
-	 * is something else than #define b (x) */
-	if (CC == '(') {
-		/* eat the '(' */
-		next_preprocessing_token();
-		/* get next token after '(' */
-		next_preprocessing_token();
+	if (pending_newlines > 0)
+		return false;
 
-		while (true) {
-			switch (pp_token.type) {
-			case TP_DOTDOTDOT:
-				new_definition->is_variadic = true;
-				next_preprocessing_token();
-				if (pp_token.type != ')') {
-					errorf(&input.position,
-							"'...' not at end of macro argument list");
-					goto error_out;
-				}
-				break;
-			case TP_IDENTIFIER:
-				obstack_ptr_grow(&pp_obstack, pp_token.symbol);
-				next_preprocessing_token();
+	unsigned linenr   = input.position.linenr;
+	unsigned newlines = counted_newlines;
+	unsigned spaces   = counted_spaces;
+	bool     skipped  = skip_spaces(!in_pp_directive);
+	if (CC == '(')
+		return true;
 
-				if (pp_token.type == ',') {
-					next_preprocessing_token();
-					break;
-				}
+	/* we looked beyond the end of the line, remember that we still have
+	 * to report the newlines */
+	pending_newlines = input.position.linenr - linenr;
+	counted_newlines = newlines;
+	counted_spaces   = spaces;
+	if (skipped)
+		pending_space = true;
+	return false;
+}
 
-				if (pp_token.type != ')') {
+static bool is_builtin_macro(const symbol_t *symbol)
+{
+	switch (symbol->pp_ID) {
+	case TP___FILE__:
+	case TP___LINE__:
+	case TP___DATE__:
+	case TP___TIME__:
+	case TP___COUNTER__:
+	case TP___INCLUDE_LEVEL__:
+	case TP__Pragma:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void make_string_token(const char *string)
+{
+	for (const char *c = string; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\')
+			obstack_1grow(&symbol_obstack, '\\');
+		obstack_1grow(&symbol_obstack, *c);
+	}
+	obstack_1grow(&symbol_obstack, '\0');
+	size_t  size   = obstack_object_size(&symbol_obstack) - 1;
+	char   *result = obstack_finish(&symbol_obstack);
+
+	pp_token.type          = TP_STRING_LITERAL;
+	pp_token.literal.begin = result;
+	pp_token.literal.size  = size;
+}
+
+static void make_number_token(unsigned long value)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%lu", value);
+	size_t  size   = strlen(buf);
+	char   *result = obstack_copy0(&symbol_obstack, buf, size);
+
+	pp_token.type          = TP_NUMBER;
+	pp_token.literal.begin = result;
+	pp_token.literal.size  = size;
+}
+
+/**
+ * Expands the builtin macro in pp_token. Returns true if the token was
+ * consumed and the next one has to be read.
+ */
+static bool expand_builtin_macro(void)
+{
+	char       buf[32];
+	time_t     now = time(NULL);
+	struct tm *tm  = localtime(&now);
+
+	switch (pp_token.symbol->pp_ID) {
+	case TP___FILE__:
+		make_string_token(input.position.input_name);
+		return false;
+	case TP___LINE__:
+		make_number_token(get_source_position_linenr(&pp_token.source_position));
+		return false;
+	case TP___DATE__:
+		strftime(buf, sizeof(buf), "%b %e %Y", tm);
+		make_string_token(buf);
+		return false;
+	case TP___TIME__:
+		strftime(buf, sizeof(buf), "%H:%M:%S", tm);
+		make_string_token(buf);
+		return false;
+	case TP___COUNTER__:
+		make_number_token(counter++);
+		return false;
+	case TP___INCLUDE_LEVEL__:
+		make_number_token(n_inputs);
+		return false;
+	case TP__Pragma: {
+		/* _Pragma("...") operators are dropped for now */
+		source_position_t position = pp_token.source_position;
+		if (!next_is_lparen())
+			return false;
+		int depth = 0;
+		do {
+			if (!next_raw_token() || pp_token.type == TP_EOF
+					|| (pp_token.type == '\n' && in_pp_directive)) {
+				errorf(&position, "unterminated _Pragma");
+				return false;
+			}
+			if (pp_token.type == '(') {
+				++depth;
+			} else if (pp_token.type == ')') {
+				--depth;
+			}
+		} while (depth > 0);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+static int get_parameter_index(const pp_definition_t *definition,
+                               const symbol_t *symbol)
+{
+	for (size_t i = 0; i < definition->n_parameters; ++i) {
+		if (definition->parameters[i] == symbol)
+			return (int) i;
+	}
+	return -1;
+}
+
+/**
+ * Collects the arguments of a function-like macro invocation into the
+ * buffers of state, the current token is the '(' of the invocation. Returns
+ * false on errors.
+ */
+static bool collect_arguments(pp_expansion_state_t *state,
+                              pp_definition_t *definition, const token_t *name)
+{
+	/* read all tokens up to the closing ')', the whitespace inside the
+	 * invocation does not end up in the text output */
+	unsigned spaces  = counted_spaces;
+	bool     newline = false;
+	int      depth   = 0;
+	while (true) {
+		if (!next_raw_token() || pp_token.type == TP_EOF
+				|| (pp_token.type == '\n' && in_pp_directive)) {
+			errorf(&name->source_position,
+			       "unterminated argument list invoking macro '%Y'",
+			       definition->symbol);
+			goto error;
+		}
+		if (pp_token.type == '\n') {
+			newline = true;
+			continue;
+		}
+		if (pp_token.type == '(') {
+			++depth;
+		} else if (pp_token.type == ')') {
+			if (depth == 0)
+				break;
+			--depth;
+		}
+		if (newline) {
+			pp_token.space_before = true;
+			newline               = false;
+		}
+		ARR_APP1(token_t, state->argument_tokens, pp_token);
+	}
+
+	counted_spaces = spaces;
+
+	size_t   n_tokens = ARR_LEN(state->argument_tokens);
+	token_t *tokens   = state->argument_tokens;
+
+	/* split them at the top-level commas */
+	size_t n_parameters = definition->n_parameters;
+	size_t n_arguments  = n_parameters > 0 ? n_parameters : 1;
+	ARR_RESIZE(pp_argument_t, state->arguments, n_arguments);
+	pp_argument_t *arguments = state->arguments;
+	memset(arguments, 0, n_arguments * sizeof(arguments[0]));
+
+	size_t argument = 0;
+	size_t begin    = 0;
+	depth           = 0;
+	for (size_t i = 0; i <= n_tokens; ++i) {
+		if (i < n_tokens) {
+			int type = tokens[i].type;
+			if (type == '(') {
+				++depth;
+				continue;
+			} else if (type == ')') {
+				--depth;
+				continue;
+			} else if (type != ',' || depth > 0) {
+				continue;
+			}
+			/* the variadic argument takes all remaining commas */
+			if (definition->is_variadic && argument + 1 == n_parameters)
+				continue;
+		}
+		if (argument < n_arguments) {
+			arguments[argument].token_list = tokens + begin;
+			arguments[argument].list_len   = i - begin;
+		}
+		++argument;
+		begin = i + 1;
+	}
+
+	if (n_parameters == 0) {
+		if (n_tokens > 0) {
+			errorf(&name->source_position,
+			       "macro '%Y' passed %u arguments, but takes just 0",
+			       definition->symbol, (unsigned) argument);
+			goto error;
+		}
+	} else if (argument < n_parameters) {
+		/* the variadic argument may be omitted entirely */
+		if (!definition->is_variadic || argument + 1 < n_parameters) {
+			errorf(&name->source_position,
+			       "macro '%Y' requires %u arguments, but only %u given",
+			       definition->symbol, (unsigned) n_parameters,
+			       (unsigned) argument);
+			goto error;
+		}
+	} else if (argument > n_parameters) {
+		errorf(&name->source_position,
+		       "macro '%Y' passed %u arguments, but takes just %u",
+		       definition->symbol, (unsigned) argument,
+		       (unsigned) n_parameters);
+		goto error;
+	}
+
+	return true;
+
+error:
+	counted_spaces = spaces;
+	return false;
+}
+
+static bool next_expanded_token(void);
+
+/**
+ * Fully macro expands an argument of the invocation in state and returns
+ * the expanded tokens. Each argument is expanded only once, on its first
+ * use.
+ */
+static const token_t *get_expanded_argument(pp_expansion_state_t *state,
+                                            pp_argument_t *argument,
+                                            const source_position_t *position)
+{
+	if (!argument->is_expanded) {
+		size_t begin = ARR_LEN(state->expanded_tokens);
+		push_expansion(alloc_expansion_state(), NULL, argument->token_list,
+		               argument->list_len, position);
+		while (next_expanded_token()) {
+			ARR_APP1(token_t, state->expanded_tokens, pp_token);
+		}
+		/* remove the argument end marker */
+		pop_expansion();
+
+		argument->is_expanded    = true;
+		argument->expanded_begin = begin;
+		argument->expanded_len   = ARR_LEN(state->expanded_tokens) - begin;
+	}
+	/* the buffer may have moved while expanding other arguments */
+	return state->expanded_tokens + argument->expanded_begin;
+}
+
+/**
+ * Creates a string literal from the spelling of a macro argument (the
+ * # operator).
+ */
+static token_t stringify(const pp_argument_t *argument)
+{
+	for (size_t i = 0; i < argument->list_len; ++i) {
+		const token_t *token = &argument->token_list[i];
+		if (i > 0 && token->space_before)
+			obstack_1grow(&symbol_obstack, ' ');
+		grow_token_spelling(&symbol_obstack, token, true);
+	}
+	obstack_1grow(&symbol_obstack, '\0');
+	size_t  size   = obstack_object_size(&symbol_obstack) - 1;
+	char   *string = obstack_finish(&symbol_obstack);
+
+	token_t result;
+	memset(&result, 0, sizeof(result));
+	result.type          = TP_STRING_LITERAL;
+	result.literal.begin = string;
+	result.literal.size  = size;
+	return result;
+}
+
+/**
+ * Lexes a single token from a string (used for the ## operator). Returns
+ * false if the string does not form exactly one preprocessing token.
+ */
+static bool lex_from_string(char *string, size_t len)
+{
+	pp_input_t   saved_input       = input;
+	pp_input_t  *saved_input_stack = input_stack;
+	bool         saved_print       = do_print_spaces;
+	unsigned     saved_newlines    = pending_newlines;
+	bool         saved_space       = pending_space;
+
+	input_stack     = NULL;
+	do_print_spaces = false;
+	pending_newlines = 0;
+	pending_space    = false;
+	open_buffer_input(string, len, saved_input.position.input_name);
+	next_char();
+
+	lex_token();
+	bool single_token = CC == EOF && pp_token.type != TP_EOF
+	                 && pp_token.type != TP_ERROR;
+
+	input           = saved_input;
+	input_stack     = saved_input_stack;
+	do_print_spaces = saved_print;
+	pending_newlines = saved_newlines;
+	pending_space   = saved_space;
+	return single_token;
+}
+
+/**
+ * Concatenates two tokens (the ## operator).
+ */
+static token_t paste_tokens(const token_t *left, const token_t *right)
+{
+	grow_token_spelling(&expansion_obstack, left, false);
+	grow_token_spelling(&expansion_obstack, right, false);
+	obstack_1grow(&expansion_obstack, '\0');
+	size_t  len    = obstack_object_size(&expansion_obstack) - 1;
+	char   *string = obstack_finish(&expansion_obstack);
+
+	token_t saved_token = pp_token;
+	token_t result;
+	if (lex_from_string(string, len)) {
+		result                 = pp_token;
+		result.source_position = left->source_position;
+		result.space_before    = left->space_before;
+	} else {
+		errorf(&right->source_position,
+		       "pasting \"%s\" does not give a valid preprocessing token",
+		       string);
+		result = *right;
+	}
+	/* the lexed token does not refer to the string */
+	obstack_free(&expansion_obstack, string);
+	pp_token = saved_token;
+	return result;
+}
+
+/**
+ * Creates the replacement list of a macro invocation in the buffer of state
+ * by substituting the arguments and applying the # and ## operators, then
+ * starts reading it.
+ */
+static void substitute(pp_expansion_state_t *state,
+                       pp_definition_t *definition, const token_t *name)
+{
+	pp_argument_t *arguments    = state->arguments;
+	token_t       *result       = state->buffer;
+	const token_t *body         = definition->token_list;
+	size_t         len          = definition->list_len;
+	bool           paste        = false;
+	size_t         operand_start = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		const token_t *token = &body[i];
+		if (token->type == TP_HASHHASH) {
+			paste = true;
+			continue;
+		}
+
+		const token_t *operand   = token;
+		size_t         n_operand = 1;
+		bool           glue      = false;
+		token_t        stringified;
+		int            index     = -1;
+		if (definition->has_parameters && token->type == '#') {
+			assert(i + 1 < len);
+			index = get_parameter_index(definition, body[i+1].symbol);
+			assert(index >= 0);
+			stringified              = stringify(&arguments[index]);
+			stringified.space_before = token->space_before;
+			operand                  = &stringified;
+			++i;
+		} else if (token->type == TP_IDENTIFIER && definition->has_parameters
+				&& (index = get_parameter_index(definition, token->symbol)) >= 0) {
+			pp_argument_t *argument    = &arguments[index];
+			bool           next_pastes = i + 1 < len
+			                          && body[i+1].type == TP_HASHHASH;
+			if (paste || next_pastes) {
+				operand   = argument->token_list;
+				n_operand = argument->list_len;
+			} else {
+				operand   = get_expanded_argument(state, argument,
+				                                  &name->source_position);
+				n_operand = argument->expanded_len;
+			}
+
+			/* GNU extension: , ## __VA_ARGS__ removes the comma if no
+			 * variadic arguments are present */
+			if (paste && definition->is_variadic
+					&& (size_t) index + 1 == definition->n_parameters
+					&& i >= 2 && body[i-2].type == ','
+					&& ARR_LEN(result) > 0
+					&& result[ARR_LEN(result)-1].type == ',') {
+				paste = false;
+				glue  = true;
+				if (n_operand == 0)
+					ARR_SHRINKLEN(result, ARR_LEN(result) - 1);
+			}
+		}
+
+		size_t first = 0;
+		if (paste) {
+			paste = false;
+			/* pasting with a placemarker leaves the other operand */
+			if (n_operand > 0 && ARR_LEN(result) > operand_start) {
+				token_t *last = &result[ARR_LEN(result)-1];
+				*last = paste_tokens(last, &operand[0]);
+				first = 1;
+			}
+		} else {
+			operand_start = ARR_LEN(result);
+		}
+
+		for (size_t o = first; o < n_operand; ++o) {
+			ARR_APP1(token_t, result, operand[o]);
+			if (o == 0)
+				result[ARR_LEN(result)-1].space_before
+					= glue ? false : token->space_before;
+		}
+	}
+
+	size_t n_result = ARR_LEN(result);
+	if (n_result > 0)
+		result[0].space_before = false;
+	state->buffer = result;
+	push_expansion(state, definition, result, n_result,
+	               &name->source_position);
+	expansion_stack->space_before = name->space_before;
+}
+
+/**
+ * Expands the macro in pp_token. Returns true if the token was consumed and
+ * the next one has to be read, false if pp_token is final.
+ */
+static bool expand_macro(void)
+{
+	symbol_t        *symbol     = pp_token.symbol;
+	pp_definition_t *definition = symbol->pp_definition;
+	if (definition == NULL) {
+		if (is_builtin_macro(symbol))
+			return expand_builtin_macro();
+		return false;
+	}
+	if (definition->is_expanding) {
+		/* the name stays unexpanded even when it is rescanned after the
+		 * expansion of the macro ended (e.g. as part of an argument) */
+		pp_token.no_expand = true;
+		return false;
+	}
+
+	token_t name = pp_token;
+	if (!definition->has_parameters) {
+		if (!definition->has_concatenation) {
+			/* no substitution necessary, read the replacement list
+			 * directly */
+			push_expansion(alloc_expansion_state(), definition,
+			               definition->token_list, definition->list_len,
+			               &name.source_position);
+			expansion_stack->space_before = name.space_before;
+			return true;
+		}
+		substitute(alloc_expansion_state(), definition, &name);
+		return true;
+	}
+
+	if (!next_is_lparen()) {
+		pp_token = name;
+		return false;
+	}
+	/* read the '(' */
+	next_raw_token();
+	assert(pp_token.type == '(');
+
+	pp_expansion_state_t *state = alloc_expansion_state();
+	if (!collect_arguments(state, definition, &name)) {
+		free_expansion_state(state);
+		/* pp_token is the offending token (end of line or file), it is
+		 * not consumed */
+		if (pp_token.type == '\n' || pp_token.type == TP_EOF)
+			return false;
+		return true;
+	}
+	substitute(state, definition, &name);
+	return true;
+}
+
+/**
+ * Reads the next fully macro expanded token. Returns false when the end of a
+ * macro argument is reached.
+ */
+static bool next_expanded_token(void)
+{
+	while (true) {
+		if (!next_raw_token())
+			return false;
+		if (pp_token.type != TP_IDENTIFIER || !do_expansions
+		    || pp_token.no_expand)
+			return true;
+		if (!expand_macro())
+			return true;
+	}
+}
+
+static void next_preprocessing_token(void)
+{
+	bool res = next_expanded_token();
+	(void) res;
+	assert(res);
+}
+
+static bool strings_equal(const string_t *string1, const string_t *string2)
+{
+	size_t size = string1->size;
+	if(size != string2->size)
+		return false;
+
+	const char *c1 = string1->begin;
+	const char *c2 = string2->begin;
+	for(size_t i = 0; i < size; ++i, ++c1, ++c2) {
+		if(*c1 != *c2)
+			return false;
+	}
+	return true;
+}
+
+static bool pp_tokens_equal(const token_t *token1, const token_t *token2)
+{
+	if(token1->type != token2->type)
+		return false;
+
+	switch(token1->type) {
+	case TP_HEADERNAME:
+		/* TODO */
+		return false;
+	case TP_IDENTIFIER:
+		return token1->symbol == token2->symbol;
+	case TP_NUMBER:
+	case TP_CHARACTER_CONSTANT:
+	case TP_WIDE_CHARACTER_CONSTANT:
+	case TP_STRING_LITERAL:
+	case TP_WIDE_STRING_LITERAL:
+		return strings_equal(&token1->literal, &token2->literal);
+
+	default:
+		return true;
+	}
+}
+
+static bool pp_definitions_equal(const pp_definition_t *definition1,
+                                 const pp_definition_t *definition2)
+{
+	if (definition1->has_parameters != definition2->has_parameters
+			|| definition1->is_variadic != definition2->is_variadic
+			|| definition1->n_parameters != definition2->n_parameters)
+		return false;
+	for (size_t i = 0; i < definition1->n_parameters; ++i) {
+		if (definition1->parameters[i] != definition2->parameters[i])
+			return false;
+	}
+
+	if(definition1->list_len != definition2->list_len)
+		return false;
+
+	size_t         len = definition1->list_len;
+	const token_t *t1  = definition1->token_list;
+	const token_t *t2  = definition2->token_list;
+	for(size_t i = 0; i < len; ++i, ++t1, ++t2) {
+		if(!pp_tokens_equal(t1, t2))
+			return false;
+		if (i > 0 && t1->space_before != t2->space_before)
+			return false;
+	}
+	return true;
+}
+
+static void parse_define_directive(void)
+{
+	eat_pp(TP_IDENTIFIER);
+	assert(obstack_object_size(&pp_obstack) == 0);
+
+	if (pp_token.type != TP_IDENTIFIER) {
+		errorf(&pp_token.source_position,
+		       "expected identifier after #define, got '%t'", &pp_token);
+		goto error_out;
+	}
+	symbol_t *symbol = pp_token.symbol;
+	if (symbol->pp_ID == TP_defined) {
+		errorf(&pp_token.source_position, "\"defined\" cannot be used as a macro name");
+		goto error_out;
+	}
+
+	pp_definition_t *new_definition
+		= obstack_alloc(&pp_obstack, sizeof(new_definition[0]));
+	memset(new_definition, 0, sizeof(new_definition[0]));
+	new_definition->symbol          = symbol;
+	new_definition->source_position = pp_token.source_position;
+
+	/* this is probably the only place where spaces are significant in the
+	 * lexer (except for the fact that they separate tokens). #define b(x)
+	 * is something else than #define b (x) */
+	if (CC == '(') {
+		/* eat the '(' */
+		next_preprocessing_token();
+		/* get next token after '(' */
+		next_preprocessing_token();
+
+		while (true) {
+			switch (pp_token.type) {
+			case TP_DOTDOTDOT:
+				new_definition->is_variadic = true;
+				obstack_ptr_grow(&pp_obstack, symbol_va_args);
+				next_preprocessing_token();
+				if (pp_token.type != ')') {
 					errorf(&pp_token.source_position,
-					       "expected ',' or ')' after identifier, got '%t'",
-					       &pp_token);
+							"'...' not at end of macro argument list");
+					goto error_out;
+				}
+				break;
+			case TP_IDENTIFIER:
+				obstack_ptr_grow(&pp_obstack, pp_token.symbol);
+				next_preprocessing_token();
+
+				if (pp_token.type == ',') {
+					next_preprocessing_token();
+					break;
+				}
+				if (pp_token.type == TP_DOTDOTDOT) {
+					/* GNU named variadic parameter */
+					new_definition->is_variadic = true;
+					next_preprocessing_token();
+				}
+
+				if (pp_token.type != ')') {
+					errorf(&pp_token.source_position,
+					       "expected ',' or ')' after identifier, got '%t'",
+					       &pp_token);
 					goto error_out;
 				}
 				break;
@@ -1371,448 +2636,1867 @@ static void parse_define_directive(void)
 			}
 		}
 
-	finish_argument_list:
-		new_definition->has_parameters = true;
-		new_definition->n_parameters
-			= obstack_object_size(&pp_obstack) / sizeof(new_definition->parameters[0]);
-		new_definition->parameters = obstack_finish(&pp_obstack);
-	} else {
-		next_preprocessing_token();
+	finish_argument_list:
+		new_definition->has_parameters = true;
+		new_definition->n_parameters
+			= obstack_object_size(&pp_obstack) / sizeof(new_definition->parameters[0]);
+		new_definition->parameters = obstack_finish(&pp_obstack);
+	} else {
+		next_preprocessing_token();
+	}
+
+	/* construct the replacement list on the obstack */
+	assert(obstack_object_size(&pp_obstack) == 0);
+	size_t list_len = 0;
+	while (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		if (list_len == 0)
+			pp_token.space_before = false;
+		obstack_grow(&pp_obstack, &pp_token, sizeof(pp_token));
+		++list_len;
+		next_preprocessing_token();
+	}
+
+	new_definition->list_len   = list_len;
+	new_definition->token_list = obstack_finish(&pp_obstack);
+
+	/* check the # and ## operators */
+	const token_t *tokens = new_definition->token_list;
+	for (size_t i = 0; i < list_len; ++i) {
+		const token_t *token = &tokens[i];
+		if (token->type == TP_HASHHASH) {
+			if (i == 0 || i + 1 == list_len) {
+				errorf(&token->source_position,
+				       "'##' cannot appear at either end of a macro expansion");
+				goto error_definition;
+			}
+			new_definition->has_concatenation = true;
+		} else if (token->type == '#' && new_definition->has_parameters) {
+			if (i + 1 == list_len || tokens[i+1].type != TP_IDENTIFIER
+					|| get_parameter_index(new_definition, tokens[i+1].symbol) < 0) {
+				errorf(&token->source_position,
+				       "'#' is not followed by a macro parameter");
+				goto error_definition;
+			}
+		}
+	}
+
+	pp_definition_t *old_definition = symbol->pp_definition;
+	if (old_definition != NULL) {
+		if (!pp_definitions_equal(old_definition, new_definition)) {
+			warningf(&new_definition->source_position,
+			         "multiple definition of macro '%Y' (first defined %P)",
+			         symbol, &old_definition->source_position);
+		} else {
+			/* reuse the old definition */
+			obstack_free(&pp_obstack, new_definition);
+			new_definition = old_definition;
+		}
+	}
+
+	symbol->pp_definition = new_definition;
+	return;
+
+error_definition:
+	obstack_free(&pp_obstack, new_definition);
+	return;
+
+error_out:
+	if (obstack_object_size(&pp_obstack) > 0) {
+		char *ptr = obstack_finish(&pp_obstack);
+		obstack_free(&pp_obstack, ptr);
+	}
+	eat_pp_directive();
+}
+
+static void parse_undef_directive(void)
+{
+	eat_pp(TP_IDENTIFIER);
+
+	if(pp_token.type != TP_IDENTIFIER) {
+		errorf(&pp_token.source_position,
+		       "expected identifier after #undef, got '%t'", &pp_token);
+		eat_pp_directive();
+		return;
+	}
+
+	symbol_t *symbol = pp_token.symbol;
+	symbol->pp_definition = NULL;
+	next_preprocessing_token();
+
+	if(pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		warningf(&pp_token.source_position,
+		         "extra tokens at end of #undef directive");
+	}
+	/* eat until '\n' */
+	eat_pp_directive();
+}
+
+static const char *parse_headername(bool *is_system_include)
+{
+	/* behind an #include we can have the special headername lexems.
+	 * They're only allowed behind an #include so they're not recognized
+	 * by the normal next_preprocessing_token. We handle them as a special
+	 * exception here */
+
+	/* skip spaces so we reach start of next preprocessing token */
+	skip_spaces(false);
+
+	assert(obstack_object_size(&input_obstack) == 0);
+
+	/* check wether we have a "... or <... headername */
+	int terminator;
+	switch (CC) {
+	case '<':
+		terminator = '>';
+		goto read_headername;
+	case '"':
+		terminator = '"';
+read_headername:
+		*is_system_include = terminator == '>';
+		next_char();
+		while (true) {
+			switch (CC) {
+			case EOF:
+			case '\r':
+			case '\n':
+				errorf(&pp_token.source_position,
+				       "header name without closing '%c'", terminator);
+				goto error_out;
+			}
+			if (CC == terminator) {
+				next_char();
+				break;
+			}
+			obstack_1grow(&input_obstack, (char) CC);
+			next_char();
+		}
+		next_preprocessing_token();
+		break;
+
+	default:
+		/* the header name is the result of macro expansion */
+		do_expansions = true;
+		next_preprocessing_token();
+		if (pp_token.type == TP_STRING_LITERAL) {
+			*is_system_include = false;
+			obstack_grow(&input_obstack, pp_token.literal.begin,
+			             pp_token.literal.size);
+			next_preprocessing_token();
+		} else if (pp_token.type == '<') {
+			*is_system_include = true;
+			next_preprocessing_token();
+			while (pp_token.type != '>') {
+				if (pp_token.type == '\n' || pp_token.type == TP_EOF) {
+					parse_error("header name without closing '>'");
+					goto error_out;
+				}
+				if (pp_token.space_before
+						&& obstack_object_size(&input_obstack) > 0)
+					obstack_1grow(&input_obstack, ' ');
+				grow_token_spelling(&input_obstack, &pp_token, false);
+				next_preprocessing_token();
+			}
+			next_preprocessing_token();
+		} else {
+			errorf(&pp_token.source_position,
+			       "#include expects \"FILENAME\" or <FILENAME>");
+			goto error_out;
+		}
+		do_expansions = false;
+		break;
+	}
+
+	obstack_1grow(&input_obstack, '\0');
+	return obstack_finish(&input_obstack);
+
+error_out:
+	if (obstack_object_size(&input_obstack) > 0) {
+		char *ptr = obstack_finish(&input_obstack);
+		obstack_free(&input_obstack, ptr);
+	}
+	do_expansions = false;
+	return NULL;
+}
+
+/**
+ * Checks whether "directory/headername" exists (directory is NULL for an
+ * absolute headername), the filename is kept in *filename and the file (if
+ * it can be identified) in *file_info on success.
+ */
+static bool find_include(include_dir_t *directory, const char *headername,
+                         const char **filename, pp_file_t **file_info)
+{
+	if (directory != NULL) {
+		if (!include_dir_may_contain(directory, headername))
+			return false;
+		const char *dir_path = get_include_dir_path(directory);
+		obstack_grow(&input_obstack, dir_path, strlen(dir_path));
+	}
+	obstack_grow0(&input_obstack, headername, strlen(headername));
+	char *path = obstack_finish(&input_obstack);
+
+	struct stat st;
+	if (stat(path, &st) != 0 || S_ISDIR(st.st_mode)) {
+		obstack_free(&input_obstack, path);
+		return false;
+	}
+	*filename  = path;
+	*file_info = get_pp_file(&st);
+	return true;
+}
+
+/**
+ * Searches an include file: "quoted" includes are searched in the directory
+ * of the current file first, then in the quote, user and system search path.
+ * <bracket> includes skip the quote search path.
+ */
+static bool find_include_file(const char *headername, bool is_system_include,
+                              bool include_next, const char **filename,
+                              searchpath_entry_t **found_in,
+                              pp_file_t **file_info)
+{
+	*found_in = NULL;
+	if (headername[0] == '/')
+		return find_include(NULL, headername, filename, file_info);
+
+	searchpath_entry_t *entry = searchpath;
+	if (include_next && input.path != NULL) {
+		entry = input.path->next;
+	} else if (is_system_include) {
+		entry = *quote_searchpath_anchor;
+	} else {
+		const char *current = input.filename;
+		const char *slash   = strrchr(current, '/');
+		size_t      len     = slash != NULL ? (size_t) (slash - current) + 1 : 0;
+		include_dir_t *directory = get_include_dir(current, len);
+		if (find_include(directory, headername, filename, file_info))
+			return true;
+	}
+
+	for ( ; entry != NULL; entry = entry->next) {
+		if (entry->directory == NULL)
+			entry->directory = get_include_dir(entry->path, strlen(entry->path));
+		if (find_include(entry->directory, headername, filename, file_info)) {
+			*found_in = entry;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void parse_include_directive(bool include_next)
+{
+	/* don't eat the include token here!
+	 * we need an alternative parsing for the next token */
+	source_position_t position = pp_token.source_position;
+
+	bool        is_system_include;
+	const char *headername = parse_headername(&is_system_include);
+	if (headername == NULL) {
+		eat_pp_directive();
+		return;
+	}
+
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		warningf(&pp_token.source_position,
+		         "extra tokens at end of #include directive");
+		eat_pp_directive();
+	}
+
+	if (n_inputs > INCLUDE_LIMIT) {
+		errorf(&position, "#include nested too deeply");
+		return;
+	}
+
+	const char         *filename;
+	searchpath_entry_t *path;
+	pp_file_t          *file_info;
+	if (!find_include_file(headername, is_system_include, include_next,
+	                       &filename, &path, &file_info)) {
+		errorf(&position, "failed including '%s': file not found",
+		       headername);
+		return;
+	}
+	/* the multiple include optimization: don't even open the file */
+	if (file_info != NULL && is_include_skipped(file_info)) {
+		pp_header_stats_t *stats = get_header_stats(file_info, filename);
+		if (stats != NULL)
+			pp_stats_skip_header(stats, n_inputs + 1);
+		return;
+	}
+
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		errorf(&position, "failed including '%s': %s", headername,
+		       strerror(errno));
+		return;
+	}
+
+	/* switch inputs */
+	timer_trace_begin("include", filename);
+	uint32_t last_loc = current_position().loc;
+	push_input();
+	open_file_input(file, filename, path);
+	input.close_file = true;
+	input.file_info  = file_info;
+	begin_header_stats();
+	begin_position_segment(input.bufpos, last_loc);
+	next_char();
+
+	/* indicate that we're at a new input */
+	print_line_marker(&input.position, "1");
+}
+
+/**
+ * Reads the whole contents of a file for #embed. Regular files are mapped,
+ * so even huge resources are not copied before the parser stores them in an
+ * initializer.
+ */
+static pp_embedded_t *read_embedded_file(FILE *file)
+{
+	pp_embedded_t *embedded = XMALLOCZ(pp_embedded_t);
+
+#ifdef HAVE_MMAP
+	int         fd = fileno(file);
+	struct stat st;
+	if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+			&& st.st_size > 0 && (off_t) (size_t) st.st_size == st.st_size) {
+		size_t size = (size_t) st.st_size;
+		void  *map  = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			embedded->data   = map;
+			embedded->size   = size;
+			embedded->mapped = true;
+			return embedded;
+		}
+	}
+#endif
+
+	size_t capacity = 0;
+	while (true) {
+		if (embedded->size == capacity) {
+			capacity       = capacity == 0 ? BUF_SIZE : 2 * capacity;
+			embedded->data = XREALLOC(embedded->data, char, capacity);
+		}
+		size_t n = fread(embedded->data + embedded->size, 1,
+		                 capacity - embedded->size, file);
+		if (n == 0)
+			break;
+		embedded->size += n;
+	}
+	if (ferror(file)) {
+		free(embedded->data);
+		free(embedded);
+		return NULL;
+	}
+	return embedded;
+}
+
+static void free_embedded_files(void)
+{
+	pp_embedded_t *next;
+	for (pp_embedded_t *embedded = embedded_files; embedded != NULL;
+	     embedded = next) {
+		next = embedded->next;
+#ifdef HAVE_MMAP
+		if (embedded->mapped) {
+			munmap(embedded->data, embedded->size);
+		} else
+#endif
+		{
+			free(embedded->data);
+		}
+		free(embedded);
+	}
+	embedded_files = NULL;
+}
+
+/**
+ * Parses an #embed directive: the bytes of the file are passed to the parser
+ * as a single token, which initializes objects like a list of integer
+ * constants. When writing text the bytes are printed as such a list.
+ * Parameters like limit() are not supported.
+ */
+static void parse_embed_directive(void)
+{
+	/* like #include the resource name is parsed as header name */
+	source_position_t position = pp_token.source_position;
+
+	bool        is_system_include;
+	const char *headername = parse_headername(&is_system_include);
+	if (headername == NULL) {
+		eat_pp_directive();
+		return;
+	}
+
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		warningf(&pp_token.source_position,
+		         "extra tokens at end of #embed directive");
+		eat_pp_directive();
+	}
+
+	const char         *filename;
+	searchpath_entry_t *path;
+	pp_file_t          *file_info;
+	if (!find_include_file(headername, is_system_include, false,
+	                       &filename, &path, &file_info)) {
+		errorf(&position, "failed embedding '%s': file not found",
+		       headername);
+		return;
+	}
+
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) {
+		errorf(&position, "failed embedding '%s': %s", headername,
+		       strerror(errno));
+		return;
+	}
+	pp_embedded_t *embedded = read_embedded_file(file);
+	if (embedded == NULL) {
+		errorf(&position, "failed embedding '%s': %s", headername,
+		       strerror(errno));
+		fclose(file);
+		return;
+	}
+	fclose(file);
+	embedded->next = embedded_files;
+	embedded_files = embedded;
+
+	/* an empty resource expands to nothing */
+	if (embedded->size == 0)
+		return;
+
+	if (out != NULL) {
+		print_newlines();
+		if (line_has_output)
+			fputc('\n', out);
+		const unsigned char *data = (const unsigned char*) embedded->data;
+		for (size_t i = 0; i < embedded->size; ++i) {
+			fprintf(out, i > 0 ? ",%u" : "%u", data[i]);
+		}
+		line_has_output = true;
+		return;
+	}
+
+	memset(&embed_token, 0, sizeof(embed_token));
+	embed_token.type            = TP_EMBED;
+	embed_token.literal.begin   = embedded->data;
+	embed_token.literal.size    = embedded->size;
+	embed_token.source_position = position;
+}
+
+/** value of a preprocessor expression */
+typedef struct pp_value_t {
+	intmax_t value;
+	bool     is_unsigned;
+} pp_value_t;
+
+static pp_value_t make_pp_value(intmax_t value, bool is_unsigned)
+{
+	pp_value_t result;
+	result.value       = value;
+	result.is_unsigned = is_unsigned;
+	return result;
+}
+
+static pp_value_t parse_pp_number(const token_t *token)
+{
+	const char *string = token->literal.begin;
+	char       *end;
+	errno = 0;
+	uintmax_t value = strtoumax(string, &end, 0);
+	if (errno == ERANGE) {
+		errorf(&token->source_position,
+		       "integer constant is too large for its type");
+	}
+
+	bool is_unsigned = false;
+	for ( ; *end != '\0'; ++end) {
+		switch (*end) {
+		case 'u':
+		case 'U':
+			is_unsigned = true;
+			break;
+		case 'l':
+		case 'L':
+			break;
+		default:
+			if (strpbrk(string, ".eEpP") != NULL && strncmp(string, "0x", 2) != 0
+					&& strncmp(string, "0X", 2) != 0) {
+				errorf(&token->source_position,
+				       "floating constant in preprocessor expression");
+			} else {
+				errorf(&token->source_position,
+				       "invalid suffix \"%s\" on integer constant", end);
+			}
+			return make_pp_value(0, false);
+		}
+	}
+
+	if (value > INTMAX_MAX)
+		is_unsigned = true;
+	return make_pp_value((intmax_t) value, is_unsigned);
+}
+
+static pp_value_t parse_pp_character_constant(const token_t *token)
+{
+	const char *c      = token->literal.begin;
+	const char *end    = c + token->literal.size;
+	intmax_t    value  = 0;
+	bool        is_wide = token->type == TP_WIDE_CHARACTER_CONSTANT;
+
+	if (c == end) {
+		errorf(&token->source_position, "empty character constant");
+		return make_pp_value(0, false);
+	}
+
+	while (c < end) {
+		utf32 tc;
+		if (*c == '\\') {
+			++c;
+			tc = resolve_escape_sequence(&c, &token->source_position);
+		} else if (is_wide) {
+			tc = read_utf8_char(&c);
+		} else {
+			tc = (unsigned char) *c++;
+		}
+
+		if (is_wide) {
+			value = tc;
+		} else {
+			value = (value << 8) | (tc & 0xFF);
+		}
+	}
+
+	/* a single plain character has type char */
+	if (!is_wide && token->literal.size == 1 && char_is_signed)
+		value = (signed char) value;
+	return make_pp_value(value, false);
+}
+
+static pp_value_t parse_pp_conditional_expression(bool evaluate);
+
+static pp_value_t parse_pp_primary_expression(bool evaluate)
+{
+	pp_value_t result;
+	switch (pp_token.type) {
+	case TP_NUMBER:
+		result = parse_pp_number(&pp_token);
+		next_preprocessing_token();
+		return result;
+
+	case TP_CHARACTER_CONSTANT:
+	case TP_WIDE_CHARACTER_CONSTANT:
+		result = parse_pp_character_constant(&pp_token);
+		next_preprocessing_token();
+		return result;
+
+	case TP_IDENTIFIER: {
+		symbol_t *symbol = pp_token.symbol;
+		if (symbol->pp_ID == TP_defined) {
+			/* the operand of defined must not be expanded */
+			do_expansions = false;
+			next_preprocessing_token();
+			bool in_parens = pp_token.type == '(';
+			if (in_parens)
+				next_preprocessing_token();
+			if (pp_token.type != TP_IDENTIFIER) {
+				errorf(&pp_token.source_position,
+				       "operator \"defined\" requires an identifier");
+				do_expansions = true;
+				return make_pp_value(0, false);
+			}
+			symbol_t *operand = pp_token.symbol;
+			bool      defined = operand->pp_definition != NULL
+			                 || is_builtin_macro(operand);
+			if (in_parens) {
+				next_preprocessing_token();
+				if (pp_token.type != ')') {
+					errorf(&pp_token.source_position,
+					       "missing ')' after \"defined\"");
+					do_expansions = true;
+					return make_pp_value(defined, false);
+				}
+			}
+			do_expansions = true;
+			next_preprocessing_token();
+			return make_pp_value(defined, false);
+		}
+
+		/* all remaining identifiers are replaced by 0 (true and false are
+		 * keywords in C++) */
+		next_preprocessing_token();
+		if ((c_mode & _CXX) && streq(symbol->string, "true"))
+			return make_pp_value(1, false);
+		return make_pp_value(0, false);
+	}
+
+	case '(':
+		next_preprocessing_token();
+		result = parse_pp_conditional_expression(evaluate);
+		if (pp_token.type != ')') {
+			errorf(&pp_token.source_position,
+			       "missing ')' in expression");
+			return result;
+		}
+		next_preprocessing_token();
+		return result;
+
+	case '\n':
+	case TP_EOF:
+		errorf(&pp_token.source_position, "#if with no expression");
+		return make_pp_value(0, false);
+
+	default:
+		errorf(&pp_token.source_position,
+		       "token '%t' is not valid in preprocessor expressions",
+		       &pp_token);
+		next_preprocessing_token();
+		return make_pp_value(0, false);
+	}
+}
+
+static pp_value_t parse_pp_unary_expression(bool evaluate)
+{
+	pp_value_t value;
+	switch (pp_token.type) {
+	case '+':
+		next_preprocessing_token();
+		return parse_pp_unary_expression(evaluate);
+	case '-':
+		next_preprocessing_token();
+		value = parse_pp_unary_expression(evaluate);
+		value.value = (intmax_t) -(uintmax_t) value.value;
+		return value;
+	case '~':
+		next_preprocessing_token();
+		value = parse_pp_unary_expression(evaluate);
+		value.value = ~value.value;
+		return value;
+	case '!':
+		next_preprocessing_token();
+		value = parse_pp_unary_expression(evaluate);
+		return make_pp_value(value.value == 0, false);
+	default:
+		return parse_pp_primary_expression(evaluate);
+	}
+}
+
+static unsigned get_pp_binary_precedence(int type)
+{
+	switch (type) {
+	case '*':
+	case '/':
+	case '%':                     return 10;
+	case '+':
+	case '-':                     return 9;
+	case TP_LESSLESS:
+	case TP_GREATERGREATER:       return 8;
+	case '<':
+	case '>':
+	case TP_LESSEQUAL:
+	case TP_GREATEREQUAL:         return 7;
+	case TP_EQUALEQUAL:
+	case TP_EXCLAMATIONMARKEQUAL: return 6;
+	case '&':                     return 5;
+	case '^':                     return 4;
+	case '|':                     return 3;
+	case TP_ANDAND:               return 2;
+	case TP_PIPEPIPE:             return 1;
+	default:                      return 0;
+	}
+}
+
+static pp_value_t evaluate_pp_binary(int type, pp_value_t left,
+                                     pp_value_t right, bool evaluate,
+                                     const source_position_t *pos)
+{
+	/* usual arithmetic conversions */
+	bool      is_unsigned = left.is_unsigned || right.is_unsigned;
+	uintmax_t ul          = (uintmax_t) left.value;
+	uintmax_t ur          = (uintmax_t) right.value;
+	intmax_t  l           = left.value;
+	intmax_t  r           = right.value;
+
+	switch (type) {
+	case '*':
+		return make_pp_value((intmax_t) (ul * ur), is_unsigned);
+	case '/':
+	case '%':
+		if (r == 0) {
+			if (evaluate)
+				errorf(pos, "division by zero in #if");
+			return make_pp_value(0, is_unsigned);
+		}
+		if (is_unsigned) {
+			return make_pp_value((intmax_t) (type == '/' ? ul / ur : ul % ur),
+			                     true);
+		}
+		if (r == -1)
+			return make_pp_value(type == '/' ? (intmax_t) -ul : 0, false);
+		return make_pp_value(type == '/' ? l / r : l % r, false);
+	case '+':
+		return make_pp_value((intmax_t) (ul + ur), is_unsigned);
+	case '-':
+		return make_pp_value((intmax_t) (ul - ur), is_unsigned);
+	case TP_LESSLESS:
+		if (ur >= sizeof(uintmax_t) * 8)
+			return make_pp_value(0, left.is_unsigned);
+		return make_pp_value((intmax_t) (ul << ur), left.is_unsigned);
+	case TP_GREATERGREATER:
+		if (ur >= sizeof(uintmax_t) * 8)
+			return make_pp_value(!left.is_unsigned && l < 0 ? -1 : 0,
+			                     left.is_unsigned);
+		if (left.is_unsigned)
+			return make_pp_value((intmax_t) (ul >> ur), true);
+		return make_pp_value(l >> ur, false);
+	case '<':
+		return make_pp_value(is_unsigned ? ul < ur : l < r, false);
+	case '>':
+		return make_pp_value(is_unsigned ? ul > ur : l > r, false);
+	case TP_LESSEQUAL:
+		return make_pp_value(is_unsigned ? ul <= ur : l <= r, false);
+	case TP_GREATEREQUAL:
+		return make_pp_value(is_unsigned ? ul >= ur : l >= r, false);
+	case TP_EQUALEQUAL:
+		return make_pp_value(l == r, false);
+	case TP_EXCLAMATIONMARKEQUAL:
+		return make_pp_value(l != r, false);
+	case '&':
+		return make_pp_value(l & r, is_unsigned);
+	case '^':
+		return make_pp_value(l ^ r, is_unsigned);
+	case '|':
+		return make_pp_value(l | r, is_unsigned);
+	case TP_ANDAND:
+		return make_pp_value(l != 0 && r != 0, false);
+	case TP_PIPEPIPE:
+		return make_pp_value(l != 0 || r != 0, false);
+	default:
+		panic("invalid binary operator in preprocessor expression");
+	}
+}
+
+static pp_value_t parse_pp_binary_expression(unsigned min_precedence,
+                                             bool evaluate)
+{
+	pp_value_t left = parse_pp_unary_expression(evaluate);
+	while (true) {
+		int      type       = pp_token.type;
+		unsigned precedence = get_pp_binary_precedence(type);
+		if (precedence == 0 || precedence < min_precedence)
+			return left;
+
+		source_position_t pos = pp_token.source_position;
+		next_preprocessing_token();
+
+		/* && and || do not evaluate their right operand if the result is
+		 * already known */
+		bool evaluate_right = evaluate;
+		if ((type == TP_ANDAND && left.value == 0)
+				|| (type == TP_PIPEPIPE && left.value != 0))
+			evaluate_right = false;
+
+		pp_value_t right
+			= parse_pp_binary_expression(precedence + 1, evaluate_right);
+		left = evaluate_pp_binary(type, left, right, evaluate_right, &pos);
+	}
+}
+
+static pp_value_t parse_pp_conditional_expression(bool evaluate)
+{
+	pp_value_t condition = parse_pp_binary_expression(1, evaluate);
+	if (pp_token.type != '?')
+		return condition;
+	next_preprocessing_token();
+
+	pp_value_t true_value
+		= parse_pp_conditional_expression(evaluate && condition.value != 0);
+	if (pp_token.type != ':') {
+		errorf(&pp_token.source_position,
+		       "expected ':' in preprocessor expression, got '%t'", &pp_token);
+		return condition;
+	}
+	next_preprocessing_token();
+	pp_value_t false_value
+		= parse_pp_conditional_expression(evaluate && condition.value == 0);
+
+	pp_value_t result = condition.value != 0 ? true_value : false_value;
+	result.is_unsigned = true_value.is_unsigned || false_value.is_unsigned;
+	return result;
+}
+
+/**
+ * Evaluates the condition of an #if or #elif directive, the current token is
+ * the directive name.
+ */
+static bool parse_pp_condition(void)
+{
+	do_expansions = true;
+	next_preprocessing_token();
+
+	pp_value_t value = parse_pp_conditional_expression(true);
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		errorf(&pp_token.source_position,
+		       "missing binary operator before token '%t'", &pp_token);
+		eat_pp_directive();
+	}
+	do_expansions = false;
+	return value.value != 0;
+}
+
+static pp_conditional_t *push_conditional(void)
+{
+	pp_conditional_t *conditional = XMALLOCZ(pp_conditional_t);
+
+	conditional->parent = conditional_stack;
+	conditional_stack   = conditional;
+
+	return conditional;
+}
+
+/**
+ * Returns true if conditional is the #ifndef of the include guard candidate
+ * of the current input.
+ */
+static bool is_guard_conditional(const pp_conditional_t *conditional)
+{
+	return input.guard_state == GUARD_INSIDE
+	    && input.guard_conditional == conditional;
+}
+
+static void pop_conditional(void)
+{
+	assert(conditional_stack != NULL);
+	pp_conditional_t *conditional = conditional_stack;
+	conditional_stack = conditional->parent;
+	free(conditional);
+}
+
+/**
+ * Returns the innermost conditional opened in the current input.
+ */
+static pp_conditional_t *get_current_conditional(void)
+{
+	if (conditional_stack == input.conditional_stack)
+		return NULL;
+	return conditional_stack;
+}
+
+static void parse_if_directive(void)
+{
+	source_position_t position = pp_token.source_position;
+
+	if (skip_mode) {
+		eat_pp_directive();
+		pp_conditional_t *conditional = push_conditional();
+		conditional->source_position  = position;
+		conditional->skip             = true;
+		return;
+	}
+
+	bool condition = parse_pp_condition();
+
+	pp_conditional_t *conditional = push_conditional();
+	conditional->source_position  = position;
+	conditional->condition        = condition;
+
+	if (!condition) {
+		skip_mode = true;
+	}
+}
+
+static void parse_ifdef_ifndef_directive(void)
+{
+	bool is_ifndef = (pp_token.symbol->pp_ID == TP_ifndef);
+	bool condition;
+	source_position_t position = pp_token.source_position;
+	next_preprocessing_token();
+
+	if (skip_mode) {
+		eat_pp_directive();
+		pp_conditional_t *conditional = push_conditional();
+		conditional->source_position  = position;
+		conditional->skip             = true;
+		return;
+	}
+
+	symbol_t *guard = NULL;
+	if (pp_token.type != TP_IDENTIFIER) {
+		errorf(&pp_token.source_position,
+		       "expected identifier after #%s, got '%t'",
+		       is_ifndef ? "ifndef" : "ifdef", &pp_token);
+		eat_pp_directive();
+
+		/* just take the true case in the hope to avoid further errors */
+		condition = true;
+	} else {
+		symbol_t *symbol  = pp_token.symbol;
+		bool      defined = symbol->pp_definition != NULL
+		                 || is_builtin_macro(symbol);
+		guard = symbol;
+		next_preprocessing_token();
+
+		if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+			errorf(&pp_token.source_position,
+			       "extra tokens at end of #%s",
+			       is_ifndef ? "ifndef" : "ifdef");
+			eat_pp_directive();
+		}
+
+		/* evaluate wether we are in true or false case */
+		condition = is_ifndef ? !defined : defined;
+	}
+
+	pp_conditional_t *conditional = push_conditional();
+	conditional->source_position  = position;
+	conditional->condition        = condition;
+
+	if (input.guard_state == GUARD_AT_START && is_ifndef && guard != NULL) {
+		input.guard_state       = GUARD_INSIDE;
+		input.guard             = guard;
+		input.guard_conditional = conditional;
+	} else if (input.guard_state != GUARD_INSIDE) {
+		input.guard_state = GUARD_NONE;
+	}
+
+	if (!condition) {
+		skip_mode = true;
+	}
+}
+
+static void parse_elif_directive(void)
+{
+	source_position_t position    = pp_token.source_position;
+	pp_conditional_t *conditional = get_current_conditional();
+	if (conditional == NULL) {
+		errorf(&position, "#elif without prior #if");
+		eat_pp_directive();
+		return;
+	}
+	if (is_guard_conditional(conditional))
+		input.guard_state = GUARD_NONE;
+
+	if (conditional->in_else) {
+		errorf(&position, "#elif after #else (condition started %P)",
+		       &conditional->source_position);
+		eat_pp_directive();
+		skip_mode = true;
+		return;
+	}
+
+	conditional->source_position = position;
+	if (conditional->skip || conditional->condition) {
+		/* an earlier branch was taken already */
+		eat_pp_directive();
+		skip_mode = true;
+		return;
+	}
+
+	skip_mode = false;
+	bool condition = parse_pp_condition();
+	conditional->condition = condition;
+	skip_mode              = !condition;
+}
+
+static void parse_else_directive(void)
+{
+	eat_pp(TP_IDENTIFIER);
+
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		if (!skip_mode) {
+			warningf(&pp_token.source_position, "extra tokens at end of #else");
+		}
+		eat_pp_directive();
+	}
+
+	pp_conditional_t *conditional = get_current_conditional();
+	if (conditional == NULL) {
+		errorf(&pp_token.source_position, "#else without prior #if");
+		return;
+	}
+	if (is_guard_conditional(conditional))
+		input.guard_state = GUARD_NONE;
+
+	if (conditional->in_else) {
+		errorf(&pp_token.source_position,
+		       "#else after #else (condition started %P)",
+		       &conditional->source_position);
+		skip_mode = true;
+		return;
+	}
+
+	conditional->in_else = true;
+	if (!conditional->skip) {
+		skip_mode = conditional->condition;
+	}
+	conditional->source_position = pp_token.source_position;
+}
+
+static void parse_endif_directive(void)
+{
+	eat_pp(TP_IDENTIFIER);
+
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		if (!skip_mode) {
+			warningf(&pp_token.source_position,
+			         "extra tokens at end of #endif");
+		}
+		eat_pp_directive();
+	}
+
+	pp_conditional_t *conditional = get_current_conditional();
+	if (conditional == NULL) {
+		errorf(&pp_token.source_position, "#endif without prior #if");
+		return;
 	}
+	if (is_guard_conditional(conditional))
+		input.guard_state = GUARD_AFTER;
 
-	/* construct a new pp_definition on the obstack */
-	assert(obstack_object_size(&pp_obstack) == 0);
-	size_t list_len = 0;
-	while (pp_token.type != '\n' && pp_token.type != TP_EOF) {
-		obstack_grow(&pp_obstack, &pp_token, sizeof(pp_token));
-		++list_len;
-		next_preprocessing_token();
+	if (!conditional->skip) {
+		skip_mode = false;
 	}
+	pop_conditional();
+}
 
-	new_definition->list_len   = list_len;
-	new_definition->token_list = obstack_finish(&pp_obstack);
+/**
+ * Parses a #line directive or a GNU line marker, the current token is the
+ * line number.
+ */
+static void parse_line_directive(bool is_line_marker)
+{
+	if (pp_token.type != TP_NUMBER
+			|| strspn(pp_token.literal.begin, "0123456789") != pp_token.literal.size) {
+		errorf(&pp_token.source_position,
+		       "#line directive requires a simple digit sequence");
+		eat_pp_directive();
+		return;
+	}
+	unsigned linenr = (unsigned) strtoul(pp_token.literal.begin, NULL, 10);
+	next_preprocessing_token();
 
-	pp_definition_t *old_definition = symbol->pp_definition;
-	if (old_definition != NULL) {
-		if (!pp_definitions_equal(old_definition, new_definition)) {
-			warningf(&input.position, "multiple definition of macro '%Y' (first defined %P)",
-			         symbol, &old_definition->source_position);
-		} else {
-			/* reuse the old definition */
-			obstack_free(&pp_obstack, new_definition);
-			new_definition = old_definition;
+	const char *input_name = NULL;
+	if (pp_token.type == TP_STRING_LITERAL) {
+		input_name = pp_token.literal.begin;
+		next_preprocessing_token();
+	}
+
+	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		/* line markers contain additional flags */
+		if (!is_line_marker) {
+			warningf(&pp_token.source_position,
+			         "extra tokens at end of #line directive");
 		}
+		eat_pp_directive();
 	}
 
-	symbol->pp_definition = new_definition;
-	return;
+	/* the newline was read already, so the next line gets the number */
+	input.position.linenr = linenr;
+	if (input_name != NULL)
+		input.position.input_name = input_name;
+	begin_position_segment(input.bufpos - 1, current_position().loc);
 
-error_out:
-	if (obstack_object_size(&pp_obstack) > 0) {
-		char *ptr = obstack_finish(&pp_obstack);
-		obstack_free(&pp_obstack, ptr);
-	}
-	eat_pp_directive();
+	print_line_marker(&input.position, NULL);
 }
 
-static void parse_undef_directive(void)
+/**
+ * Returns the tokens of the directive from the current one on as text.
+ */
+static const char *read_directive_text(void)
 {
-	eat_pp(TP_undef);
+	assert(obstack_object_size(&expansion_obstack) == 0);
+	while (pp_token.type != '\n' && pp_token.type != TP_EOF) {
+		if (pp_token.space_before && obstack_object_size(&expansion_obstack) > 0)
+			obstack_1grow(&expansion_obstack, ' ');
+		grow_token_spelling(&expansion_obstack, &pp_token, false);
+		next_preprocessing_token();
+	}
+	obstack_1grow(&expansion_obstack, '\0');
+	return obstack_finish(&expansion_obstack);
+}
 
-	if(pp_token.type != TP_IDENTIFIER) {
-		errorf(&input.position,
-		       "expected identifier after #undef, got '%t'", &pp_token);
+/**
+ * Parses a #pragma directive. Only the STDC pragmas are known, all others are
+ * ignored (or passed through when producing text output).
+ */
+static void parse_pragma_directive(void)
+{
+	source_position_t position = pp_token.source_position;
+	next_preprocessing_token();
+	if (pp_token.type == TP_IDENTIFIER && pp_token.symbol->pp_ID == TP_once) {
+		if (input.file_info != NULL)
+			input.file_info->once = true;
 		eat_pp_directive();
 		return;
 	}
 
-	symbol_t *symbol = pp_token.symbol;
-	symbol->pp_definition = NULL;
-	next_preprocessing_token();
+	if (out != NULL) {
+		/* pragmas are kept in the preprocessed output */
+		print_newlines();
+		if (line_has_output)
+			fputc('\n', out);
+		fputs("#pragma ", out);
+		fputs(read_directive_text(), out);
+		line_has_output = true;
+		return;
+	}
 
-	if(pp_token.type != '\n') {
-		warningf(&input.position, "extra tokens at end of #undef directive");
+	bool unknown_pragma = true;
+	if (pp_token.type == TP_IDENTIFIER && pp_token.symbol->pp_ID == TP_STDC) {
+		/* a STDC pragma */
+		next_preprocessing_token();
+		if (pp_token.type == TP_IDENTIFIER) {
+			switch (pp_token.symbol->pp_ID) {
+			case TP_FP_CONTRACT:
+			case TP_FENV_ACCESS:
+			case TP_CX_LIMITED_RANGE:
+				next_preprocessing_token();
+				if (pp_token.type == TP_IDENTIFIER
+						&& (pp_token.symbol->pp_ID == TP_ON
+						|| pp_token.symbol->pp_ID == TP_OFF
+						|| pp_token.symbol->pp_ID == TP_DEFAULT)) {
+					unknown_pragma = false;
+				} else {
+					errorf(&pp_token.source_position, "bad STDC pragma argument");
+				}
+				break;
+			default:
+				break;
+			}
+		}
 	}
-	/* eat until '\n' */
 	eat_pp_directive();
+	if (unknown_pragma && warning.unknown_pragmas) {
+		warningf(&position, "encountered unknown #pragma");
+	}
 }
 
-static const char *parse_headername(void)
+static void parse_preprocessing_directive(void)
 {
-	/* behind an #include we can have the special headername lexems.
-	 * They're only allowed behind an #include so they're not recognized
-	 * by the normal next_preprocessing_token. We handle them as a special
-	 * exception here */
+	do_print_spaces = false;
+	do_expansions   = false;
+	in_pp_directive = true;
+	eat_pp('#');
 
-	/* skip spaces so we reach start of next preprocessing token */
-	skip_spaces(false);
+	if (pp_token.type != TP_IDENTIFIER) {
+		if (pp_token.type == '\n' || pp_token.type == TP_EOF) {
+			/* the nop directive */
+		} else if (pp_token.type == TP_NUMBER && !skip_mode) {
+			if (input.guard_state != GUARD_INSIDE)
+				input.guard_state = GUARD_NONE;
+			/* GNU line marker */
+			parse_line_directive(true);
+		} else {
+			if (!skip_mode) {
+				errorf(&pp_token.source_position,
+				       "invalid preprocessing directive #%t", &pp_token);
+			}
+			eat_pp_directive();
+		}
+	} else if (skip_mode) {
+		switch(pp_token.symbol->pp_ID) {
+		case TP_if:
+			parse_if_directive();
+			break;
+		case TP_ifdef:
+		case TP_ifndef:
+			parse_ifdef_ifndef_directive();
+			break;
+		case TP_elif:
+			parse_elif_directive();
+			break;
+		case TP_else:
+			parse_else_directive();
+			break;
+		case TP_endif:
+			parse_endif_directive();
+			break;
+		default:
+			eat_pp_directive();
+			break;
+		}
+	} else {
+		source_position_t position = pp_token.source_position;
+		/* only an #ifndef may start an include guard */
+		if (input.guard_state != GUARD_INSIDE
+				&& pp_token.symbol->pp_ID != TP_ifndef)
+			input.guard_state = GUARD_NONE;
+		switch(pp_token.symbol->pp_ID) {
+		case TP_define:
+			parse_define_directive();
+			break;
+		case TP_undef:
+			parse_undef_directive();
+			break;
+		case TP_if:
+			parse_if_directive();
+			break;
+		case TP_ifdef:
+		case TP_ifndef:
+			parse_ifdef_ifndef_directive();
+			break;
+		case TP_elif:
+			parse_elif_directive();
+			break;
+		case TP_else:
+			parse_else_directive();
+			break;
+		case TP_endif:
+			parse_endif_directive();
+			break;
+		case TP_include:
+			parse_include_directive(false);
+			break;
+		case TP_include_next:
+			parse_include_directive(true);
+			break;
+		case TP_embed:
+			parse_embed_directive();
+			break;
+		case TP_line:
+			do_expansions = true;
+			next_preprocessing_token();
+			parse_line_directive(false);
+			break;
+		case TP_error:
+			next_preprocessing_token();
+			errorf(&position, "#error %s", read_directive_text());
+			break;
+		case TP_warning:
+			next_preprocessing_token();
+			warningf(&position, "#warning %s", read_directive_text());
+			break;
+		case TP_pragma:
+			parse_pragma_directive();
+			break;
+		case TP_ident:
+		case TP_sccs:
+			eat_pp_directive();
+			break;
+		default:
+			errorf(&pp_token.source_position,
+				   "invalid preprocessing directive #%t", &pp_token);
+			eat_pp_directive();
+			break;
+		}
+	}
 
-	assert(obstack_object_size(&input_obstack) == 0);
+	do_print_spaces = true;
+	do_expansions   = !skip_mode;
+	in_pp_directive = false;
 
-	/* check wether we have a "... or <... headername */
-	switch (CC) {
-	case '<':
-		/* for now until we have proper searchpath handling */
-		obstack_1grow(&input_obstack, '.');
-		obstack_1grow(&input_obstack, '/');
+	assert(pp_token.type == '\n' || pp_token.type == TP_EOF);
+}
 
-		next_char();
-		while (true) {
-			switch (CC) {
-			case EOF:
-				/* fallthrough */
-			MATCH_NEWLINE(
-				parse_error("header name without closing '>'");
-				return NULL;
-			)
-			case '>':
+/**
+ * Skips a literal in a false conditional. Unterminated literals end at the
+ * end of the line.
+ */
+static void skip_text_literal(int quote)
+{
+	eat(quote);
+	while (true) {
+		switch (CC) {
+		case '\\':
+			next_char();
+			if (CC == EOF)
+				return;
+			next_char();
+			break;
+
+		case '\r':
+		case '\n':
+		case EOF:
+			return;
+
+		default:
+			if (CC == quote) {
 				next_char();
-				goto finished_headername;
+				return;
 			}
-			obstack_1grow(&input_obstack, (char) CC);
+			input.bufpos = skip_literal_run(input.bufpos, input.bufend);
 			next_char();
+			break;
 		}
-		/* we should never be here */
+	}
+}
 
-	case '"':
-		/* for now until we have proper searchpath handling */
-		obstack_1grow(&input_obstack, '.');
-		obstack_1grow(&input_obstack, '/');
+/**
+ * Skips the lines of a false conditional without building tokens: only the
+ * characters that may start a comment, a literal or a line splice are
+ * looked at. Stops at the start of a line with a directive or at the end of
+ * the input, which are left to the lexer.
+ */
+static void skip_false_lines(void)
+{
+	while (true) {
+		skip_spaces(false);
+		if (CC == '#' || CC == '%' || CC == EOF)
+			return;
 
-		next_char();
 		while (true) {
 			switch (CC) {
-			case EOF:
-				/* fallthrough */
 			MATCH_NEWLINE(
-				parse_error("header name without closing '>'");
-				return NULL;
+				counted_newlines++;
+				counted_spaces = 0;
+				goto next_line;
 			)
+
+			case EOF:
+				return;
+
+			case '/':
+				next_char();
+				if (CC == '/') {
+					next_char();
+					skip_line_comment();
+				} else if (CC == '*') {
+					next_char();
+					skip_multiline_comment();
+				}
+				break;
+
 			case '"':
+			case '\'':
+				skip_text_literal(CC);
+				break;
+
+			default:
+				input.bufpos = skip_text_run(input.bufpos, input.bufend);
 				next_char();
-				goto finished_headername;
+				break;
 			}
-			obstack_1grow(&input_obstack, (char) CC);
-			next_char();
 		}
-		/* we should never be here */
+next_line:;
+	}
+}
 
-	default:
-		/* TODO: do normale pp_token parsing and concatenate results */
-		panic("pp_token concat include not implemented yet");
+/**
+ * Reads the next token of the preprocessor output: handles directives and
+ * skips the tokens of false conditionals.
+ */
+static void next_output_token(void)
+{
+	while (true) {
+		if (skip_mode && at_line_begin && expansion_stack == NULL
+				&& pending_newlines == 0)
+			skip_false_lines();
+		next_preprocessing_token();
+		switch (pp_token.type) {
+		case '\n':
+			at_line_begin = true;
+			if (expansion_stack == NULL)
+				free_expansion_memory();
+			continue;
+
+		case '#':
+			/* only a # read from the input at the beginning of a line starts
+			 * a directive */
+			if (at_line_begin && expansion_stack == NULL) {
+				parse_preprocessing_directive();
+				if (embed_token.type == TP_EMBED) {
+					/* the data of an #embed, the next token starts a line */
+					pp_token         = embed_token;
+					embed_token.type = TP_NULL;
+					return;
+				}
+				continue;
+			}
+			break;
+
+		case TP_EOF:
+			return;
+
+		default:
+			break;
+		}
+
+		at_line_begin = false;
+		if (skip_mode)
+			continue;
+		if (input.guard_state != GUARD_INSIDE)
+			input.guard_state = GUARD_NONE;
+		return;
+	}
+}
+
+/**
+ * Converts a preprocessing number into a number token of the parser:
+ * the suffix becomes the symbol of the token, the literal contains the
+ * digits (without the 0x prefix for hexadecimal numbers).
+ */
+static void convert_number(token_t *token)
+{
+	const char *string   = pp_token.literal.begin;
+	const char *p        = string;
+	bool        is_hex   = false;
+	bool        is_float = false;
+
+	if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		is_hex  = true;
+		string += 2;
+		p      += 2;
+		while (isxdigit((unsigned char) *p))
+			++p;
+		if (*p == '.') {
+			is_float = true;
+			++p;
+			while (isxdigit((unsigned char) *p))
+				++p;
+		}
+		if (*p == 'p' || *p == 'P') {
+			is_float = true;
+			++p;
+			if (*p == '+' || *p == '-')
+				++p;
+			while (isdigit((unsigned char) *p))
+				++p;
+		} else if (is_float) {
+			errorf(&token->source_position,
+			       "hexadecimal floatingpoint constant requires an exponent");
+		}
+	} else {
+		while (isdigit((unsigned char) *p))
+			++p;
+		if (*p == '.') {
+			is_float = true;
+			++p;
+			while (isdigit((unsigned char) *p))
+				++p;
+		}
+		if (*p == 'e' || *p == 'E') {
+			is_float = true;
+			++p;
+			if (*p == '+' || *p == '-')
+				++p;
+			while (isdigit((unsigned char) *p))
+				++p;
+		}
 	}
 
-finished_headername:
-	obstack_1grow(&input_obstack, '\0');
-	char *headername = obstack_finish(&input_obstack);
-
-	/* TODO: iterate search-path to find the file */
-
-	next_preprocessing_token();
+	size_t  size  = (size_t) (p - string);
+	char   *digits = obstack_copy0(&symbol_obstack, string, size);
+	token->literal.begin = digits;
+	token->literal.size  = size;
+
+	if (is_hex) {
+		token->type = is_float ? T_FLOATINGPOINT_HEXADECIMAL
+		                       : T_INTEGER_HEXADECIMAL;
+		if (size == 0) {
+			errorf(&token->source_position, "invalid number literal '%s'",
+			       pp_token.literal.begin);
+			token->literal.begin = "0";
+			token->literal.size  = 1;
+		}
+	} else if (is_float) {
+		token->type = T_FLOATINGPOINT;
+	} else if (digits[0] == '0') {
+		token->type = T_INTEGER_OCTAL;
+
+		/* check for invalid octal digits */
+		for (size_t i= 0; i < size; ++i) {
+			char t = digits[i];
+			if (t >= '8')
+				errorf(&token->source_position,
+				       "invalid digit '%c' in octal number", t);
+		}
+	} else {
+		token->type = T_INTEGER;
+	}
 
-	return headername;
+	/* the rest is the suffix */
+	token->symbol = NULL;
+	if (*p != '\0') {
+		for (const char *s = p; *s != '\0'; ++s) {
+			if (!isalnum((unsigned char) *s) && *s != '_') {
+				errorf(&token->source_position, "invalid number literal '%s'",
+				       pp_token.literal.begin);
+				return;
+			}
+		}
+		token->symbol = symbol_table_insert(p);
+	}
 }
 
-static bool parse_include_directive(void)
+static void grow_utf8(utf32 const tc)
 {
-	/* don't eat the TP_include here!
-	 * we need an alternative parsing for the next token */
-
-	print_spaces();
-
-	const char *headername = parse_headername();
-	if (headername == NULL) {
-		eat_pp_directive();
-		return false;
-	}
-
-	if (pp_token.type != '\n' && pp_token.type != TP_EOF) {
-		warningf(&pp_token.source_position,
-		         "extra tokens at end of #include directive");
-		eat_pp_directive();
+	struct obstack *const o  = &symbol_obstack;
+	if (tc < 0x80U) {
+		obstack_1grow(o, tc);
+	} else if (tc < 0x800) {
+		obstack_1grow(o, 0xC0 | (tc >> 6));
+		obstack_1grow(o, 0x80 | (tc & 0x3F));
+	} else if (tc < 0x10000) {
+		obstack_1grow(o, 0xE0 | ( tc >> 12));
+		obstack_1grow(o, 0x80 | ((tc >>  6) & 0x3F));
+		obstack_1grow(o, 0x80 | ( tc        & 0x3F));
+	} else {
+		obstack_1grow(o, 0xF0 | ( tc >> 18));
+		obstack_1grow(o, 0x80 | ((tc >> 12) & 0x3F));
+		obstack_1grow(o, 0x80 | ((tc >>  6) & 0x3F));
+		obstack_1grow(o, 0x80 | ( tc        & 0x3F));
 	}
+}
 
-	if (n_inputs > INCLUDE_LIMIT) {
-		errorf(&pp_token.source_position, "#include nested too deeply");
-		/* eat \n or EOF */
-		next_preprocessing_token();
-		return false;
+/**
+ * Resolves the escape sequences of a string literal or character constant
+ * the same way the lexer does.
+ */
+static void convert_literal(token_t *token, bool wide_escapes,
+                            bool size_with_zero)
+{
+	const char *c   = pp_token.literal.begin;
+	const char *end = c + pp_token.literal.size;
+	while (c < end) {
+		if (*c != '\\') {
+			obstack_1grow(&symbol_obstack, *c++);
+			continue;
+		}
+		++c;
+		utf32 tc = resolve_escape_sequence(&c, &token->source_position);
+		if (wide_escapes) {
+			grow_utf8(tc);
+		} else {
+			if (tc >= 0x100) {
+				warningf(&token->source_position,
+				         "escape sequence out of range");
+			}
+			obstack_1grow(&symbol_obstack, tc);
+		}
 	}
+	obstack_1grow(&symbol_obstack, '\0');
+	size_t  size   = obstack_object_size(&symbol_obstack);
+	char   *string = obstack_finish(&symbol_obstack);
 
-	/* we have to reenable space counting and macro expansion here,
-	 * because it is still disabled in directive parsing,
-	 * but we will trigger a preprocessing token reading of the new file
-	 * now and need expansions/space counting */
-	do_print_spaces = true;
-	do_expansions   = true;
+	token->literal = identify_string(string, size_with_zero ? size : size - 1);
+}
 
-	/* switch inputs */
-	push_input();
-	bool res = open_input(headername);
-	if (!res) {
-		errorf(&pp_token.source_position,
-		       "failed including '%s': %s", headername, strerror(errno));
-		pop_restore_input();
-		return false;
+/**
+ * Converts pp_token into a token for the parser.
+ */
+static void convert_pp_token(token_t *token)
+{
+	*token = pp_token;
+	switch (pp_token.type) {
+	case TP_IDENTIFIER:
+		token->type = pp_token.symbol->ID;
+		break;
+	case TP_NUMBER:
+		convert_number(token);
+		break;
+	case TP_STRING_LITERAL:
+		token->type = T_STRING_LITERAL;
+		convert_literal(token, false, true);
+		break;
+	case TP_WIDE_STRING_LITERAL:
+		token->type = T_WIDE_STRING_LITERAL;
+		convert_literal(token, false, true);
+		break;
+	case TP_CHARACTER_CONSTANT:
+		token->type = T_CHARACTER_CONSTANT;
+		convert_literal(token, false, false);
+		break;
+	case TP_WIDE_CHARACTER_CONSTANT:
+		token->type = T_WIDE_CHARACTER_CONSTANT;
+		convert_literal(token, true, false);
+		break;
+	case TP_EMBED:
+		token->type = T_EMBED;
+		break;
+	case TP_EOF:
+		token->type = T_EOF;
+		break;
+	case TP_ERROR:
+		token->type = T_ERROR;
+		break;
+	default:
+		/* punctuators have the same values */
+		break;
 	}
+}
 
-	return true;
+void preprocessor_next_token(void)
+{
+	next_output_token();
+	convert_pp_token(&lexer_token);
 }
 
-static pp_conditional_t *push_conditional(void)
+void preprocessor_write_text(FILE *output)
 {
-	pp_conditional_t *conditional
-		= obstack_alloc(&pp_obstack, sizeof(*conditional));
-	memset(conditional, 0, sizeof(*conditional));
+	out = output;
 
-	conditional->parent = conditional_stack;
-	conditional_stack   = conditional;
+	/* this is here so we can directly compare "gcc -E" output and our
+	 * output */
+	const presumed_position_t *main_position = input_stack != NULL
+		? &input_stack->position : &input.position;
+	print_line_directive(main_position, NULL);
+	if (input_stack != NULL)
+		print_line_directive(&input.position, NULL);
 
-	return conditional;
+	while (true) {
+		next_output_token();
+		if (pp_token.type == TP_EOF)
+			break;
+		emit_pp_token();
+	}
+	if (line_has_output)
+		fputc('\n', out);
 }
 
-static void pop_conditional(void)
+/**
+ * Inserts a search path entry at *anchor, anchors pointing to the same
+ * place belong to later parts of the search path and move behind the entry.
+ */
+static void insert_searchpath_entry(searchpath_entry_t *entry,
+                                    searchpath_entry_t ***anchor)
 {
-	assert(conditional_stack != NULL);
-	conditional_stack = conditional_stack->parent;
+	searchpath_entry_t **place = *anchor;
+	entry->next = *place;
+	*place      = entry;
+	if (user_searchpath_anchor == place)
+		user_searchpath_anchor = &entry->next;
+	if (system_searchpath_anchor == place)
+		system_searchpath_anchor = &entry->next;
+	*anchor = &entry->next;
 }
 
-static void check_unclosed_conditionals(void)
+void add_include_path(const char *path, bool is_system_dir)
 {
-	while (conditional_stack != NULL) {
-		pp_conditional_t *conditional = conditional_stack;
+	searchpath_entry_t *entry = XMALLOCZ(searchpath_entry_t);
+	entry->path          = xstrdup(path);
+	entry->is_system_dir = is_system_dir;
 
-		if (conditional->in_else) {
-			errorf(&conditional->source_position, "unterminated #else");
-		} else {
-			errorf(&conditional->source_position, "unterminated condition");
-		}
-		pop_conditional();
-	}
+	/* user directories are searched before the system directories */
+	insert_searchpath_entry(entry, is_system_dir ? &system_searchpath_anchor
+	                                             : &user_searchpath_anchor);
 }
 
-static void parse_ifdef_ifndef_directive(void)
+void add_quote_include_path(const char *path)
 {
-	bool is_ifndef = (pp_token.type == TP_ifndef);
-	bool condition;
-	next_preprocessing_token();
-
-	if (skip_mode) {
-		eat_pp_directive();
-		pp_conditional_t *conditional = push_conditional();
-		conditional->source_position  = pp_token.source_position;
-		conditional->skip             = true;
-		return;
-	}
-
-	if (pp_token.type != TP_IDENTIFIER) {
-		errorf(&pp_token.source_position,
-		       "expected identifier after #%s, got '%t'",
-		       is_ifndef ? "ifndef" : "ifdef", &pp_token);
-		eat_pp_directive();
-
-		/* just take the true case in the hope to avoid further errors */
-		condition = true;
-	} else {
-		symbol_t        *symbol        = pp_token.symbol;
-		pp_definition_t *pp_definition = symbol->pp_definition;
-		next_preprocessing_token();
-
-		if (pp_token.type != '\n') {
-			errorf(&pp_token.source_position,
-			       "extra tokens at end of #%s",
-			       is_ifndef ? "ifndef" : "ifdef");
-			eat_pp_directive();
-		}
+	searchpath_entry_t *entry = XMALLOCZ(searchpath_entry_t);
+	entry->path = xstrdup(path);
+	insert_searchpath_entry(entry, &quote_searchpath_anchor);
+}
 
-		/* evaluate wether we are in true or false case */
-		condition = is_ifndef ? pp_definition == NULL : pp_definition != NULL;
+void cache_include_directories(void)
+{
+	for (searchpath_entry_t *entry = searchpath; entry != NULL;
+	     entry = entry->next) {
+		if (entry->directory == NULL)
+			entry->directory = get_include_dir(entry->path, strlen(entry->path));
+		read_include_dir(entry->directory);
 	}
+}
 
-	pp_conditional_t *conditional = push_conditional();
-	conditional->source_position  = pp_token.source_position;
-	conditional->condition        = condition;
+void add_define(const char *name, const char *value, bool standard_define)
+{
+	struct obstack *obst = standard_define ? &builtin_defines : &user_defines;
+	obstack_printf(obst, "#define %s %s\n", name, value != NULL ? value : "1");
+}
 
-	if (!condition) {
-		skip_mode = true;
-	}
+void add_undef(const char *name)
+{
+	obstack_printf(&user_defines, "#undef %s\n", name);
 }
 
-static void parse_else_directive(void)
+void clear_standard_defines(void)
 {
-	eat_pp(TP_else);
+	size_t size = obstack_object_size(&builtin_defines);
+	if (size > 0)
+		obstack_blank(&builtin_defines, -(int) size);
+}
 
-	if (pp_token.type != '\n') {
-		if (!skip_mode) {
-			warningf(&pp_token.source_position, "extra tokens at end of #else");
-		}
-		eat_pp_directive();
-	}
+/**
+ * Resets the state for a new main source file.
+ */
+static void begin_main_input(void)
+{
+	assert(input_stack == NULL && expansion_stack == NULL);
+	conditional_stack = NULL;
+	skip_mode         = false;
+	do_expansions     = true;
+	do_print_spaces   = true;
+	in_pp_directive   = false;
+	at_line_begin     = true;
+	pending_newlines  = 0;
+	line_has_output   = false;
+	pending_space     = false;
+	counted_newlines  = 0;
+	counted_spaces    = 0;
+	counter           = 0;
+
+	++current_unit;
+	include_cache_new_unit();
+}
 
-	pp_conditional_t *conditional = conditional_stack;
-	if (conditional == NULL) {
-		errorf(&pp_token.source_position, "#else without prior #if");
-		return;
+/**
+ * Starts reading the main source file opened in input.
+ */
+static void enter_main_input(const char *input_name)
+{
+	if (pp_stats_format != PP_STATS_NONE) {
+		pp_stats_begin_unit(input_name);
+		begin_header_stats();
 	}
+	begin_position_segment(input.bufpos, 0);
+	next_char();
 
-	if (conditional->in_else) {
-		errorf(&pp_token.source_position,
-		       "#else after #else (condition started %P)",
-		       conditional->source_position);
-		skip_mode = true;
-		return;
+	/* the predefined macros and the -D/-U options are processed like an
+	 * input file in front of the main file */
+	size_t builtin_len = obstack_object_size(&builtin_defines);
+	size_t user_len    = obstack_object_size(&user_defines);
+	if (builtin_len + user_len > 0) {
+		char *text = XMALLOCN(char, builtin_len + user_len);
+		memcpy(text, obstack_base(&builtin_defines), builtin_len);
+		memcpy(text + builtin_len, obstack_base(&user_defines), user_len);
+
+		uint32_t last_loc = current_position().loc;
+		push_input();
+		open_buffer_input(text, builtin_len + user_len, "<command-line>");
+		input.free_buf = true;
+		begin_position_segment(input.bufpos, last_loc);
+		next_char();
 	}
+}
 
-	conditional->in_else = true;
-	if (!conditional->skip) {
-		skip_mode = conditional->condition;
-	}
-	conditional->source_position = pp_token.source_position;
+void preprocessor_open_stream(FILE *stream, const char *input_name)
+{
+	begin_main_input();
+	open_file_input(stream, input_name, NULL);
+	struct stat st;
+	int         fd = fileno(stream);
+	if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		input.file_info = get_pp_file(&st);
+	enter_main_input(input_name);
 }
 
-static void parse_endif_directive(void)
+void preprocessor_open_buffer(char *text, size_t len, const char *input_name)
 {
-	eat_pp(TP_endif);
+	begin_main_input();
+	open_buffer_input(text, len, input_name);
+	enter_main_input(input_name);
+}
 
-	if (pp_token.type != '\n') {
-		if (!skip_mode) {
-			warningf(&pp_token.source_position,
-			         "extra tokens at end of #endif");
-		}
-		eat_pp_directive();
+void preprocessor_close(void)
+{
+	/* leave all inputs when we stopped early */
+	while (input_stack != NULL) {
+		close_input();
+		pop_restore_input();
 	}
+	close_input();
 
-	pp_conditional_t *conditional = conditional_stack;
-	if (conditional == NULL) {
-		errorf(&pp_token.source_position, "#endif without prior #if");
-		return;
+	while (expansion_stack != NULL) {
+		pop_expansion();
 	}
+	free_expansion_memory();
+	free_embedded_files();
+	embed_token.type = TP_NULL;
+	out = NULL;
 
-	if (!conditional->skip) {
-		skip_mode = false;
-	}
-	pop_conditional();
+	if (pp_stats_format != PP_STATS_NONE)
+		pp_stats_print(stderr);
 }
 
-static void parse_preprocessing_directive(void)
+void init_preprocessor(void)
 {
-	do_print_spaces = false;
-	do_expansions   = false;
-	eat_pp('#');
+	obstack_init(&pp_obstack);
+	obstack_init(&input_obstack);
+	obstack_init(&expansion_obstack);
+	obstack_init(&builtin_defines);
+	obstack_init(&user_defines);
+	expansion_obstack_start = obstack_alloc(&expansion_obstack, 1);
+	_pp_fileset_init(&pp_files);
+	init_include_cache();
+	init_pp_stats();
+
+	symbol_va_args = symbol_table_insert("__VA_ARGS__");
+}
 
-	if (skip_mode) {
-		switch(pp_token.type) {
-		case TP_ifdef:
-		case TP_ifndef:
-			parse_ifdef_ifndef_directive();
-			break;
-		case TP_else:
-			parse_else_directive();
-			break;
-		case TP_endif:
-			parse_endif_directive();
-			break;
-		default:
-			eat_pp_directive();
-			break;
-		}
-	} else {
-		switch(pp_token.type) {
-		case TP_define:
-			parse_define_directive();
-			break;
-		case TP_undef:
-			parse_undef_directive();
-			break;
-		case TP_ifdef:
-		case TP_ifndef:
-			parse_ifdef_ifndef_directive();
-			break;
-		case TP_else:
-			parse_else_directive();
-			break;
-		case TP_endif:
-			parse_endif_directive();
-			break;
-		case TP_include: {
-			bool in_new_source = parse_include_directive();
-			/* no need to do anything if source file switched */
-			if (in_new_source)
-				return;
-			break;
-		}
-		case '\n':
-			/* the nop directive */
-			break;
-		default:
-			errorf(&pp_token.source_position,
-				   "invalid preprocessing directive #%t", &pp_token);
-			eat_pp_directive();
-			break;
-		}
+void exit_preprocessor(void)
+{
+	searchpath_entry_t *next;
+	for (searchpath_entry_t *entry = searchpath; entry != NULL; entry = next) {
+		next = entry->next;
+		free((char*) entry->path);
+		free(entry);
 	}
+	searchpath               = NULL;
+	quote_searchpath_anchor  = &searchpath;
+	user_searchpath_anchor   = &searchpath;
+	system_searchpath_anchor = &searchpath;
+
+	exit_include_cache();
+	exit_pp_stats();
+
+	pp_expansion_state_t *next_state;
+	for (pp_expansion_state_t *state = free_expansion_states; state != NULL;
+	     state = next_state) {
+		next_state = state->parent;
+		DEL_ARR_F(state->buffer);
+		DEL_ARR_F(state->argument_tokens);
+		DEL_ARR_F(state->arguments);
+		DEL_ARR_F(state->expanded_tokens);
+		free(state);
+	}
+	free_expansion_states = NULL;
 
-	do_print_spaces = true;
-	do_expansions   = true;
-
-	/* eat '\n' */
-	assert(pp_token.type == '\n' || pp_token.type == TP_EOF);
-	next_preprocessing_token();
+	_pp_fileset_destroy(&pp_files);
+	obstack_free(&user_defines, NULL);
+	obstack_free(&builtin_defines, NULL);
+	obstack_free(&expansion_obstack, NULL);
+	obstack_free(&input_obstack, NULL);
+	obstack_free(&pp_obstack, NULL);
 }
 
-#define GCC_COMPAT_MODE
-
 int pptest_main(int argc, char **argv);
 int pptest_main(int argc, char **argv)
 {
 	init_symbol_table();
+	init_source_positions();
 	init_tokens();
-
-	obstack_init(&pp_obstack);
-	obstack_init(&input_obstack);
+	init_preprocessor();
 
 	const char *filename = "t.c";
-	if (argc > 1)
-		filename = argv[1];
-
-	out = stdout;
-
-#ifdef GCC_COMPAT_MODE
-	/* this is here so we can directly compare "gcc -E" output and our output */
-	fprintf(out, "# 1 \"%s\"\n", filename);
-	fputs("# 1 \"<built-in>\"\n", out);
-	fputs("# 1 \"<command-line>\"\n", out);
-#endif
-
-	bool ok = open_input(filename);
-	assert(ok);
-
-	while(true) {
-		/* we're at a line begin */
-		if(pp_token.type == '#') {
-			parse_preprocessing_directive();
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (strncmp(arg, "-I", 2) == 0) {
+			add_include_path(arg + 2, false);
+		} else if (strncmp(arg, "-isystem", 8) == 0) {
+			add_include_path(arg + 8, true);
+		} else if (strncmp(arg, "-iquote", 7) == 0) {
+			add_quote_include_path(arg + 7);
+		} else if (strcmp(arg, "--pp-stats") == 0) {
+			pp_stats_format = PP_STATS_TEXT;
+		} else if (strcmp(arg, "--pp-stats=json") == 0) {
+			pp_stats_format = PP_STATS_JSON;
+		} else if (strncmp(arg, "-D", 2) == 0) {
+			char *name  = xstrdup(arg + 2);
+			char *value = strchr(name, '=');
+			if (value != NULL)
+				*value++ = '\0';
+			add_define(name, value, false);
+			free(name);
 		} else {
-			/* parse+emit a line */
-			while(pp_token.type != '\n') {
-				if(pp_token.type == TP_EOF)
-					goto end_of_main_loop;
-				emit_pp_token();
-				next_preprocessing_token();
-			}
-			emit_pp_token();
-			next_preprocessing_token();
+			filename = arg;
 		}
 	}
-end_of_main_loop:
 
-	check_unclosed_conditionals();
-	close_input();
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Couldn't open '%s': %s\n", filename, strerror(errno));
+		return EXIT_FAILURE;
+	}
 
-	obstack_free(&input_obstack, NULL);
-	obstack_free(&pp_obstack, NULL);
+	preprocessor_open_stream(file, filename);
+	preprocessor_write_text(stdout);
+	preprocessor_close();
+	fclose(file);
 
+	exit_preprocessor();
 	exit_tokens();
+	exit_source_positions();
 	exit_symbol_table();
 
-	return 0;
+	return error_count > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,92 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+void init_preprocessor(void);
+void exit_preprocessor(void);
+
+/**
+ * Appends a directory to the include search path. Directories added with
+ * is_system_dir set are searched after all user directories.
+ */
+void add_include_path(const char *path, bool is_system_dir);
+
+/**
+ * Appends a directory to the search path of "quoted" includes (-iquote),
+ * searched before all other directories.
+ */
+void add_quote_include_path(const char *path);
+
+/**
+ * Reads the listings of all directories in the include search path, so
+ * processes forked afterwards share them.
+ */
+void cache_include_directories(void);
+
+/**
+ * Defines a macro as if by "#define name value". A NULL value defines the
+ * macro as "1". Standard defines are processed before the user defines.
+ */
+void add_define(const char *name, const char *value, bool standard_define);
+
+/**
+ * Undefines a macro as if by "#undef name" after all defines.
+ */
+void add_undef(const char *name);
+
+/**
+ * Removes all standard defines (needed when the language changes between
+ * two source files).
+ */
+void clear_standard_defines(void);
+
+/**
+ * Start preprocessing of a new main source file.
+ */
+void preprocessor_open_stream(FILE *stream, const char *input_name);
+
+/**
+ * Start preprocessing of a main source file in memory. The text is lexed in
+ * place and must stay alive and writable until preprocessor_close().
+ */
+void preprocessor_open_buffer(char *text, size_t len, const char *input_name);
+
+/**
+ * Finish preprocessing of the current main source file.
+ */
+void preprocessor_close(void);
+
+/**
+ * Fetch the next fully preprocessed token and convert it into a parser token
+ * in lexer_token.
+ */
+void preprocessor_next_token(void);
+
+/**
+ * Preprocess the whole opened source file and write the result as text
+ * (like "cpp" would do).
+ */
+void preprocessor_write_text(FILE *output);
+
+#endif
@@ -0,0 +1,49 @@
+/* needs -Ipreproctest for the <> lookup, with -E the data is printed as a
+ * list of numbers */
+static const unsigned char quoted[] = {
+#embed "embed.dat"
+};
+static const unsigned char angled[] = {
+#embed <embed.dat>
+};
+static const unsigned char empty[] = {
+#embed "embedempty.dat"
+	0
+};
+
+/* the arrays are sized by the resource */
+typedef char check_quoted[sizeof(quoted) == 8 ? 1 : -1];
+typedef char check_angled[sizeof(angled) == 8 ? 1 : -1];
+typedef char check_empty[sizeof(empty) == 1 ? 1 : -1];
+
+/* every byte initializes a whole element */
+static const int ints[] = {
+	-1,
+#embed "embed.dat"
+	, -2
+};
+typedef char check_ints[sizeof(ints) == 10 * sizeof(int) ? 1 : -1];
+
+/* elements which can't be packed get one value initializer per byte */
+static const unsigned long ulongs[] = {
+#embed "embed.dat"
+};
+static const double doubles[] = {
+#embed "embed.dat"
+};
+
+static const struct {
+	short s;
+	long  l[3];
+	char  rest[4];
+} mixed = {
+#embed "embed.dat"
+};
+
+int main(void)
+{
+	return quoted[0] == 'c' && angled[7] == '\n' && empty[0] == 0
+	    && ints[1] == 'c' && ints[9] == -2 && mixed.s == 'c'
+	    && mixed.l[2] == 'r' && ulongs[0] == 'c' && doubles[7] == '\n'
+	    && mixed.rest[3] == '\n' ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+/* #embed only works in initializer lists of arithmetic elements */
+int f(void)
+{
+	return
+#embed "embed.dat"
+	;
+}
+
+static const char *const pointers[] = {
+#embed "embed.dat"
+};
@@ -0,0 +1,5 @@
+#ifndef GUARDAFTER_H
+#define GUARDAFTER_H
+guarded_once
+#endif
+after_guard_twice
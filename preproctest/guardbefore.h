@@ -0,0 +1,5 @@
+before_guard_twice
+#ifndef GUARDBEFORE_H
+#define GUARDBEFORE_H
+guarded_once
+#endif
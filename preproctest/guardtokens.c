@@ -0,0 +1,4 @@
+#include "preproctest/guardbefore.h"
+#include "preproctest/guardbefore.h"
+#include "preproctest/guardafter.h"
+#include "preproctest/guardafter.h"
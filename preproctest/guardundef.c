@@ -0,0 +1,4 @@
+#include "preproctest/guardundef.h"
+#undef GUARDUNDEF_H
+#include "preproctest/guardundef.h"
+#include "preproctest/guardundef.h"
@@ -0,0 +1,4 @@
+#ifndef GUARDUNDEF_H
+#define GUARDUNDEF_H
+read_twice
+#endif
@@ -0,0 +1,8 @@
+int f(void)
+{
+	char a[] = { 1/0 };
+	return a[0];
+}
+
+static const unsigned char packed[] = { 1, 2, 1/0, 3, 300.0e40, 4 };
+static const short mixed[] = { -1, 0x7fff, 1%0, -0x8000 };
@@ -0,0 +1,3 @@
+#define z z[0]
+#define q(a) a + z
+q(z)
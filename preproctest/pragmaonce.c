@@ -0,0 +1,3 @@
+#include "preproctest/once.h"
+#include "preproctest/../preproctest/once.h"
+#include "./preproctest/once.h"
@@ -0,0 +1,448 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <config.h>
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "server.h"
+#include "adt/xmalloc.h"
+
+#ifdef _WIN32
+
+void compile_server_run(const char *socket_path, int *argc, char ***argv)
+{
+	(void) socket_path;
+	(void) argc;
+	(void) argv;
+	fprintf(stderr, "error: compile server not supported on this host\n");
+	exit(EXIT_FAILURE);
+}
+
+int compile_server_submit(const char *socket_path, int argc, char **argv)
+{
+	(void) socket_path;
+	(void) argc;
+	(void) argv;
+	return -1;
+}
+
+void compile_server_reject_job(void)
+{
+	fprintf(stderr, "error: compile server job rejected\n");
+	exit(EXIT_FAILURE);
+}
+
+#else
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/** the standard streams of the client are passed along with a job */
+#define N_JOB_FDS 3
+
+/** reported to the client instead of an exit status if the server can't
+ * run its job */
+#define JOB_REJECTED (-1)
+
+extern char **environ;
+
+/** header of a job, followed by the working directory, the arguments and the
+ * environment */
+typedef struct job_header_t {
+	uint32_t argc;
+	uint32_t n_env;
+	uint32_t payload_size;
+} job_header_t;
+
+/** write end of the pipe used by compile_server_reject_job() */
+static int reject_fd = -1;
+
+static bool write_all(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+	while (size > 0) {
+		ssize_t res = write(fd, p, size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p    += res;
+		size -= res;
+	}
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t size)
+{
+	char *p = buf;
+	while (size > 0) {
+		ssize_t res = read(fd, p, size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (res == 0)
+			return false;
+		p    += res;
+		size -= res;
+	}
+	return true;
+}
+
+static bool init_address(struct sockaddr_un *address, const char *socket_path)
+{
+	size_t len = strlen(socket_path);
+	if (len >= sizeof(address->sun_path)) {
+		fprintf(stderr, "error: socket path '%s' too long\n", socket_path);
+		return false;
+	}
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	memcpy(address->sun_path, socket_path, len + 1);
+	return true;
+}
+
+int compile_server_submit(const char *socket_path, int argc, char **argv)
+{
+	struct sockaddr_un address;
+	if (!init_address(&address, socket_path))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	uint32_t n_env        = 0;
+	size_t   payload_size = strlen(cwd) + 1;
+	for (int i = 0; i < argc; ++i) {
+		payload_size += strlen(argv[i]) + 1;
+	}
+	for (char **env = environ; *env != NULL; ++env) {
+		payload_size += strlen(*env) + 1;
+		++n_env;
+	}
+	char *payload = XMALLOCN(char, payload_size);
+	char *p       = payload;
+	size_t len    = strlen(cwd) + 1;
+	memcpy(p, cwd, len);
+	p += len;
+	for (int i = 0; i < argc; ++i) {
+		len = strlen(argv[i]) + 1;
+		memcpy(p, argv[i], len);
+		p += len;
+	}
+	for (char **env = environ; *env != NULL; ++env) {
+		len = strlen(*env) + 1;
+		memcpy(p, *env, len);
+		p += len;
+	}
+
+	/* the header carries our standard streams */
+	job_header_t header;
+	header.argc         = argc;
+	header.n_env        = n_env;
+	header.payload_size = payload_size;
+
+	struct iovec iov;
+	iov.iov_base = &header;
+	iov.iov_len  = sizeof(header);
+
+	union {
+		struct cmsghdr header;
+		char           buf[CMSG_SPACE(N_JOB_FDS * sizeof(int))];
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov        = &iov;
+	message.msg_iovlen     = 1;
+	message.msg_control    = control.buf;
+	message.msg_controllen = sizeof(control.buf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(N_JOB_FDS * sizeof(int));
+	int *fds = (int*) CMSG_DATA(cmsg);
+	for (int i = 0; i < N_JOB_FDS; ++i) {
+		fds[i] = i;
+	}
+
+	int status = -1;
+	if (sendmsg(fd, &message, 0) == (ssize_t) sizeof(header)
+			&& write_all(fd, payload, payload_size)) {
+		int32_t result;
+		if (read_all(fd, &result, sizeof(result))) {
+			/* a rejected job is compiled locally */
+			status = result == JOB_REJECTED ? -1 : result;
+		} else {
+			fprintf(stderr, "error: compile server aborted the job\n");
+			status = EXIT_FAILURE;
+		}
+	}
+	free(payload);
+	close(fd);
+	return status;
+}
+
+/**
+ * Receive a job from the client connected on fd. The standard streams of
+ * the client are stored in fds.
+ */
+static char *receive_job(int fd, int *fds, uint32_t *argc, uint32_t *n_env)
+{
+	job_header_t header;
+	struct iovec iov;
+	iov.iov_base = &header;
+	iov.iov_len  = sizeof(header);
+
+	union {
+		struct cmsghdr header;
+		char           buf[CMSG_SPACE(N_JOB_FDS * sizeof(int))];
+	} control;
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov        = &iov;
+	message.msg_iovlen     = 1;
+	message.msg_control    = control.buf;
+	message.msg_controllen = sizeof(control.buf);
+
+	ssize_t res;
+	do {
+		res = recvmsg(fd, &message, 0);
+	} while (res < 0 && errno == EINTR);
+	if (res != (ssize_t) sizeof(header))
+		return NULL;
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+			|| cmsg->cmsg_type != SCM_RIGHTS
+			|| cmsg->cmsg_len != CMSG_LEN(N_JOB_FDS * sizeof(int)))
+		return NULL;
+	memcpy(fds, CMSG_DATA(cmsg), N_JOB_FDS * sizeof(int));
+
+	if (header.argc == 0 || header.payload_size == 0)
+		return NULL;
+	char *payload = XMALLOCN(char, header.payload_size);
+	if (!read_all(fd, payload, header.payload_size)
+			|| payload[header.payload_size - 1] != '\0') {
+		free(payload);
+		return NULL;
+	}
+	/* the working directory, the arguments and the environment */
+	size_t n_strings = 0;
+	for (uint32_t i = 0; i < header.payload_size; ++i) {
+		if (payload[i] == '\0')
+			++n_strings;
+	}
+	if (n_strings != 1 + (size_t) header.argc + header.n_env) {
+		free(payload);
+		return NULL;
+	}
+	*argc  = header.argc;
+	*n_env = header.n_env;
+	return payload;
+}
+
+/**
+ * Check that the client connected on fd runs as the same user as the server.
+ */
+static bool is_own_client(int fd)
+{
+#ifdef SO_PEERCRED
+	struct ucred credentials;
+	socklen_t    len = sizeof(credentials);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &len) != 0)
+		return false;
+	return credentials.uid == getuid();
+#else
+	/* only the owner can connect to the socket (see compile_server_run) */
+	(void) fd;
+	return true;
+#endif
+}
+
+/**
+ * Handle a single connection. Runs in a process of its own, which forks the
+ * actual job and reports its exit status back to the client.
+ */
+static void serve_connection(int fd, int *argc, char ***argv)
+{
+	if (!is_own_client(fd))
+		_exit(EXIT_FAILURE);
+
+	int      fds[N_JOB_FDS];
+	uint32_t job_argc;
+	uint32_t n_env;
+	char    *payload = receive_job(fd, fds, &job_argc, &n_env);
+	if (payload == NULL)
+		_exit(EXIT_FAILURE);
+
+	/* the job writes to this pipe if it rejects itself */
+	int reject_pipe[2];
+	if (pipe(reject_pipe) != 0)
+		_exit(EXIT_FAILURE);
+
+	pid_t pid = fork();
+	if (pid < 0)
+		_exit(EXIT_FAILURE);
+
+	if (pid == 0) {
+		/* the job: take over the environment of the client */
+		const char *cwd = payload;
+		if (chdir(cwd) != 0)
+			_exit(EXIT_FAILURE);
+		for (int i = 0; i < N_JOB_FDS; ++i) {
+			dup2(fds[i], i);
+			close(fds[i]);
+		}
+		close(fd);
+		close(reject_pipe[0]);
+		/* programs started by the job must not keep the pipe open */
+		fcntl(reject_pipe[1], F_SETFD, FD_CLOEXEC);
+		reject_fd = reject_pipe[1];
+
+		char **job_argv = XMALLOCN(char*, job_argc + 1);
+		char  *p        = payload + strlen(cwd) + 1;
+		for (uint32_t i = 0; i < job_argc; ++i) {
+			job_argv[i] = p;
+			p += strlen(p) + 1;
+		}
+		job_argv[job_argc] = NULL;
+
+		clearenv();
+		for (uint32_t i = 0; i < n_env; ++i) {
+			putenv(p);
+			p += strlen(p) + 1;
+		}
+
+		*argc = (int) job_argc;
+		*argv = job_argv;
+		return;
+	}
+
+	for (int i = 0; i < N_JOB_FDS; ++i) {
+		close(fds[i]);
+	}
+	close(reject_pipe[1]);
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			_exit(EXIT_FAILURE);
+	}
+	int32_t result = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+	char    rejected;
+	if (read(reject_pipe[0], &rejected, 1) == 1)
+		result = JOB_REJECTED;
+	write_all(fd, &result, sizeof(result));
+	_exit(EXIT_SUCCESS);
+}
+
+void compile_server_reject_job(void)
+{
+	char rejected = 1;
+	if (reject_fd >= 0 && write(reject_fd, &rejected, 1) == 1)
+		_exit(EXIT_FAILURE);
+	/* not a server job: nobody can compile it instead */
+	fprintf(stderr, "error: compile server job rejected\n");
+	exit(EXIT_FAILURE);
+}
+
+void compile_server_run(const char *socket_path, int *argc, char ***argv)
+{
+	struct sockaddr_un address;
+	if (!init_address(&address, socket_path))
+		exit(EXIT_FAILURE);
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		fprintf(stderr, "error: couldn't create socket: %s\n",
+		        strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	unlink(socket_path);
+	/* jobs run with our permissions, so only we may connect */
+	mode_t old_umask = umask(0077);
+	int    res       = bind(listen_fd, (struct sockaddr*) &address,
+	                        sizeof(address));
+	umask(old_umask);
+	if (res < 0 || chmod(socket_path, 0600) < 0
+			|| listen(listen_fd, 64) < 0) {
+		fprintf(stderr, "error: couldn't listen on '%s': %s\n", socket_path,
+		        strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/* connection handlers are never waited for */
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "error: accept failed: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		fflush(NULL);
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(listen_fd);
+			signal(SIGCHLD, SIG_DFL);
+			serve_connection(fd, argc, argv);
+			return;
+		}
+		if (pid < 0) {
+			fprintf(stderr, "error: couldn't fork: %s\n", strerror(errno));
+		}
+		close(fd);
+	}
+}
+
+#endif
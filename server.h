@@ -0,0 +1,49 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+/**
+ * Run a compile server listening on the unix domain socket socket_path.
+ * Every job is compiled in a process forked from the server, so the state
+ * initialized by the server is reused while nothing a job does leaks into
+ * the next one.
+ *
+ * This function only returns inside such a job process: its working
+ * directory and standard streams are those of the client and argc/argv
+ * are replaced by the command line of the client.
+ */
+void compile_server_run(const char *socket_path, int *argc, char ***argv);
+
+/**
+ * Called in a job process if the job can't be compiled by this server (e.g.
+ * because it was started with a different target). Ends the job, the client
+ * compiles the command line on its own.
+ */
+void compile_server_reject_job(void);
+
+/**
+ * Let the compile server at socket_path execute the given command line.
+ *
+ * @return the exit status of the job or -1 if no server could be reached
+ */
+int compile_server_submit(const char *socket_path, int argc, char **argv);
+
+#endif
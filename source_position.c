@@ -0,0 +1,148 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <config.h>
+
+#include <assert.h>
+
+#include "source_position.h"
+#include "adt/array.h"
+#include "adt/error.h"
+
+/**
+ * A run of consecutive locations of one input between two changes of the
+ * presumed input name or line (entering or leaving an include, #line).
+ */
+typedef struct source_segment_t source_segment_t;
+struct source_segment_t {
+	uint32_t    base;        /**< first location of the segment */
+	size_t      first_line;  /**< index of base in line_starts */
+	const char *input_name;  /**< presumed input name */
+	unsigned    linenr;      /**< presumed line number at base */
+};
+
+static source_segment_t *segments;
+/** locations where lines start, increasing over all segments */
+static uint32_t         *line_starts;
+static uint32_t          next_loc;
+
+void init_source_positions(void)
+{
+	segments    = NEW_ARR_F(source_segment_t, 0);
+	line_starts = NEW_ARR_F(uint32_t, 0);
+	next_loc    = SOURCE_LOC_BUILTIN + 1;
+}
+
+void exit_source_positions(void)
+{
+	DEL_ARR_F(line_starts);
+	DEL_ARR_F(segments);
+}
+
+uint32_t source_segment_begin(const char *input_name, unsigned linenr,
+                              uint32_t last_loc)
+{
+	uint64_t base = last_loc >= next_loc ? (uint64_t) last_loc + 1 : next_loc;
+	if (base >= UINT32_MAX)
+		panic("too much source code for 32 bit source positions");
+
+	source_segment_t segment;
+	segment.base       = (uint32_t) base;
+	segment.first_line = ARR_LEN(line_starts);
+	segment.input_name = input_name;
+	segment.linenr     = linenr;
+	ARR_APP1(source_segment_t, segments, segment);
+	/* the segment starts a (partial) line */
+	ARR_APP1(uint32_t, line_starts, (uint32_t) base);
+
+	next_loc = (uint32_t) base + 1;
+	return (uint32_t) base;
+}
+
+void source_locations_check(uint32_t loc, size_t n)
+{
+	if ((uint64_t) loc + n >= UINT32_MAX)
+		panic("too much source code for 32 bit source positions");
+}
+
+void source_line_begin(uint32_t loc)
+{
+	assert(loc >= line_starts[ARR_LEN(line_starts) - 1]);
+	ARR_APP1(uint32_t, line_starts, loc);
+	if (loc >= next_loc)
+		next_loc = loc + 1;
+}
+
+void get_presumed_position(const source_position_t *pos,
+                           presumed_position_t *presumed)
+{
+	uint32_t loc  = pos->loc;
+	size_t   n    = segments != NULL ? ARR_LEN(segments) : 0;
+	if (loc <= SOURCE_LOC_BUILTIN || n == 0 || loc < segments[0].base) {
+		presumed->input_name
+			= loc == SOURCE_LOC_BUILTIN ? "<built-in>" : NULL;
+		presumed->linenr = 0;
+		presumed->colnr  = 0;
+		return;
+	}
+
+	/* last segment starting at or before loc */
+	size_t lo = 0;
+	size_t hi = n;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (segments[mid].base <= loc) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	const source_segment_t *segment = &segments[lo];
+
+	/* last line of the segment starting at or before loc */
+	lo = segment->first_line;
+	hi = segment + 1 < segments + n
+		? segment[1].first_line : ARR_LEN(line_starts);
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (line_starts[mid] <= loc) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	presumed->input_name = segment->input_name;
+	presumed->linenr     = segment->linenr + (unsigned) (lo - segment->first_line);
+	presumed->colnr      = loc - line_starts[lo] + 1;
+}
+
+const char *get_source_position_input_name(const source_position_t *pos)
+{
+	presumed_position_t presumed;
+	get_presumed_position(pos, &presumed);
+	return presumed.input_name;
+}
+
+unsigned get_source_position_linenr(const source_position_t *pos)
+{
+	presumed_position_t presumed;
+	get_presumed_position(pos, &presumed);
+	return presumed.linenr;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2007-2009 Matthias Braun <matze@braunis.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef SOURCE_POSITION_H
+#define SOURCE_POSITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A position in the source code, encoded as a 32 bit location. Every input
+ * character read gets its own location; the preprocessor and the lexer
+ * register where lines and inputs start, so file name, line and column are
+ * only decoded when a diagnostic or debug info needs them.
+ */
+typedef struct source_position_t source_position_t;
+struct source_position_t {
+	uint32_t loc;
+};
+
+/** location of unknown positions (not set) */
+#define SOURCE_LOC_UNKNOWN 0
+/** location of builtin_source_position */
+#define SOURCE_LOC_BUILTIN 1
+
+/**
+ * A decoded source position. File name and line are the presumed ones,
+ * i.e. they respect #line directives.
+ */
+typedef struct presumed_position_t presumed_position_t;
+struct presumed_position_t {
+	const char *input_name;
+	unsigned    linenr;
+	unsigned    colnr;   /**< starting at 1, 0 if unknown */
+};
+
+void init_source_positions(void);
+void exit_source_positions(void);
+
+/**
+ * Starts a new segment of locations, used when entering or returning to an
+ * input and after a #line directive.
+ *
+ * @param input_name  the presumed name of the input
+ * @param linenr      the presumed line number at the start of the segment
+ * @param last_loc    the last location handed out so far
+ * @return the first location of the segment, the following characters get
+ *         consecutive locations
+ */
+uint32_t source_segment_begin(const char *input_name, unsigned linenr,
+                              uint32_t last_loc);
+
+/**
+ * Checks that the n locations following loc, which the current segment is
+ * about to use, fit into 32 bits. Aborts otherwise.
+ */
+void source_locations_check(uint32_t loc, size_t n);
+
+/**
+ * Registers loc as the start of the next line of the current segment.
+ * Locations of new lines have to be increasing.
+ */
+void source_line_begin(uint32_t loc);
+
+/**
+ * Decodes a source position.
+ */
+void get_presumed_position(const source_position_t *pos,
+                           presumed_position_t *presumed);
+
+/**
+ * Returns the presumed input name of a position, NULL if it is unknown.
+ */
+const char *get_source_position_input_name(const source_position_t *pos);
+
+/**
+ * Returns the presumed line number of a position.
+ */
+unsigned get_source_position_linenr(const source_position_t *pos);
+
+#endif
@@ -29,6 +29,7 @@ struct symbol_t {
 	const char       *string;
 	unsigned short    ID;
 	unsigned short    pp_ID;
+	unsigned          length;   /**< strlen(string) */
 	entity_t         *entity;
 	pp_definition_t  *pp_definition;
 };
@@ -25,15 +25,44 @@
 #include "adt/hash_string.h"
 #include "adt/obst.h"
 
+#include <stdint.h>
+#include <string.h>
+
+/* the symbols of all keywords and other token strings */
+#include "gen_keywords.h"
+
 struct obstack symbol_obstack;
 
+/** the string of a symbol together with its length and hash_string_words() */
+typedef struct symbol_key_t {
+	const char *string;
+	size_t      length;
+	unsigned    hash;
+	bool        copy;    /**< a new symbol needs a copy of the string */
+} symbol_key_t;
+
+static inline bool symbol_has_string(const symbol_t *symbol, symbol_key_t key)
+{
+	return symbol->length == key.length
+	    && memcmp(symbol->string, key.string, key.length) == 0;
+}
+
 static inline
-void init_symbol_table_entry(symbol_t *entry, const char *string)
+void init_symbol_table_entry(symbol_t *entry, symbol_key_t key)
 {
+	const char *string = key.string;
+	if (key.copy) {
+		char *copy = obstack_alloc(&symbol_obstack, key.length + 1);
+		memcpy(copy, key.string, key.length);
+		copy[key.length] = '\0';
+		string = copy;
+	}
 	entry->string = string;
+	entry->length = (unsigned) key.length;
 	entry->ID     = T_IDENTIFIER;
 	entry->pp_ID  = TP_IDENTIFIER;
-	entry->entity = NULL;
+	entry->entity        = NULL;
+	entry->pp_definition = NULL;
 }
 
 #define HashSet                    symbol_table_t
@@ -42,12 +71,12 @@ void init_symbol_table_entry(symbol_t *entry, const char *string)
 #define ValueType                  symbol_t*
 #define NullValue                  NULL
 #define DeletedValue               ((symbol_t*)-1)
-#define KeyType                    const char *
-#define ConstKeyType               const char *
-#define GetKey(value)              (value)->string
-#define InitData(this,value,key)   ((void)((value) = (ValueType)obstack_alloc(&symbol_obstack, sizeof(symbol_t)), init_symbol_table_entry((value), key)))
-#define Hash(this, key)            hash_string(key)
-#define KeysEqual(this,key1,key2)  (strcmp(key1, key2) == 0)
+#define KeyType                    symbol_key_t
+#define ConstKeyType               symbol_key_t
+#define GetKey(value)              (value)
+#define InitData(this,value,key)   ((void)((value) = (ValueType)obstack_alloc(&symbol_obstack, sizeof(symbol_t)), init_symbol_table_entry((value), (key))))
+#define Hash(this, key)            (key).hash
+#define KeysEqual(this,key1,key2)  symbol_has_string(key1, key2)
 #define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(symbol_table_hash_entry_t))
 #define SCALAR_RETURN
 
@@ -66,9 +95,41 @@ void init_symbol_table_entry(symbol_t *entry, const char *string)
 
 static symbol_table_t  symbol_table;
 
+/**
+ * Returns the static symbol of a token string or NULL if the string is no
+ * token string, see gen_keywords.c.
+ */
+static inline symbol_t *find_keyword(symbol_key_t key)
+{
+	unsigned slot = keyword_slots[KEYWORD_SLOT(key.hash)];
+	if (slot == 0)
+		return NULL;
+
+	symbol_t *symbol = &keyword_symbols[slot - 1];
+	return symbol_has_string(symbol, key) ? symbol : NULL;
+}
+
+static symbol_t *insert(symbol_key_t key)
+{
+	symbol_t *keyword = find_keyword(key);
+	if (keyword != NULL)
+		return keyword;
+
+	return _symbol_table_insert(&symbol_table, key);
+}
+
 symbol_t *symbol_table_insert(const char *string)
 {
-	return _symbol_table_insert(&symbol_table, string);
+	size_t       len = strlen(string);
+	symbol_key_t key = { string, len, hash_string_words(string, len), false };
+	return insert(key);
+}
+
+symbol_t *symbol_table_insert_string(const char *string, size_t len,
+                                     unsigned hash)
+{
+	symbol_key_t key = { string, len, hash, true };
+	return insert(key);
 }
 
 void init_symbol_table(void)
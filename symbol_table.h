@@ -20,11 +20,26 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
+#include <stddef.h>
+
 #include "symbol.h"
 #include "adt/obst.h"
 
+/**
+ * Returns the symbol for a NUL terminated string. A new symbol uses the
+ * string itself, so it has to stay alive.
+ */
 symbol_t *symbol_table_insert(const char *string);
 
+/**
+ * Returns the symbol for the len characters at string, which need no NUL
+ * terminator. hash has to be hash_string_words(string, len). Only a new
+ * symbol allocates memory: a terminated copy of the string on the symbol
+ * obstack.
+ */
+symbol_t *symbol_table_insert_string(const char *string, size_t len,
+                                     unsigned hash);
+
 void init_symbol_table(void);
 void exit_symbol_table(void);
 
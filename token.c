@@ -32,7 +32,7 @@
 static symbol_t *token_symbols[T_LAST_TOKEN];
 static symbol_t *pp_token_symbols[TP_LAST_TOKEN];
 
-const source_position_t builtin_source_position = { "<built-in>", 0 };
+const source_position_t builtin_source_position = { SOURCE_LOC_BUILTIN };
 
 static int last_id;
 
@@ -72,7 +72,7 @@ static void register_pp_token(unsigned mode, token_type_t id,
 	if (! (c_mode & mode))
 		return;
 
-	symbol_t *symbol = intern_register_token(id, string);
+	symbol_t *symbol = intern_register_pp_token(id, string);
 	symbol->pp_ID = id;
 }
 
@@ -134,6 +134,11 @@ symbol_t *get_token_symbol(const token_t *token)
 	return token_symbols[token->type];
 }
 
+symbol_t *get_pp_token_symbol(const token_t *token)
+{
+	return pp_token_symbols[token->type];
+}
+
 static void print_stringrep(const string_t *string, FILE *f)
 {
 	for (size_t i = 0; i < string->size; ++i) {
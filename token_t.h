@@ -21,10 +21,12 @@
 #define TOKEN_T_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "string_rep.h"
 #include "symbol.h"
 #include "symbol_table.h"
 #include "type.h"
+#include "source_position.h"
 
 typedef enum token_type_t {
 	T_ERROR = -1,
@@ -50,17 +52,13 @@ typedef enum preprocessor_token_type_t {
 	TP_LAST_TOKEN
 } preprocessor_token_type_t;
 
-typedef struct source_position_t source_position_t;
-struct source_position_t {
-	const char *input_name;
-	unsigned    linenr;
-};
-
 /* position used for "builtin" declarations/types */
 extern const source_position_t builtin_source_position;
 
 typedef struct {
 	int                type;
+	bool               space_before; /**< whitespace precedes the token (preprocessor only) */
+	bool               no_expand;    /**< identifier is never macro expanded again, C11 6.10.3.4p2 (preprocessor only) */
 	symbol_t          *symbol;  /**< contains identifier. Contains number suffix for numbers */
 	string_t           literal; /**< string value/literal value */
 	source_position_t  source_position;
@@ -72,6 +70,7 @@ void print_token_type(FILE *out, token_type_t token_type);
 void print_token(FILE *out, const token_t *token);
 
 symbol_t *get_token_symbol(const token_t *token);
+symbol_t *get_pp_token_symbol(const token_t *token);
 
 void print_pp_token_type(FILE *out, int type);
 void print_pp_token(FILE *out, const token_t *token);
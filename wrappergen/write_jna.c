@@ -48,9 +48,11 @@ static void write_type(type_t *type);
 
 static bool is_system_header(const char *fname)
 {
+	if (fname == NULL)
+		return false;
 	if (strncmp(fname, "/usr/include", 12) == 0)
 		return true;
-	if (fname == builtin_source_position.input_name)
+	if (strcmp(fname, "<built-in>") == 0)
 		return true;
 	return false;
 }
@@ -538,7 +540,8 @@ void write_jna_decls(FILE *output, const translation_unit_t *unit)
 	for ( ; entity != NULL; entity = entity->base.next) {
 		if (entity->kind != ENTITY_FUNCTION)
 			continue;
-		const char *input_name = entity->base.source_position.input_name;
+		const char *input_name
+			= get_source_position_input_name(&entity->base.source_position);
 		if (is_system_header(input_name))
 			continue;
 		if (output_limits != NULL) {